@@ -1,35 +1,38 @@
 #pragma once
 
-class BlueNoiseStreamLUT
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+#include "pcg/pcg_basic.h"
+#include "mathutils.h"
+#include "cdftable.h"
+#include "spmd.h"
+#include "tableregistry.h"
+#include "platform.h"
+
+struct BlueNoiseLUTProgram
 {
-public:
-	BlueNoiseStreamLUT(pcg32_random_t rng)
-		: m_rng(rng)
+	// Filter uniform white noise to remove low frequencies and make it blue.
+	// A side effect is the noise becomes non uniform.
+	static constexpr float c_xCoefficients[3] = {0.5f, -1.0f, 0.5f};
+
+	// the noise is also [-1,1] now, normalize to [0,1]
+	float Normalize(float y) const
 	{
-		m_lastValues[0] = RandomFloat01();
-		m_lastValues[1] = RandomFloat01();
+		return y * 0.5f + 0.5f;
 	}
 
-	float Next()
+	float Remap(float x) const
 	{
-		// Filter uniform white noise to remove low frequencies and make it blue.
-		// A side effect is the noise becomes non uniform.
-		static const float xCoefficients[3] = {0.5f, -1.0f, 0.5f};
-
-		float value = RandomFloat01();
-
-		float y =
-			value * xCoefficients[0] +
-			m_lastValues[0] * xCoefficients[1] +
-			m_lastValues[1] * xCoefficients[2];
-
-		m_lastValues[1] = m_lastValues[0];
-		m_lastValues[0] = value;
-
-		// the noise is also [-1,1] now, normalize to [0,1]
-		float x = y * 0.5f + 0.5f;
-
 		// Make the noise uniform again by putting it through a LUT of the CDF
+		return SamplePaddedTable(LUT(), c_LUTSize, x);
+	}
+
+	// The table registry's copy of the LUT, which every stream shares
+	static const float* LUT()
+	{
 		static const float LUT[] =
 		{
 			0.000008f,
@@ -95,141 +98,494 @@ public:
 			0.998971f,  // 60
 			0.999558f,
 			0.999887f,
-			0.999991f
+			0.999991f,
+			0.999991f   // padding, a copy of the last entry, for SamplePaddedTable
 		};
-		static const size_t lutSize = _countof(LUT);
-
-		float xindexf = std::min(x * float(lutSize - 1), (float)(lutSize - 1));
-		int xindex1 = int(xindexf);
-		int xindex2 = std::min(xindex1 + 1, (int)lutSize - 1);
-		float xindexfract = xindexf - std::floor(xindexf);
-
-		float y1 = LUT[xindex1];
-		float y2 = LUT[xindex2];
-
-		if (xindex1 == 0 && xindexfract == 0.0f)
-			y1 = y2 = 0.0f;
-		else if (xindex1 == lutSize - 1)
-			y1 = y2 = 1.0f;
+		static std::atomic<const float*> registered{ nullptr };
+		return BuiltInTable(registered, LUT, _countof(LUT));
+	}
+	static const size_t c_LUTSize = 64;
+};
 
-		return Lerp(y1, y2, xindexfract);
+class BlueNoiseStreamLUT
+{
+public:
+	BlueNoiseStreamLUT(pcg32_random_t rng)
+		: m_stream(&rng)
+	{
 	}
 
-private:
-	float RandomFloat01()
+	float Next()
 	{
-		// return a uniform white noise random float between 0 and 1.
-		// Can use whatever RNG you want, such as std::mt19937.
-		return ldexpf((float)pcg32_random_r(&m_rng), -32);
+		float ret;
+		m_stream.Next(&ret);
+		return ret;
 	}
 
-	pcg32_random_t m_rng;
-	float m_lastValues[2] = {};
+private:
+	NoiseStreamSPMD<1, BlueNoiseLUTProgram> m_stream;
 };
 
-class BlueNoiseStreamPolynomial
+// The same as BlueNoiseStreamLUT, but only using integer math, so that it gives the exact same output on every
+// compiler and CPU. That makes it usable for lockstep replays and networked simulations, where float results that
+// vary with FMA contraction or the instruction set would cause desyncs. Next() returns the value as Q0.32 fixed point,
+// so the value as a float is ldexpf(float(Next()), -32).
+class BlueNoiseStreamFixedPoint
 {
 public:
-	BlueNoiseStreamPolynomial(pcg32_random_t rng)
+	BlueNoiseStreamFixedPoint(pcg32_random_t rng)
 		: m_rng(rng)
 	{
-		m_lastValues[0] = RandomFloat01();
-		m_lastValues[1] = RandomFloat01();
+		m_lastValues[0] = pcg32_random_r(&m_rng);
+		m_lastValues[1] = pcg32_random_r(&m_rng);
 	}
-	
-	float Next()
-	{
-		// Filter uniform white noise to remove low frequencies and make it blue.
-		// A side effect is the noise becomes non uniform.
-		static const float xCoefficients[3] = {0.5f, -1.0f, 0.5f};
 
-		float value = RandomFloat01();
+	uint32_t Next()
+	{
+		// The white noise is the uint32 from PCG, which is already [0,1) in Q0.32
+		uint32_t value = pcg32_random_r(&m_rng);
 
-		float y =
-			value * xCoefficients[0] +
-			m_lastValues[0] * xCoefficients[1] +
-			m_lastValues[1] * xCoefficients[2];
+		// Filter with {0.5, -1, 0.5} and normalize from [-1,1] to [0,1] like the float version does: x = y * 0.5 + 0.5.
+		// Multiplying that through by 4 gives value - 2 * last + lastlast + 2, which fits in 35 bits, and then
+		// dividing by 4 puts it back in Q0.32, and never goes past 0xFFFFFFFF.
+		int64_t y4 = int64_t(value) - 2 * int64_t(m_lastValues[0]) + int64_t(m_lastValues[1]) + (int64_t(1) << 33);
+		uint32_t x = uint32_t(y4 >> 2);
 
 		m_lastValues[1] = m_lastValues[0];
 		m_lastValues[0] = value;
 
-		// the noise is also [-1,1] now, normalize to [0,1]
-		float x = y * 0.5f + 0.5f;
+		// The LUT from BlueNoiseStreamLUT, rounded to Q0.32
+		const uint32_t* LUT = FixedPointLUT();
+		const uint32_t lutSize = c_LUTSize;
+
+		// x * (lutSize - 1) in 32.32 fixed point. The integer part is the index, and since x < 1 it is at most lutSize - 2.
+		// The fractional part is the lerp amount in Q0.32.
+		uint64_t xindex = uint64_t(x) * (lutSize - 1);
+		uint32_t xindex1 = uint32_t(xindex >> 32);
+		uint64_t xindexfract = xindex & 0xFFFFFFFF;
 
+		// The LUT is monotonic, so the difference is never negative, and the product fits in 64 bits
+		uint32_t y1 = LUT[xindex1];
+		uint32_t y2 = LUT[xindex1 + 1];
+		return y1 + uint32_t((uint64_t(y2 - y1) * xindexfract) >> 32);
+	}
+
+private:
+	// The table registry's copy of the LUT, shared by every stream
+	static const uint32_t* FixedPointLUT()
+	{
+		static const uint32_t LUT[] =
+		{
+			0x00008638, 0x000841ee, 0x001f5382, 0x004bb1af,
+			0x00938583, 0x01081c2e, 0x01a61e0c, 0x0274e22a,
+			0x038183f9, 0x04d8665e, 0x067daa50, 0x0874c900,
+			0x0ac7863c, 0x0d7060bb, 0x1095e17e, 0x1426783a,
+			0x183d35eb, 0x1cbf2b24, 0x21bf37b9, 0x271f1498,
+			0x2ce2c12b, 0x32f4e011, 0x39774257, 0x4033508f,
+			0x47214f05, 0x4e543f1c, 0x55ad96a7, 0x5d2e2fbe,
+			0x64d9945b, 0x6cc2b51c, 0x74ba6267, 0x7c9741d1,
+			0x84904f6e, 0x8c6bdf4c, 0x944523f6, 0x9c167a96,
+			0xa3d1bb49, 0xab4f6167, 0xb2b5f5f1, 0xb9ea3593,
+			0xc0de19fc, 0xc795d4e9, 0xcdea67e8, 0xd409a240,
+			0xd9b7ae58, 0xdf034b0e, 0xe3eb399f, 0xe8667f91,
+			0xec69a4df, 0xefeed45f, 0xf30995ab, 0xf5a76d98,
+			0xf7e9a6f8, 0xf9d41fa7, 0xfb646ae4, 0xfcac29bf,
+			0xfdadc8fc, 0xfe788db0, 0xff0da5db, 0xff75b813,
+			0xffbc903f, 0xffe30878, 0xfff8982d, 0xffff6901
+		};
+		static std::atomic<const uint32_t*> registered{ nullptr };
+		return BuiltInTable(registered, LUT, _countof(LUT));
+	}
+	static const uint32_t c_LUTSize = 64;
+
+	pcg32_random_t m_rng;
+	uint32_t m_lastValues[2] = {};
+};
+
+struct BlueNoisePolynomialProgram
+{
+	// Filter uniform white noise to remove low frequencies and make it blue.
+	// A side effect is the noise becomes non uniform.
+	static constexpr float c_xCoefficients[3] = {0.5f, -1.0f, 0.5f};
+
+	// the noise is also [-1,1] now, normalize to [0,1]
+	float Normalize(float y) const
+	{
+		return y * 0.5f + 0.5f;
+	}
+
+	float Remap(float x) const
+	{
 		// Make the noise uniform again by putting it through a piecewise cubic polynomial approximation of the CDF
 		// Switched to Horner's method polynomials, and a polynomial array to avoid branching, per Marc Reynolds. Thanks!
-		float polynomialCoefficients[16] = {
+		const float* polynomialCoefficients = PolynomialCoefficients();
+		int first = std::min(int(x * 4.0f), 3) * 4;
+		return polynomialCoefficients[first + 3] + x * (polynomialCoefficients[first + 2] + x * (polynomialCoefficients[first + 1] + x * polynomialCoefficients[first + 0]));
+	}
+
+	// The table registry's copy of the coefficients, which is one cache line, shared by every stream
+	static const float* PolynomialCoefficients()
+	{
+		static const float polynomialCoefficients[16] = {
 			5.25964f, 0.039474f, 0.000708779f, 0.0f,
 			-5.20987f, 7.82905f, -1.93105f, 0.159677f,
 			-5.22644f, 7.8272f, -1.91677f, 0.15507f,
 			5.23882f, -15.761f, 15.8054f, -4.28323f
 		};
-		int first = std::min(int(x * 4.0f), 3) * 4;
-		return polynomialCoefficients[first + 3] + x * (polynomialCoefficients[first + 2] + x * (polynomialCoefficients[first + 1] + x * polynomialCoefficients[first + 0]));
+		static std::atomic<const float*> registered{ nullptr };
+		return BuiltInTable(registered, polynomialCoefficients, _countof(polynomialCoefficients));
+	}
+};
+
+class BlueNoiseStreamPolynomial
+{
+public:
+	BlueNoiseStreamPolynomial(pcg32_random_t rng)
+		: m_stream(&rng)
+	{
+	}
+
+	float Next()
+	{
+		float ret;
+		m_stream.Next(&ret);
+		return ret;
 	}
 
 private:
-	float RandomFloat01()
+	NoiseStreamSPMD<1, BlueNoisePolynomialProgram> m_stream;
+};
+
+// A scalar stream is a width 1 NoiseStreamSPMD, which has to stay as small as the generator and the two values of
+// history it keeps, for pools and arrays of thousands of streams. The programs with built in tables get them from
+// function local statics, so add nothing.
+static_assert(sizeof(BlueNoiseStreamPolynomial) == sizeof(pcg32_random_t) + 2 * sizeof(float), "A width 1 stream shouldn't carry lane padding or table pointers");
+static_assert(sizeof(BlueNoiseStreamFixedPoint) == sizeof(pcg32_random_t) + 2 * sizeof(uint32_t), "The fixed point stream shouldn't carry a table pointer");
+
+struct BlueNoiseHermiteProgram
+{
+	// Filter uniform white noise to remove low frequencies and make it blue.
+	// A side effect is the noise becomes non uniform.
+	static constexpr float c_xCoefficients[3] = {0.5f, -1.0f, 0.5f};
+
+	// the noise is also [-1,1] now, normalize to [0,1]
+	float Normalize(float y) const
 	{
-		// return a uniform white noise random float between 0 and 1.
-		// Can use whatever RNG you want, such as std::mt19937.
-		return ldexpf((float)pcg32_random_r(&m_rng), -32);
+		return y * 0.5f + 0.5f;
 	}
 
-	pcg32_random_t m_rng;
-	float m_lastValues[2] = {};
+	float Remap(float x) const
+	{
+		// Make the noise uniform again by putting it through a monotone piecewise cubic Hermite approximation of the CDF.
+		// Unlike the least squares fit, this can't go backwards or out of [0,1]. See MonotoneCubicFit.
+		// Each piece is a cubic in t, which goes from 0 to 1 across the piece.
+		const float* polynomialCoefficients = PolynomialCoefficients();
+		int piece = std::min(int(x * 8.0f), 7);
+		float t = x * 8.0f - float(piece);
+		int first = piece * 4;
+		return polynomialCoefficients[first + 3] + t * (polynomialCoefficients[first + 2] + t * (polynomialCoefficients[first + 1] + t * polynomialCoefficients[first + 0]));
+	}
+	// The table registry's copy of the coefficients, shared by every stream
+	static const float* PolynomialCoefficients()
+	{
+		static const float polynomialCoefficients[32] = {
+			0.0171326f, -0.0142948f, 0.00761686f, 0.0f,
+			0.00938253f, 0.033259f, 0.0304251f, 0.0104547f,
+			-0.0208718f, 0.0728959f, 0.125091f, 0.0835214f,
+			-0.0311933f, 0.0623456f, 0.208267f, 0.260636f,
+			-0.0310887f, 0.0310477f, 0.239378f, 0.500056f,
+			-0.0208824f, -0.0102474f, 0.208207f, 0.739393f,
+			0.00944236f, -0.0614545f, 0.125066f, 0.916471f,
+			0.017178f, -0.0371856f, 0.0304836f, 0.989524f
+		};
+		static std::atomic<const float*> registered{ nullptr };
+		return BuiltInTable(registered, polynomialCoefficients, _countof(polynomialCoefficients));
+	}
 };
 
-class RedNoiseStreamPolynomial
+class BlueNoiseStreamHermite
 {
 public:
-	RedNoiseStreamPolynomial(pcg32_random_t rng)
+	BlueNoiseStreamHermite(pcg32_random_t rng)
+		: m_stream(&rng)
+	{
+	}
+
+	float Next()
+	{
+		float ret;
+		m_stream.Next(&ret);
+		return ret;
+	}
+
+private:
+	NoiseStreamSPMD<1, BlueNoiseHermiteProgram> m_stream;
+};
+
+// Blue noise with a distribution other than uniform, such as gaussian.
+// The LUT is the CDF of the filtered noise composed with the ICDF of the target distribution, made by MakeFusedLUT,
+// so a single lookup gives the target distribution, instead of going to uniform and then doing a second transform.
+struct BlueNoiseFusedProgram
+{
+	// Filter uniform white noise to remove low frequencies and make it blue.
+	// A side effect is the noise becomes non uniform.
+	static constexpr float c_xCoefficients[3] = {0.5f, -1.0f, 0.5f};
+
+	// the noise is also [-1,1] now, normalize to [0,1]
+	float Normalize(float y) const
+	{
+		return y * 0.5f + 0.5f;
+	}
+
+	float Remap(float x) const
+	{
+		// Go straight to the target distribution through the fused LUT
+		return SamplePaddedLUT(m_LUT, m_LUTSize, x);
+	}
+
+	// The table registry's copy of the LUT, padded by PadTable, shared by every stream made from the same LUT.
+	// m_LUTSize doesn't count the padding.
+	const float* m_LUT;
+	size_t m_LUTSize;
+};
+
+class BlueNoiseStreamFused
+{
+public:
+	// The LUT is copied, so it doesn't need to outlive the stream
+	BlueNoiseStreamFused(pcg32_random_t rng, const float* LUT, size_t LUTSize)
+		: m_stream(&rng, BlueNoiseFusedProgram{ TableRegistry::Get().Register(PadTable(std::vector<float>(LUT, LUT + LUTSize))), LUTSize })
+	{
+	}
+
+	float Next()
+	{
+		float ret;
+		m_stream.Next(&ret);
+		return ret;
+	}
+
+private:
+	NoiseStreamSPMD<1, BlueNoiseFusedProgram> m_stream;
+};
+
+// The same as BlueNoiseStreamLUT, but the CDF table is a level of a CDF table pyramid, chosen when the stream is made.
+// That way one characterization run serves every quality tier, from a small table that stays in registers, to a
+// large table for offline use.
+struct BlueNoiseCDFTableProgram
+{
+	// Filter uniform white noise to remove low frequencies and make it blue.
+	// A side effect is the noise becomes non uniform.
+	static constexpr float c_xCoefficients[3] = {0.5f, -1.0f, 0.5f};
+
+	// the noise is also [-1,1] now, normalize to [0,1]
+	float Normalize(float y) const
+	{
+		return y * 0.5f + 0.5f;
+	}
+
+	float Remap(float x) const
+	{
+		// Make the noise uniform again by putting it through a LUT of the CDF
+		return SamplePaddedTable(m_LUT, m_LUTSize, x);
+	}
+
+	// The table registry's copy of the table, padded by PadTable, shared by every stream made from the same level.
+	// m_LUTSize doesn't count the padding.
+	const float* m_LUT;
+	size_t m_LUTSize;
+};
+
+class BlueNoiseStreamCDFTable
+{
+public:
+	// Uses the largest level of the pyramid that is no larger than tableSize
+	BlueNoiseStreamCDFTable(pcg32_random_t rng, const CDFTablePyramid& pyramid, size_t tableSize)
+		: BlueNoiseStreamCDFTable(rng, pyramid.LevelAtMost(tableSize))
+	{
+	}
+
+	BlueNoiseStreamCDFTable(pcg32_random_t rng, const CDFTableLevel& level)
+		: m_stream(&rng, BlueNoiseCDFTableProgram{ TableRegistry::Get().Register(PadTable(level.table)), level.table.size() })
+	{
+	}
+
+	float Next()
+	{
+		float ret;
+		m_stream.Next(&ret);
+		return ret;
+	}
+
+	size_t TableSize() const
+	{
+		return m_stream.Program().m_LUTSize;
+	}
+
+private:
+	NoiseStreamSPMD<1, BlueNoiseCDFTableProgram> m_stream;
+};
+
+// Blue noise from any N tap FIR filter, such as the kernels FIRTest characterizes, made uniform with a CDF table.
+// The CDF table is evenly spaced over the analytic bounds of the kernel (FIRBounds), normalized to [0,1].
+// It can come from the CDF cache, or from running NextFiltered() and making a table from the values.
+//
+// The history of white noise is a power of two ring buffer that is written twice, at index and index + size, so the
+// last N values are always contiguous in memory. That makes the tap sum a plain dot product with no wrapping, which
+// is split across 4 accumulators so the adds don't wait on each other, and fully unrolls for small N.
+template <size_t N>
+class BlueNoiseStreamFIR
+{
+public:
+	static_assert(N > 0, "BlueNoiseStreamFIR needs at least one tap");
+
+	// The kernel can have fewer than N taps, which is the same as padding it with zeros, but not more
+	BlueNoiseStreamFIR(pcg32_random_t rng, const std::vector<float>& kernel, const std::vector<float>& CDF)
 		: m_rng(rng)
+		, m_CDF(TableRegistry::Get().Register(PadTable(CDF)))
+		, m_CDFSize(CDF.size())
 	{
-		m_lastValues[0] = RandomFloat01();
-		m_lastValues[1] = RandomFloat01();
+		assert(kernel.size() <= N && "BlueNoiseStreamFIR<N> would drop the taps of the kernel past N");
+
+		// store the kernel reversed, so it lines up with the history, which is oldest first.
+		// m_kernel[index] is the tap N - 1 - index values back.
+		for (size_t index = 0; index < N; ++index)
+		{
+			const size_t tap = N - 1 - index;
+			m_kernel[index] = (tap < kernel.size()) ? kernel[tap] : 0.0f;
+		}
+
+		// the bounds of the taps that are actually run
+		float boundsMin, boundsMax;
+		FIRBounds(std::vector<float>(m_kernel, m_kernel + N), boundsMin, boundsMax);
+		m_normalizeOffset = -boundsMin;
+		m_normalizeScale = (boundsMax > boundsMin) ? 1.0f / (boundsMax - boundsMin) : 1.0f;
+
+		// fill the history, like the other streams fill m_lastValues
+		for (size_t index = 0; index < N - 1; ++index)
+			Push(RandomFloat01());
 	}
 
 	float Next()
 	{
-		// Filter uniform white noise to remove high frequencies and make it red.
-		// A side effect is the noise becomes non uniform.
-		static const float xCoefficients[3] = { 0.25f, 0.5f, 0.25f };
+		float x = NextFiltered();
 
-		float value = RandomFloat01();
+		// Make the noise uniform again by putting it through a LUT of the CDF
+		return SamplePaddedTable(m_CDF, m_CDFSize, x);
+	}
 
-		float y =
-			value * xCoefficients[0] +
-			m_lastValues[0] * xCoefficients[1] +
-			m_lastValues[1] * xCoefficients[2];
+	// The filtered noise normalized to [0,1], before it's made uniform. Used to make the CDF table.
+	float NextFiltered()
+	{
+		Push(RandomFloat01());
 
-		m_lastValues[1] = m_lastValues[0];
-		m_lastValues[0] = value;
+		// the last N values, oldest first
+		const float* window = &m_history[m_index + c_historySize - (N - 1)];
+
+		float sums[4] = {};
+		size_t index = 0;
+		for (; index + 4 <= N; index += 4)
+		{
+			sums[0] += window[index + 0] * m_kernel[index + 0];
+			sums[1] += window[index + 1] * m_kernel[index + 1];
+			sums[2] += window[index + 2] * m_kernel[index + 2];
+			sums[3] += window[index + 3] * m_kernel[index + 3];
+		}
+		for (; index < N; ++index)
+			sums[index % 4] += window[index] * m_kernel[index];
+		float y = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+
+		// normalize from the kernel bounds to [0,1]
+		return std::min(std::max((y + m_normalizeOffset) * m_normalizeScale, 0.0f), 1.0f);
+	}
+
+private:
+	static constexpr size_t HistorySize()
+	{
+		size_t size = 1;
+		while (size < N)
+			size *= 2;
+		return size;
+	}
+	static const size_t c_historySize = HistorySize();
+
+	void Push(float value)
+	{
+		m_index = (m_index + 1) & (c_historySize - 1);
+		m_history[m_index] = value;
+		m_history[m_index + c_historySize] = value;
+	}
+
+	float RandomFloat01()
+	{
+		// return a uniform white noise random float between 0 and 1.
+		// Can use whatever RNG you want, such as std::mt19937.
+		return ldexpf((float)pcg32_random_r(&m_rng), -32);
+	}
+
+	pcg32_random_t m_rng;
+	const float* m_CDF;    // the table registry's copy, padded by PadTable
+	size_t m_CDFSize;      // not counting the padding
+	float m_normalizeOffset = 0.0f;
+	float m_normalizeScale = 1.0f;
+	size_t m_index = 0;
+	// not cache line aligned, the window into the history starts anywhere, so the loads are unaligned anyway
+	float m_kernel[N] = {};
+	float m_history[c_historySize * 2] = {};
+};
+
+struct RedNoisePolynomialProgram
+{
+	// Filter uniform white noise to remove high frequencies and make it red.
+	// A side effect is the noise becomes non uniform.
+	static constexpr float c_xCoefficients[3] = { 0.25f, 0.5f, 0.25f };
 
-		float x = y;
+	// the filter weights add up to 1, so the noise is already [0,1]
+	float Normalize(float y) const
+	{
+		return y;
+	}
 
+	float Remap(float x) const
+	{
 		// Make the noise uniform again by putting it through a piecewise cubic polynomial approximation of the CDF
 		// Switched to Horner's method polynomials, and a polynomial array to avoid branching, per Marc Reynolds. Thanks!
-		float polynomialCoefficients[16] = {
+		const float* polynomialCoefficients = PolynomialCoefficients();
+		int first = std::min(int(x * 4.0f), 3) * 4;
+		return polynomialCoefficients[first + 3] + x * (polynomialCoefficients[first + 2] + x * (polynomialCoefficients[first + 1] + x * polynomialCoefficients[first + 0]));
+	}
+
+	// The table registry's copy of the coefficients, which is one cache line, shared by every stream
+	static const float* PolynomialCoefficients()
+	{
+		static const float polynomialCoefficients[16] = {
 			5.25964f, 0.039474f, 0.000708779f, 0.0f,
 			-5.20987f, 7.82905f, -1.93105f, 0.159677f,
 			-5.22644f, 7.8272f, -1.91677f, 0.15507f,
 			5.23882f, -15.761f, 15.8054f, -4.28323f
 		};
-		int first = std::min(int(x * 4.0f), 3) * 4;
-		return polynomialCoefficients[first + 3] + x * (polynomialCoefficients[first + 2] + x * (polynomialCoefficients[first + 1] + x * polynomialCoefficients[first + 0]));
+		static std::atomic<const float*> registered{ nullptr };
+		return BuiltInTable(registered, polynomialCoefficients, _countof(polynomialCoefficients));
 	}
+};
 
-private:
-	float RandomFloat01()
+class RedNoiseStreamPolynomial
+{
+public:
+	RedNoiseStreamPolynomial(pcg32_random_t rng)
+		: m_stream(&rng)
 	{
-		// return a uniform white noise random float between 0 and 1.
-		// Can use whatever RNG you want, such as std::mt19937.
-		return ldexpf((float)pcg32_random_r(&m_rng), -32);
 	}
 
-	pcg32_random_t m_rng;
-	float m_lastValues[2] = {};
+	float Next()
+	{
+		float ret;
+		m_stream.Next(&ret);
+		return ret;
+	}
+
+private:
+	NoiseStreamSPMD<1, RedNoisePolynomialProgram> m_stream;
 };
 
 // From Nick Appleton:
@@ -0,0 +1,230 @@
+#include "ToUniformC.h"
+
+#include <atomic>
+#include <new>
+#include "BlueNoiseStream.h"
+#include "dispatch.h"
+
+// A stream is the state of a NoiseStreamSPMD<1, PROGRAM>, with the program chosen by type
+struct ToUniform_Stream
+{
+	ToUniform_StreamType type;
+	uint64_t state;
+	uint64_t inc;
+	float lastValue0;
+	float lastValue1;
+
+	// The table registry's copy of the CDF table, padded by PadTable, for ToUniform_BlueNoiseCDFTable.
+	// CDFSize doesn't count the padding.
+	const float* CDF;
+	size_t CDFSize;
+};
+
+namespace ToUniformCInternal
+{
+	// How many values the fills make at a time, which is the most white noise they keep on the stack
+	static const size_t c_blockSize = 256;
+
+	inline float NextFloat01(uint64_t& state, uint64_t inc)
+	{
+		float value = float(SPMDInternal::PCG32Output(state)) * SPMDInternal::c_uint32ToFloat01;
+		state = state * SPMDInternal::c_pcg32Multiplier + inc;
+		return value;
+	}
+
+	// The instruction set of the dispatch.h kernels that an implementation runs on. Auto is whatever Kernels() picked,
+	// which is the best the CPU has, unless TOUNIFORM_ISA says otherwise.
+	inline DispatchISA ImplementationISA(ToUniform_Implementation implementation)
+	{
+		switch (implementation)
+		{
+			case ToUniform_Scalar: return DispatchISA::Scalar;
+			case ToUniform_SSE: return DispatchISA::SSE42;
+			case ToUniform_AVX2: return DispatchISA::AVX2;
+			case ToUniform_AVX512: return DispatchISA::AVX512;
+			default: return Kernels().ISA;
+		}
+	}
+
+	inline ToUniform_Implementation ISAImplementation(DispatchISA ISA)
+	{
+		switch (ISA)
+		{
+			case DispatchISA::SSE42: return ToUniform_SSE;
+			case DispatchISA::AVX2: return ToUniform_AVX2;
+			case DispatchISA::AVX512: return ToUniform_AVX512;
+			default: return ToUniform_Scalar;
+		}
+	}
+
+	// NoiseStreamSPMD<1, PROGRAM>::Next(), count times, a block at a time: the white noise for the block from
+	// UniformFloats, then the filter and remap over the block, with the two values before it in front. Both are the
+	// kernels of dispatch.h for the instruction set, so every implementation gives the same bits.
+	template <typename PROGRAM>
+	void Fill(ToUniform_Implementation implementation, ToUniform_Stream& stream, const PROGRAM& program, float* out, size_t count)
+	{
+		const DispatchISA ISA = ImplementationISA(implementation);
+		const NoiseKernels& kernels = *KernelsFor(ISA);
+
+		pcg32_random_t rng;
+		rng.state = stream.state;
+		rng.inc = stream.inc;
+
+		// the oldest value first, so value i is filtered with values i-1 and i-2
+		alignas(64) float values[c_blockSize + 2];
+		while (count > 0)
+		{
+			const size_t blockCount = std::min(count, c_blockSize);
+			values[0] = stream.lastValue1;
+			values[1] = stream.lastValue0;
+			kernels.UniformFloats(rng, values + 2, blockCount);
+			DispatchProgram<PROGRAM>::Remap(ISA, program, values, out, blockCount);
+
+			stream.lastValue0 = values[blockCount + 1];
+			stream.lastValue1 = values[blockCount];
+			out += blockCount;
+			count -= blockCount;
+		}
+		stream.state = rng.state;
+	}
+
+	// Auto is always supported. The others need the CPU to run their instruction set, so SSE and up aren't supported
+	// on CPUs that aren't x86.
+	inline bool Supported(ToUniform_Implementation implementation)
+	{
+		if (implementation == ToUniform_Auto)
+			return true;
+		if (implementation < ToUniform_Auto || implementation >= ToUniform_ImplementationCount)
+			return false;
+		return KernelsFor(ImplementationISA(implementation)) != nullptr;
+	}
+
+	static std::atomic<int> s_implementation(ToUniform_Auto);
+
+	inline ToUniform_Implementation CurrentImplementation()
+	{
+		ToUniform_Implementation implementation = (ToUniform_Implementation)s_implementation.load(std::memory_order_relaxed);
+		if (implementation == ToUniform_Auto)
+			implementation = ISAImplementation(Kernels().ISA);
+		return implementation;
+	}
+
+	inline void Seed(ToUniform_Stream& stream, uint64_t seed, uint64_t sequence)
+	{
+		// the same as NoiseStreamSPMD's constructor
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, seed, sequence);
+		stream.state = rng.state;
+		stream.inc = rng.inc;
+		stream.lastValue0 = NextFloat01(stream.state, stream.inc);
+		stream.lastValue1 = NextFloat01(stream.state, stream.inc);
+	}
+
+	inline ToUniform_Stream* Create(ToUniform_StreamType type, const float* CDF, size_t CDFSize, uint64_t seed, uint64_t sequence)
+	{
+		ToUniform_Stream* stream = new (std::nothrow) ToUniform_Stream;
+		if (!stream)
+			return nullptr;
+		stream->type = type;
+		stream->CDF = CDF;
+		stream->CDFSize = CDFSize;
+		Seed(*stream, seed, sequence);
+		return stream;
+	}
+}
+
+extern "C" {
+
+int ToUniform_Version(void)
+{
+	return TOUNIFORM_C_VERSION;
+}
+
+ToUniform_Stream* ToUniform_CreateStream(ToUniform_StreamType type, uint64_t seed, uint64_t sequence)
+{
+	if (type < 0 || type >= ToUniform_StreamTypeCount || type == ToUniform_BlueNoiseCDFTable)
+		return nullptr;
+	return ToUniformCInternal::Create(type, nullptr, 0, seed, sequence);
+}
+
+ToUniform_Stream* ToUniform_CreateStreamFromTable(const float* CDF, size_t count, uint64_t seed, uint64_t sequence)
+{
+	if (!CDF || count < 2)
+		return nullptr;
+	const float* registered = TableRegistry::Get().Register(PadTable(std::vector<float>(CDF, CDF + count)));
+	ToUniform_Stream* stream = ToUniformCInternal::Create(ToUniform_BlueNoiseCDFTable, registered, count, seed, sequence);
+	if (!stream)
+		TableRegistry::Get().Release(registered);
+	return stream;
+}
+
+void ToUniform_Seed(ToUniform_Stream* stream, uint64_t seed, uint64_t sequence)
+{
+	ToUniformCInternal::Seed(*stream, seed, sequence);
+}
+
+void ToUniform_Fill(ToUniform_Stream* stream, float* out, size_t count)
+{
+	using namespace ToUniformCInternal;
+	ToUniform_Implementation implementation = CurrentImplementation();
+	switch (stream->type)
+	{
+		case ToUniform_BlueNoiseLUT: Fill(implementation, *stream, BlueNoiseLUTProgram(), out, count); break;
+		case ToUniform_BlueNoisePolynomial: Fill(implementation, *stream, BlueNoisePolynomialProgram(), out, count); break;
+		case ToUniform_BlueNoiseHermite: Fill(implementation, *stream, BlueNoiseHermiteProgram(), out, count); break;
+		case ToUniform_RedNoisePolynomial: Fill(implementation, *stream, RedNoisePolynomialProgram(), out, count); break;
+		case ToUniform_BlueNoiseCDFTable: Fill(implementation, *stream, BlueNoiseCDFTableProgram{ stream->CDF, stream->CDFSize }, out, count); break;
+		default: break;
+	}
+}
+
+void ToUniform_FillStreams(ToUniform_Stream* const* streams, size_t streamCount, float* out, size_t count)
+{
+	for (size_t index = 0; index < streamCount; ++index)
+		ToUniform_Fill(streams[index], out + index * count, count);
+}
+
+ToUniform_StreamType ToUniform_GetStreamType(const ToUniform_Stream* stream)
+{
+	return stream->type;
+}
+
+void ToUniform_DestroyStream(ToUniform_Stream* stream)
+{
+	if (stream && stream->type == ToUniform_BlueNoiseCDFTable)
+		TableRegistry::Get().Release(stream->CDF);
+	delete stream;
+}
+
+int ToUniform_ImplementationSupported(ToUniform_Implementation implementation)
+{
+	return ToUniformCInternal::Supported(implementation) ? 1 : 0;
+}
+
+int ToUniform_SetImplementation(ToUniform_Implementation implementation)
+{
+	if (!ToUniformCInternal::Supported(implementation))
+		return 0;
+	ToUniformCInternal::s_implementation.store(implementation, std::memory_order_relaxed);
+	return 1;
+}
+
+ToUniform_Implementation ToUniform_GetImplementation(void)
+{
+	return ToUniformCInternal::CurrentImplementation();
+}
+
+const char* ToUniform_ImplementationName(ToUniform_Implementation implementation)
+{
+	switch (implementation)
+	{
+		case ToUniform_Auto: return "Auto";
+		case ToUniform_Scalar: return "Scalar";
+		case ToUniform_SSE: return "SSE";
+		case ToUniform_AVX2: return "AVX2";
+		case ToUniform_AVX512: return "AVX512";
+		default: return "Unknown";
+	}
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// C API for the noise streams, built as the ToUniformC shared library, for using them from C, Python (ctypes/cffi),
+// Rust, or an engine, without the C++ headers.
+// * Streams are opaque handles. Create one, fill buffers from it, and destroy it.
+// * A stream gives the same values as the C++ stream of the same type, made with the same seed and sequence.
+// * The bulk fills run several positions of a stream at once with SIMD, using the kernels of dispatch.h. Which
+//   instruction set that uses can be chosen at runtime, and every choice gives the same values, so it only changes
+//   the speed.
+// * The ABI is stable: the enum values won't change meaning, new ones only get added on the end, and no structs are
+//   passed across it. ToUniform_Version() can be checked against TOUNIFORM_C_VERSION.
+// A stream must only be used by one thread at a time. Different streams can be used from different threads.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+	#if defined(TOUNIFORM_C_EXPORTS)
+		#define TOUNIFORM_C_API __declspec(dllexport)
+	#else
+		#define TOUNIFORM_C_API __declspec(dllimport)
+	#endif
+#elif defined(__GNUC__) || defined(__clang__)
+	#define TOUNIFORM_C_API __attribute__((visibility("default")))
+#else
+	#define TOUNIFORM_C_API
+#endif
+
+#define TOUNIFORM_C_VERSION 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ToUniform_Stream ToUniform_Stream;
+
+typedef enum ToUniform_StreamType
+{
+	ToUniform_BlueNoiseLUT = 0,          // BlueNoiseStreamLUT
+	ToUniform_BlueNoisePolynomial = 1,   // BlueNoiseStreamPolynomial
+	ToUniform_BlueNoiseHermite = 2,      // BlueNoiseStreamHermite
+	ToUniform_RedNoisePolynomial = 3,    // RedNoiseStreamPolynomial
+	ToUniform_BlueNoiseCDFTable = 4,     // BlueNoiseStreamCDFTable, made with ToUniform_CreateStreamFromTable
+	ToUniform_StreamTypeCount
+} ToUniform_StreamType;
+
+typedef enum ToUniform_Implementation
+{
+	ToUniform_Auto = 0,     // the fastest one the CPU supports, or the one the TOUNIFORM_ISA environment variable picks
+	ToUniform_Scalar = 1,   // one value at a time
+	ToUniform_SSE = 2,      // 4 values at a time, on x86 CPUs that have SSE4.2
+	ToUniform_AVX2 = 3,     // 8 values at a time, on x86 CPUs that have AVX2
+	ToUniform_AVX512 = 4,   // 16 values at a time, on x86 CPUs that have AVX-512
+	ToUniform_ImplementationCount
+} ToUniform_Implementation;
+
+// TOUNIFORM_C_VERSION of the library
+TOUNIFORM_C_API int ToUniform_Version(void);
+
+// Makes a stream, seeded like pcg32_srandom_r(seed, sequence). Returns NULL if the type isn't valid, or is
+// ToUniform_BlueNoiseCDFTable, which needs a table.
+TOUNIFORM_C_API ToUniform_Stream* ToUniform_CreateStream(ToUniform_StreamType type, uint64_t seed, uint64_t sequence);
+
+// Makes a ToUniform_BlueNoiseCDFTable stream, which makes the noise uniform with a CDF table of count entries, evenly
+// spaced over [0,1]. The table is copied, so it doesn't need to outlive the stream, and the copy is shared by the
+// streams made from the same table, until the last of them is destroyed. Returns NULL if count < 2.
+TOUNIFORM_C_API ToUniform_Stream* ToUniform_CreateStreamFromTable(const float* CDF, size_t count, uint64_t seed, uint64_t sequence);
+
+// Restarts a stream, as if it was just made with this seed and sequence
+TOUNIFORM_C_API void ToUniform_Seed(ToUniform_Stream* stream, uint64_t seed, uint64_t sequence);
+
+// Writes the next count values of the stream to out
+TOUNIFORM_C_API void ToUniform_Fill(ToUniform_Stream* stream, float* out, size_t count);
+
+// Writes the next count values of each of streamCount streams to out, the first stream's values first.
+// The same as calling ToUniform_Fill on each, with one call across the language boundary instead of many.
+TOUNIFORM_C_API void ToUniform_FillStreams(ToUniform_Stream* const* streams, size_t streamCount, float* out, size_t count);
+
+TOUNIFORM_C_API ToUniform_StreamType ToUniform_GetStreamType(const ToUniform_Stream* stream);
+
+// Does nothing if stream is NULL
+TOUNIFORM_C_API void ToUniform_DestroyStream(ToUniform_Stream* stream);
+
+// Returns 1 if this CPU can run the implementation, else 0
+TOUNIFORM_C_API int ToUniform_ImplementationSupported(ToUniform_Implementation implementation);
+
+// Chooses the implementation the fills use, for every stream. ToUniform_Auto is the default.
+// Returns 0, and changes nothing, if the CPU can't run it.
+TOUNIFORM_C_API int ToUniform_SetImplementation(ToUniform_Implementation implementation);
+
+// The implementation the fills use, with ToUniform_Auto resolved to what it chose
+TOUNIFORM_C_API ToUniform_Implementation ToUniform_GetImplementation(void);
+
+TOUNIFORM_C_API const char* ToUniform_ImplementationName(ToUniform_Implementation implementation);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "platform.h"
+
+// Writes a file on a background thread, so that making the output and writing it to disk overlap.
+// Writes go into one of two buffers. When it fills, it is handed to the writer thread, and writing continues in the
+// other buffer while the first goes to disk. The caller only waits if it fills a buffer before the writer thread has
+// finished the one before, which is when the disk is the bottleneck anyway.
+// Only one thread should write to an AsyncFileWriter at a time.
+
+static const size_t c_asyncWriterBufferSize = 1 << 22;
+
+class AsyncFileWriter
+{
+public:
+	AsyncFileWriter(const char* fileName, const char* mode, size_t bufferSize = c_asyncWriterBufferSize)
+		: m_bufferSize(bufferSize)
+	{
+		fopen_s(&m_file, fileName, mode);
+		for (std::vector<char>& buffer : m_buffers)
+			buffer.resize(bufferSize);
+		m_thread = std::thread(&AsyncFileWriter::WriterThread, this);
+	}
+
+	AsyncFileWriter(const AsyncFileWriter&) = delete;
+	AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+	~AsyncFileWriter()
+	{
+		Close();
+	}
+
+	// False if the file couldn't be opened. Writes to a file that isn't open do nothing.
+	bool IsOpen() const
+	{
+		return m_file != nullptr;
+	}
+
+	void Write(const void* data, size_t size)
+	{
+		const char* bytes = (const char*)data;
+		while (size > 0)
+		{
+			size_t amount = std::min(size, m_bufferSize - m_used[m_current]);
+			memcpy(m_buffers[m_current].data() + m_used[m_current], bytes, amount);
+			m_used[m_current] += amount;
+			bytes += amount;
+			size -= amount;
+
+			if (m_used[m_current] == m_bufferSize)
+				Submit();
+		}
+	}
+
+	// Formats straight into the buffer, like fprintf
+	void Printf(const char* format, ...)
+	{
+		va_list args;
+		va_start(args, format);
+		VPrintf(format, args);
+		va_end(args);
+	}
+
+	void VPrintf(const char* format, va_list args)
+	{
+		// Format into the free space at the end of the buffer. If it doesn't fit, the length it needs is known, so
+		// hand over the buffer and format it again in the fresh one, or in a temporary if it's bigger than a buffer.
+		size_t& used = m_used[m_current];
+		size_t space = m_bufferSize - used;
+
+		va_list argsCopy;
+		va_copy(argsCopy, args);
+		int length = vsnprintf(m_buffers[m_current].data() + used, space, format, argsCopy);
+		va_end(argsCopy);
+
+		if (length < 0)
+			return;
+
+		if (size_t(length) < space)
+		{
+			used += length;
+			return;
+		}
+
+		std::vector<char> formatted(size_t(length) + 1);
+		vsnprintf(formatted.data(), formatted.size(), format, args);
+		Write(formatted.data(), size_t(length));
+	}
+
+	// Hands over what has been written so far, and waits until it is all in the file
+	void Flush()
+	{
+		Submit();
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [&]() { return !m_pending; });
+		if (m_file)
+			fflush(m_file);
+	}
+
+	// Flushes, stops the writer thread and closes the file. Called by the destructor.
+	void Close()
+	{
+		if (!m_thread.joinable())
+			return;
+
+		Flush();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_exit = true;
+		}
+		m_condition.notify_all();
+		m_thread.join();
+
+		if (m_file)
+			fclose(m_file);
+		m_file = nullptr;
+	}
+
+private:
+	// Gives the current buffer to the writer thread and switches to the other one, waiting for the writer to finish
+	// with it first, if it hasn't
+	void Submit()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [&]() { return !m_pending; });
+		if (m_used[m_current] == 0)
+			return;
+
+		m_pending = true;
+		m_pendingIndex = m_current;
+		m_current = 1 - m_current;
+		m_used[m_current] = 0;
+		lock.unlock();
+		m_condition.notify_all();
+	}
+
+	void WriterThread()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_condition.wait(lock, [&]() { return m_pending || m_exit; });
+			if (!m_pending)
+				return;
+
+			// write outside of the lock, so the other buffer can be filled meanwhile
+			const std::vector<char>& buffer = m_buffers[m_pendingIndex];
+			const size_t used = m_used[m_pendingIndex];
+			lock.unlock();
+			if (m_file)
+				fwrite(buffer.data(), 1, used, m_file);
+			lock.lock();
+
+			m_pending = false;
+			m_condition.notify_all();
+		}
+	}
+
+	FILE* m_file = nullptr;
+	size_t m_bufferSize;
+	std::vector<char> m_buffers[2];
+	size_t m_used[2] = {};
+	int m_current = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_pending = false;
+	int m_pendingIndex = 0;
+	bool m_exit = false;
+	std::thread m_thread;
+};
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "leastsquaresfit.h"
+#include "monotonecubicfit.h"
+#include "mathutils.h"
+#include "platform.h"
+#include "pcg/pcg_basic.h"
+#include "spmd.h"
+#include "tableregistry.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+// Picks the fastest CDF approximation on this CPU that is within an error budget.
+// Whether a LUT or a polynomial is faster, and which size, depends on things like gather throughput, FMA latency
+// and cache size, so the candidates are timed on the machine that will run them, and the winner is written to a
+// config file, which BlueNoiseStreamTuned loads at startup.
+
+enum class TunedCDFType
+{
+	LUT,
+	Polynomial,
+	Hermite
+};
+
+// A CDF approximation, in the same layout the stream classes use.
+// LUT: values are the table, evenly spaced in [0,1], and pieces is the table size.
+// Polynomial: values are Horner coefficients in x, highest power first, order + 1 per piece, like BlueNoiseStreamPolynomial.
+// Hermite: values are Horner coefficients in t across the piece, highest power first, 4 per piece, like BlueNoiseStreamHermite.
+struct TunedCDF
+{
+	TunedCDFType type = TunedCDFType::LUT;
+	int order = 1;
+	int pieces = 0;
+	std::vector<float> values;
+
+	// Filled in by AutotuneCDF
+	float maxError = 0.0f;
+	float nsPerSample = 0.0f;
+	std::string cpu;
+
+	// Switches on the type and order every call, so is for measuring error, not for running per sample.
+	// BlueNoiseTunedProgram has them built in instead.
+	float Evaluate(float x) const
+	{
+		switch (type)
+		{
+			case TunedCDFType::LUT: return EvaluateLUT(values.data(), pieces, x);
+			case TunedCDFType::Polynomial:
+			{
+				switch (order)
+				{
+					case 1: return EvaluatePolynomial<1>(values.data(), pieces, x);
+					case 2: return EvaluatePolynomial<2>(values.data(), pieces, x);
+					default: return EvaluatePolynomial<3>(values.data(), pieces, x);
+				}
+			}
+			default: return EvaluateHermite(values.data(), pieces, x);
+		}
+	}
+
+	static float EvaluateLUT(const float* values, int pieces, float x)
+	{
+		float xindexf = x * float(pieces - 1);
+		int xindex1 = std::min(int(xindexf), pieces - 1);
+		int xindex2 = std::min(xindex1 + 1, pieces - 1);
+		float xindexfract = xindexf - float(xindex1);
+		return values[xindex1] * (1.0f - xindexfract) + values[xindex2] * xindexfract;
+	}
+
+	template <int ORDER>
+	static float EvaluatePolynomial(const float* values, int pieces, float x)
+	{
+		int first = std::min(int(x * float(pieces)), pieces - 1) * (ORDER + 1);
+		float ret = values[first];
+		for (int i = 1; i <= ORDER; ++i)
+			ret = values[first + i] + x * ret;
+		return ret;
+	}
+
+	static float EvaluateHermite(const float* values, int pieces, float x)
+	{
+		float xf = x * float(pieces);
+		int piece = std::min(int(xf), pieces - 1);
+		float t = xf - float(piece);
+		int first = piece * 4;
+		return values[first + 3] + t * (values[first + 2] + t * (values[first + 1] + t * values[first + 0]));
+	}
+
+	std::string Description() const
+	{
+		char buffer[256];
+		switch (type)
+		{
+			case TunedCDFType::LUT: sprintf_s(buffer, "LUT %i", pieces); break;
+			case TunedCDFType::Polynomial: sprintf_s(buffer, "Polynomial O%i C%i", order, pieces); break;
+			default: sprintf_s(buffer, "Hermite C%i", pieces); break;
+		}
+		return buffer;
+	}
+};
+
+// The name of the CPU, from cpuid where available
+inline std::string HostCPUName()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	unsigned int registers[12] = {};
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+#if defined(_MSC_VER)
+		__cpuid((int*)&registers[i * 4], int(0x80000002 + i));
+#else
+		__get_cpuid(0x80000002 + i, &registers[i * 4 + 0], &registers[i * 4 + 1], &registers[i * 4 + 2], &registers[i * 4 + 3]);
+#endif
+	}
+	char name[49] = {};
+	memcpy(name, registers, 48);
+	std::string ret = name;
+	ret.erase(0, ret.find_first_not_of(' '));
+	ret.erase(ret.find_last_not_of(' ') + 1);
+	if (!ret.empty())
+		return ret;
+#endif
+	return "unknown";
+}
+
+// Makes a LUT candidate by resampling the reference CDF
+inline TunedCDF MakeTunedLUT(const std::vector<float>& CDF, int size)
+{
+	TunedCDF ret;
+	ret.type = TunedCDFType::LUT;
+	ret.pieces = size;
+	ret.values.resize(size);
+	for (int i = 0; i < size; ++i)
+	{
+		float x = float(i) / float(size - 1);
+		float indexf = x * float(CDF.size() - 1);
+		int index1 = std::min(int(indexf), (int)CDF.size() - 1);
+		int index2 = std::min(index1 + 1, (int)CDF.size() - 1);
+		float fract = indexf - float(index1);
+		ret.values[i] = CDF[index1] * (1.0f - fract) + CDF[index2] * fract;
+	}
+	return ret;
+}
+
+// Makes a polynomial candidate from a least squares fit, flipping the coefficients to be highest power first
+inline TunedCDF MakeTunedPolynomial(const PiecewisePolynomial& polynomial)
+{
+	TunedCDF ret;
+	ret.type = TunedCDFType::Polynomial;
+	ret.order = polynomial.order;
+	ret.pieces = polynomial.pieces;
+	ret.values.resize(polynomial.coefficients.size());
+	for (int piece = 0; piece < polynomial.pieces; ++piece)
+		for (int i = 0; i <= polynomial.order; ++i)
+			ret.values[piece * (polynomial.order + 1) + i] = (float)polynomial.coefficients[piece * (polynomial.order + 1) + polynomial.order - i];
+	return ret;
+}
+
+inline TunedCDF MakeTunedHermite(const std::vector<float>& CDF, int pieces)
+{
+	MonotoneCubicFit fit;
+	fit.Fit(CDF, pieces);
+
+	TunedCDF ret;
+	ret.type = TunedCDFType::Hermite;
+	ret.order = 3;
+	ret.pieces = pieces;
+	ret.values = fit.Coefficients();
+	return ret;
+}
+
+namespace AutotuneInternal
+{
+	static volatile float s_sink = 0.0f;
+
+	// Takes the best of a few runs, to ignore interruptions.
+	template <typename LAMBDA>
+	float NanosecondsPerSample(const std::vector<float>& inputs, const LAMBDA& lambda)
+	{
+		static const int c_runs = 5;
+
+		double best = 1e30;
+		for (int run = 0; run < c_runs; ++run)
+		{
+			float sum = 0.0f;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (float x : inputs)
+				sum += lambda(x);
+			auto end = std::chrono::high_resolution_clock::now();
+			s_sink = sum;
+			best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / double(inputs.size()));
+		}
+		return (float)best;
+	}
+
+	// Times the remap of the BlueNoiseTunedProgram instantiation for the candidate, which is what the stream runs.
+	// Defined after BlueNoiseTunedProgram.
+	inline float Time(const TunedCDF& candidate, const std::vector<float>& inputs);
+
+	inline float MaxError(const TunedCDF& candidate, const std::vector<float>& CDF)
+	{
+		float ret = 0.0f;
+		for (size_t i = 0; i < CDF.size(); ++i)
+		{
+			float x = float(i) / float(CDF.size() - 1);
+			ret = std::max(ret, std::abs(CDF[i] - candidate.Evaluate(x)));
+		}
+		return ret;
+	}
+}
+
+// Measures the max error of each candidate against the reference CDF, and times it on the inputs, which should be
+// normalized noise like the streams see. Returns the fastest candidate with a max error within errorBudget, or the most
+// accurate candidate if none are. The candidates are updated with their error and timing.
+inline TunedCDF AutotuneCDF(const std::vector<float>& CDF, const std::vector<float>& inputs, std::vector<TunedCDF>& candidates, float errorBudget)
+{
+	std::string cpu = HostCPUName();
+
+	int best = -1;
+	int mostAccurate = 0;
+	for (int index = 0; index < (int)candidates.size(); ++index)
+	{
+		TunedCDF& candidate = candidates[index];
+		candidate.cpu = cpu;
+		candidate.maxError = AutotuneInternal::MaxError(candidate, CDF);
+		candidate.nsPerSample = AutotuneInternal::Time(candidate, inputs);
+
+		if (candidate.maxError < candidates[mostAccurate].maxError)
+			mostAccurate = index;
+
+		if (candidate.maxError <= errorBudget && (best < 0 || candidate.nsPerSample < candidates[best].nsPerSample))
+			best = index;
+	}
+
+	return candidates[(best >= 0) ? best : mostAccurate];
+}
+
+// Config file is text, one key=value per line
+inline bool SaveTunedCDF(const char* fileName, const TunedCDF& tuned)
+{
+	FILE* file = nullptr;
+	fopen_s(&file, fileName, "wb");
+	if (!file)
+		return false;
+
+	static const char* c_typeNames[] = { "lut", "polynomial", "hermite" };
+	fprintf(file, "cpu=%s\n", tuned.cpu.c_str());
+	fprintf(file, "type=%s\n", c_typeNames[(int)tuned.type]);
+	fprintf(file, "order=%i\n", tuned.order);
+	fprintf(file, "pieces=%i\n", tuned.pieces);
+	fprintf(file, "maxError=%.9g\n", tuned.maxError);
+	fprintf(file, "nsPerSample=%.9g\n", tuned.nsPerSample);
+	fprintf(file, "values=");
+	for (size_t i = 0; i < tuned.values.size(); ++i)
+		fprintf(file, "%s%.9g", (i == 0) ? "" : " ", tuned.values[i]);
+	fprintf(file, "\n");
+
+	fclose(file);
+	return true;
+}
+
+inline bool LoadTunedCDF(const char* fileName, TunedCDF& tuned)
+{
+	FILE* file = nullptr;
+	fopen_s(&file, fileName, "rb");
+	if (!file)
+		return false;
+
+	tuned = TunedCDF();
+	std::string line;
+	int c;
+	bool done = false;
+	while (!done)
+	{
+		c = fgetc(file);
+		if (c != '\n' && c != EOF)
+		{
+			line += (char)c;
+			continue;
+		}
+		done = (c == EOF);
+
+		size_t equals = line.find('=');
+		if (equals != std::string::npos)
+		{
+			std::string key = line.substr(0, equals);
+			std::string value = line.substr(equals + 1);
+			if (key == "cpu")
+				tuned.cpu = value;
+			else if (key == "type")
+				tuned.type = (value == "lut") ? TunedCDFType::LUT : (value == "polynomial") ? TunedCDFType::Polynomial : TunedCDFType::Hermite;
+			else if (key == "order")
+				tuned.order = atoi(value.c_str());
+			else if (key == "pieces")
+				tuned.pieces = atoi(value.c_str());
+			else if (key == "maxError")
+				tuned.maxError = (float)atof(value.c_str());
+			else if (key == "nsPerSample")
+				tuned.nsPerSample = (float)atof(value.c_str());
+			else if (key == "values")
+			{
+				const char* text = value.c_str();
+				char* end = nullptr;
+				while (true)
+				{
+					float f = strtof(text, &end);
+					if (end == text)
+						break;
+					tuned.values.push_back(f);
+					text = end;
+				}
+			}
+		}
+		line.clear();
+	}
+	fclose(file);
+
+	// make sure there are the right number of values for the type
+	size_t expectedValues = 0;
+	switch (tuned.type)
+	{
+		case TunedCDFType::LUT: expectedValues = tuned.pieces; break;
+		case TunedCDFType::Polynomial: expectedValues = (tuned.order + 1) * tuned.pieces; break;
+		case TunedCDFType::Hermite: expectedValues = 4 * tuned.pieces; break;
+	}
+	return tuned.pieces > 0 && tuned.order >= 1 && tuned.order <= 3 && tuned.values.size() == expectedValues;
+}
+
+// The 3 tap blue noise program of BlueNoiseStreamPolynomial, remapped with whatever CDF approximation the autotuner
+// picked for this CPU. The type and order are template parameters, so the remap inlines into the stream's loop like
+// the other programs, and WithTunedProgram picks the instantiation once, from the TunedCDF.
+// The values are the table registry's copy, so streams of the same tuning share them.
+template <TunedCDFType TYPE, int ORDER>
+struct BlueNoiseTunedProgram
+{
+	static constexpr float c_xCoefficients[3] = {0.5f, -1.0f, 0.5f};
+
+	BlueNoiseTunedProgram(const TunedCDF& CDF)
+		: m_values(TableRegistry::Get().Register(CDF.values))
+		, m_pieces(CDF.pieces)
+	{
+	}
+
+	float Normalize(float y) const
+	{
+		return y * 0.5f + 0.5f;
+	}
+
+	float Remap(float x) const
+	{
+		if constexpr (TYPE == TunedCDFType::LUT)
+			return TunedCDF::EvaluateLUT(m_values, m_pieces, x);
+		else if constexpr (TYPE == TunedCDFType::Polynomial)
+			return TunedCDF::EvaluatePolynomial<ORDER>(m_values, m_pieces, x);
+		else
+			return TunedCDF::EvaluateHermite(m_values, m_pieces, x);
+	}
+
+	const float* m_values;
+	int m_pieces;
+};
+
+// Calls lambda with the BlueNoiseTunedProgram for the CDF's type and order. This is the only place that switches on
+// them, so everything in the lambda, like a loop over a stream made from the program, runs the remap inline.
+template <typename LAMBDA>
+auto WithTunedProgram(const TunedCDF& CDF, const LAMBDA& lambda)
+{
+	switch (CDF.type)
+	{
+		case TunedCDFType::LUT: return lambda(BlueNoiseTunedProgram<TunedCDFType::LUT, 1>(CDF));
+		case TunedCDFType::Polynomial:
+		{
+			switch (CDF.order)
+			{
+				case 1: return lambda(BlueNoiseTunedProgram<TunedCDFType::Polynomial, 1>(CDF));
+				case 2: return lambda(BlueNoiseTunedProgram<TunedCDFType::Polynomial, 2>(CDF));
+				default: return lambda(BlueNoiseTunedProgram<TunedCDFType::Polynomial, 3>(CDF));
+			}
+		}
+		default: return lambda(BlueNoiseTunedProgram<TunedCDFType::Hermite, 3>(CDF));
+	}
+}
+
+// A blue noise stream that uses whatever CDF approximation the autotuner picked for this CPU. Made from the program
+// that WithTunedProgram gives, like:
+//   WithTunedProgram(tuned, [&](const auto& program) { BlueNoiseStreamTuned stream(rng, program); ... });
+template <typename PROGRAM>
+class BlueNoiseStreamTuned
+{
+public:
+	BlueNoiseStreamTuned(pcg32_random_t rng, const PROGRAM& program)
+		: m_stream(&rng, program)
+	{
+	}
+
+	float Next()
+	{
+		float ret;
+		m_stream.Next(&ret);
+		return ret;
+	}
+
+private:
+	NoiseStreamSPMD<1, PROGRAM> m_stream;
+};
+
+inline float AutotuneInternal::Time(const TunedCDF& candidate, const std::vector<float>& inputs)
+{
+	return WithTunedProgram(candidate, [&](const auto& program)
+		{
+			return NanosecondsPerSample(inputs, [&](float x) { return program.Remap(x); });
+		}
+	);
+}
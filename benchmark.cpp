@@ -0,0 +1,599 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "platform.h"
+#include "pcg/pcg_basic.h"
+#include "BlueNoiseStream.h"
+#include "autotune.h"
+#include "noisestreamchannels.h"
+#include "noisestreampool.h"
+#include "radixsort.h"
+#include "tableregistry.h"
+#include "ToUniformC.h"
+#include "dispatch.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Measures how fast the noise streams and the pieces of the pipeline are, in nanoseconds per sample.
+// Usage: ToUniformBenchmark [sample count] [max sort count]
+// The sorts are timed at 10 million elements, and 10 times more each time, up to the max sort count.
+// Sorting 1 billion elements needs about 16GB of memory.
+
+static const size_t c_defaultSampleCount = 100000000;
+static const size_t c_defaultMaxSortCount = 100000000;
+
+// Keeps the compiler from optimizing away the work being timed
+static volatile float s_sink = 0.0f;
+
+template <typename LAMBDA>
+double NanosecondsPerSample(size_t sampleCount, const LAMBDA& lambda)
+{
+	float sum = 0.0f;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (size_t index = 0; index < sampleCount; ++index)
+		sum += lambda();
+	auto end = std::chrono::high_resolution_clock::now();
+	s_sink = sum;
+
+	return std::chrono::duration<double, std::nano>(end - start).count() / double(sampleCount);
+}
+
+template <typename STREAM>
+void BenchmarkStream(const char* label, STREAM stream, size_t sampleCount)
+{
+	double ns = NanosecondsPerSample(sampleCount, [&]() { return stream.Next(); });
+	printf("  %-28s %8.3f ns/sample  %8.1f M samples/s\n", label, ns, 1000.0 / ns);
+}
+
+void BenchmarkStreams(pcg32_random_t& rng, size_t sampleCount)
+{
+	printf("\nStreams (%zu samples)\n", sampleCount);
+	BenchmarkStream("BlueNoiseStreamLUT", BlueNoiseStreamLUT(rng), sampleCount);
+	BenchmarkStream("BlueNoiseStreamFixedPoint", BlueNoiseStreamFixedPoint(rng), sampleCount);
+	BenchmarkStream("BlueNoiseStreamPolynomial", BlueNoiseStreamPolynomial(rng), sampleCount);
+	BenchmarkStream("BlueNoiseStreamHermite", BlueNoiseStreamHermite(rng), sampleCount);
+	BenchmarkStream("RedNoiseStreamPolynomial", RedNoiseStreamPolynomial(rng), sampleCount);
+	BenchmarkStream("BlueNoiseStreamAppleton", BlueNoiseStreamAppleton(pcg32_random_r(&rng)), sampleCount);
+
+	// tuning.txt is made by ToUniform with AUTOTUNE() on
+	TunedCDF tuned;
+	if (LoadTunedCDF("tuning.txt", tuned))
+	{
+		std::string label = "BlueNoiseStreamTuned " + tuned.Description();
+		WithTunedProgram(tuned, [&](const auto& program)
+			{
+				BenchmarkStream(label.c_str(), BlueNoiseStreamTuned(rng, program), sampleCount);
+			}
+		);
+	}
+}
+
+// Times WIDTH lanes of a SPMD stream, reporting the time per sample, not per call
+template <int WIDTH, typename PROGRAM>
+void BenchmarkStreamSPMD(const char* programName, pcg32_random_t& rng, size_t sampleCount)
+{
+	pcg32_random_t rngs[WIDTH];
+	for (int lane = 0; lane < WIDTH; ++lane)
+		pcg32_srandom_r(&rngs[lane], pcg32_random_r(&rng), lane);
+	NoiseStreamSPMD<WIDTH, PROGRAM> stream(rngs);
+
+	double ns = NanosecondsPerSample(sampleCount / WIDTH,
+		[&]()
+		{
+			float values[WIDTH];
+			stream.Next(values);
+			float sum = 0.0f;
+			for (float f : values)
+				sum += f;
+			return sum;
+		}
+	) / double(WIDTH);
+
+	char label[64];
+	sprintf_s(label, "%s x%i", programName, WIDTH);
+	printf("  %-28s %8.3f ns/sample  %8.1f M samples/s\n", label, ns, 1000.0 / ns);
+}
+
+template <typename PROGRAM>
+void BenchmarkStreamSPMDWidths(const char* programName, pcg32_random_t& rng, size_t sampleCount)
+{
+	BenchmarkStreamSPMD<1, PROGRAM>(programName, rng, sampleCount);
+	BenchmarkStreamSPMD<4, PROGRAM>(programName, rng, sampleCount);
+	BenchmarkStreamSPMD<8, PROGRAM>(programName, rng, sampleCount);
+	BenchmarkStreamSPMD<16, PROGRAM>(programName, rng, sampleCount);
+}
+
+void BenchmarkStreamsSPMD(pcg32_random_t& rng, size_t sampleCount)
+{
+	printf("\nSPMD streams by lane count (%zu samples)\n", sampleCount);
+	BenchmarkStreamSPMDWidths<BlueNoiseLUTProgram>("LUT", rng, sampleCount);
+	BenchmarkStreamSPMDWidths<BlueNoisePolynomialProgram>("Polynomial", rng, sampleCount);
+	BenchmarkStreamSPMDWidths<BlueNoiseHermiteProgram>("Hermite", rng, sampleCount);
+}
+
+// Random access samples at random indices, one at a time and batched.
+// These cost a jump per sample, so they are timed over fewer samples than the streams.
+template <typename PROGRAM>
+void BenchmarkStreamSeekable(const char* programName, pcg32_random_t& rng, size_t sampleCount)
+{
+	static const size_t c_indexCount = 1024;
+
+	NoiseStreamSeekable<PROGRAM> seekable(rng);
+	std::vector<uint64_t> indices(c_indexCount);
+	for (uint64_t& index : indices)
+		index = (uint64_t(pcg32_random_r(&rng)) << 32) | pcg32_random_r(&rng);
+
+	size_t indexIndex = 0;
+	double nsScalar = NanosecondsPerSample(sampleCount,
+		[&]()
+		{
+			indexIndex = (indexIndex + 1) % c_indexCount;
+			return seekable.SampleAt(indices[indexIndex]);
+		}
+	);
+
+	std::vector<float> values(c_indexCount);
+	double nsBatched = NanosecondsPerSample(sampleCount / c_indexCount,
+		[&]()
+		{
+			seekable.SampleAt(indices.data(), values.data(), c_indexCount);
+			return values[0];
+		}
+	) / double(c_indexCount);
+
+	char label[64];
+	sprintf_s(label, "%s SampleAt", programName);
+	printf("  %-28s %8.3f ns/sample  %8.1f M samples/s\n", label, nsScalar, 1000.0 / nsScalar);
+	sprintf_s(label, "%s SampleAt batched", programName);
+	printf("  %-28s %8.3f ns/sample  %8.1f M samples/s\n", label, nsBatched, 1000.0 / nsBatched);
+}
+
+void BenchmarkStreamsSeekable(pcg32_random_t& rng, size_t sampleCount)
+{
+	printf("\nSeekable streams at random 64 bit indices (%zu samples)\n", sampleCount);
+	BenchmarkStreamSeekable<BlueNoiseLUTProgram>("LUT", rng, sampleCount);
+	BenchmarkStreamSeekable<BlueNoisePolynomialProgram>("Polynomial", rng, sampleCount);
+	BenchmarkStreamSeekable<BlueNoiseHermiteProgram>("Hermite", rng, sampleCount);
+}
+
+// The table contents don't change the timing, so this uses a linear CDF table the size of the one in BlueNoiseStreamLUT
+template <size_t N>
+void BenchmarkStreamFIR(pcg32_random_t& rng, const std::vector<float>& kernel, size_t sampleCount)
+{
+	std::vector<float> CDF(64);
+	for (size_t index = 0; index < CDF.size(); ++index)
+		CDF[index] = float(index) / float(CDF.size() - 1);
+
+	char label[64];
+	sprintf_s(label, "BlueNoiseStreamFIR<%zu>", N);
+	BenchmarkStream(label, BlueNoiseStreamFIR<N>(rng, kernel, CDF), sampleCount);
+}
+
+// Alternating signs, which is a box filter shifted to be high pass
+std::vector<float> AlternatingKernel(size_t taps)
+{
+	std::vector<float> kernel(taps);
+	for (size_t index = 0; index < taps; ++index)
+		kernel[index] = (index % 2 == 0) ? 1.0f : -1.0f;
+	return kernel;
+}
+
+void BenchmarkStreamsFIR(pcg32_random_t& rng, size_t sampleCount)
+{
+	printf("\nFIR streams by tap count (%zu samples)\n", sampleCount);
+	BenchmarkStreamFIR<3>(rng, { 0.5f, -1.0f, 0.5f }, sampleCount);
+	BenchmarkStreamFIR<5>(rng, { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f }, sampleCount);
+	BenchmarkStreamFIR<9>(rng, { 0.0002f, -0.0060f, 0.0606f, -0.2417f, 0.3829f, -0.2417f, 0.0606f, -0.0060f, 0.0002f }, sampleCount);
+	BenchmarkStreamFIR<16>(rng, AlternatingKernel(16), sampleCount);
+	BenchmarkStreamFIR<32>(rng, AlternatingKernel(32), sampleCount);
+}
+
+void BenchmarkStreamPool(size_t sampleCount)
+{
+	unsigned int threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	printf("\nNoiseStreamPool<BlueNoiseStreamLUT> (%zu samples, %u threads)\n", sampleCount, threadCount);
+
+	NoiseStreamPool<BlueNoiseStreamLUT> pool(0xa000b800, threadCount);
+
+	// One thread, going through the ring buffer
+	{
+		NoiseStreamPool<BlueNoiseStreamLUT>::Slot* slot = pool.Checkout();
+		double ns = NanosecondsPerSample(sampleCount, [&]() { return slot->Next(); });
+		printf("  %-28s %8.3f ns/sample  %8.1f M samples/s\n", "Slot Next", ns, 1000.0 / ns);
+		pool.Return(slot);
+	}
+
+	// Checkout and return, like a short lived task would do
+	{
+		double ns = NanosecondsPerSample(sampleCount / 16, [&]() {
+			NoiseStreamPool<BlueNoiseStreamLUT>::Slot* slot = pool.Checkout();
+			pool.Return(slot);
+			return 0.0f;
+		});
+		printf("  %-28s %8.3f ns/call\n", "Checkout + Return", ns);
+	}
+
+	// Every thread drawing from its own thread local slot. ns/sample is the wall time over all the samples.
+	{
+		size_t samplesPerThread = sampleCount / threadCount;
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		for (unsigned int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+		{
+			threads.emplace_back([&]()
+				{
+					NoiseStreamPool<BlueNoiseStreamLUT>::Slot* slot = pool.ThreadLocalSlot();
+					float sum = 0.0f;
+					for (size_t index = 0; index < samplesPerThread; ++index)
+						sum += slot->Next();
+					s_sink = sum;
+				}
+			);
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ns = std::chrono::duration<double, std::nano>(end - start).count() / double(samplesPerThread * threadCount);
+		printf("  %-28s %8.3f ns/sample  %8.1f M samples/s\n", "Thread local slots", ns, 1000.0 / ns);
+	}
+}
+
+// Counts L1 data cache read misses on this thread, from the hardware counters. Only on Linux, and only if the kernel
+// lets this process read them, so Available() is often false in containers and VMs.
+class L1MissCounter
+{
+public:
+	L1MissCounter()
+	{
+#if defined(__linux__)
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		m_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~L1MissCounter()
+	{
+#if defined(__linux__)
+		if (m_fd >= 0)
+			close(m_fd);
+#endif
+	}
+
+	bool Available() const
+	{
+		return m_fd >= 0;
+	}
+
+	void Start()
+	{
+#if defined(__linux__)
+		if (m_fd >= 0)
+		{
+			ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	uint64_t Stop()
+	{
+		uint64_t count = 0;
+#if defined(__linux__)
+		if (m_fd >= 0)
+		{
+			ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+				count = 0;
+		}
+#endif
+		return count;
+	}
+
+private:
+	int m_fd = -1;
+};
+
+// BlueNoiseCDFTableProgram the way it was before the table registry, with each stream holding its own copy of the table
+struct CopiedCDFTableProgram
+{
+	static constexpr float c_xCoefficients[3] = {0.5f, -1.0f, 0.5f};
+
+	float Normalize(float y) const
+	{
+		return y * 0.5f + 0.5f;
+	}
+
+	float Remap(float x) const
+	{
+		return SamplePaddedTable(m_LUT.data(), m_LUT.size() - 1, x);
+	}
+
+	// padded by PadTable
+	std::vector<float> m_LUT;
+};
+
+// Takes a sample from each stream in turn, like a renderer giving every pixel or particle its own stream
+template <typename STREAM, typename BEFORE_ROUND>
+void BenchmarkManyStreams(const char* label, std::vector<STREAM>& streams, size_t sampleCount, const BEFORE_ROUND& beforeRound)
+{
+	size_t rounds = std::max(sampleCount / streams.size(), size_t(1));
+	float sum = 0.0f;
+
+	L1MissCounter counter;
+	counter.Start();
+	auto start = std::chrono::high_resolution_clock::now();
+	for (size_t round = 0; round < rounds; ++round)
+	{
+		beforeRound();
+		for (STREAM& stream : streams)
+		{
+			float value;
+			stream.Next(&value);
+			sum += value;
+		}
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	uint64_t misses = counter.Stop();
+	s_sink = sum;
+
+	double samples = double(rounds * streams.size());
+	double ns = std::chrono::duration<double, std::nano>(end - start).count() / samples;
+	if (counter.Available())
+		printf("  %-28s %8.3f ns/sample  %8.4f L1 misses/sample\n", label, ns, double(misses) / samples);
+	else
+		printf("  %-28s %8.3f ns/sample  L1 misses not available\n", label, ns);
+}
+
+// Thousands of CDF table streams, each with its own copy of the table, against all of them sharing the table
+// registry's copy
+void BenchmarkTableSharing(pcg32_random_t& rng, size_t sampleCount)
+{
+	static const size_t c_streamCount = 4096;
+	static const size_t c_tableSize = 1024;
+
+	std::vector<float> table(c_tableSize);
+	for (size_t index = 0; index < c_tableSize; ++index)
+		table[index] = float(index) / float(c_tableSize - 1);
+
+	printf("\nTable sharing (%zu streams, %zu entry tables, %zu samples)\n", c_streamCount, c_tableSize, sampleCount);
+
+	std::vector<NoiseStreamSPMD<1, CopiedCDFTableProgram>> copiedStreams;
+	std::vector<NoiseStreamSPMD<1, BlueNoiseCDFTableProgram>> sharedStreams;
+	const float* sharedTable = TableRegistry::Get().Register(PadTable(table));
+	for (size_t index = 0; index < c_streamCount; ++index)
+	{
+		pcg32_random_t streamRNG;
+		pcg32_srandom_r(&streamRNG, pcg32_random_r(&rng), index);
+		copiedStreams.emplace_back(&streamRNG, CopiedCDFTableProgram{ PadTable(table) });
+		sharedStreams.emplace_back(&streamRNG, BlueNoiseCDFTableProgram{ sharedTable, c_tableSize });
+	}
+
+	BenchmarkManyStreams("Copied tables", copiedStreams, sampleCount, []() {});
+	BenchmarkManyStreams("Shared table", sharedStreams, sampleCount, []() {});
+	BenchmarkManyStreams("Shared table + prefetch", sharedStreams, sampleCount,
+		[&]() { PrefetchTable(sharedTable, c_tableSize * sizeof(float)); });
+
+	TableRegistry& registry = TableRegistry::Get();
+	printf("  Table registry: %zu tables, %zu bytes, huge pages %s\n", registry.TableCount(), registry.BytesUsed(), registry.HugePages() ? "yes" : "no");
+}
+
+// Many BlueNoiseStreamPolynomial channels, such as one per pixel or particle, each stepped once per timestep.
+// A stream object per channel, against NoiseStreamChannels stepping them all at once, a step at a time or a block of
+// steps at a time.
+void BenchmarkChannels(size_t sampleCount)
+{
+	static const size_t c_channelCounts[] = { 16, 256, 4096, 65536, 1 << 20 };
+	static const size_t c_steps = 8;
+	static const uint64_t c_seed = 0xa000b800;
+	typedef NoiseStreamChannels<BlueNoisePolynomialProgram> Channels;
+
+	printf("\nMany channels of BlueNoiseStreamPolynomial (%zu samples, %s, %zu steps per block)\n", sampleCount, DispatchISAName(Kernels().ISA), c_steps);
+	printf("  %-10s %-22s %-22s %-22s\n", "Channels", "Stream objects", "Channels, 1 step", "Channels, block");
+
+	for (size_t channelCount : c_channelCounts)
+	{
+		std::vector<BlueNoiseStreamPolynomial> streams;
+		streams.reserve(channelCount);
+		for (size_t channel = 0; channel < channelCount; ++channel)
+		{
+			pcg32_random_t rng;
+			pcg32_srandom_r(&rng, c_seed, channel);
+			streams.emplace_back(rng);
+		}
+		Channels channels(c_seed, channelCount);
+		Channels blockChannels(c_seed, channelCount);
+
+		std::vector<float> out(channelCount * c_steps);
+		const size_t blocks = std::max(sampleCount / (channelCount * c_steps), size_t(1));
+		const double samples = double(blocks * c_steps * channelCount);
+		bool matches = true;
+
+		// All three run the same steps from the same seeds, so the last block of each has to match the stream objects'
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t block = 0; block < blocks; ++block)
+		{
+			for (size_t step = 0; step < c_steps; ++step)
+			{
+				float* stepOut = &out[step * channelCount];
+				for (size_t channel = 0; channel < channelCount; ++channel)
+					stepOut[channel] = streams[channel].Next();
+			}
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double streamsNs = std::chrono::duration<double, std::nano>(end - start).count() / samples;
+		std::vector<float> streamsOut = out;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (size_t block = 0; block < blocks; ++block)
+		{
+			for (size_t step = 0; step < c_steps; ++step)
+				channels.Next(&out[step * channelCount]);
+		}
+		end = std::chrono::high_resolution_clock::now();
+		double stepNs = std::chrono::duration<double, std::nano>(end - start).count() / samples;
+		matches &= (out == streamsOut);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (size_t block = 0; block < blocks; ++block)
+			blockChannels.Next(out.data(), c_steps);
+		end = std::chrono::high_resolution_clock::now();
+		double blockNs = std::chrono::duration<double, std::nano>(end - start).count() / samples;
+		matches &= (out == streamsOut);
+		s_sink = out[0];
+
+		char streamsText[32], stepText[32], blockText[32];
+		sprintf_s(streamsText, "%.3f ns/sample", streamsNs);
+		sprintf_s(stepText, "%.3f ns/sample", stepNs);
+		sprintf_s(blockText, "%.3f ns/sample", blockNs);
+		printf("  %-10zu %-22s %-22s %-22s%s\n", channelCount, streamsText, stepText, blockText, matches ? "" : "  MISMATCH");
+	}
+}
+
+// The C API's bulk fill, with each implementation the CPU has. The CAPI test checks they match the C++ streams.
+void BenchmarkCAPI(size_t sampleCount)
+{
+	static const size_t c_fillSize = 4096;
+	static const uint64_t c_seed = 0xa000b800;
+	static const uint64_t c_sequence = 1;
+
+	printf("\nC API ToUniform_Fill (%zu samples, %zu per fill)\n", sampleCount, c_fillSize);
+
+	std::vector<float> values(c_fillSize);
+	for (int implementation = ToUniform_Scalar; implementation < ToUniform_ImplementationCount; ++implementation)
+	{
+		if (!ToUniform_SetImplementation((ToUniform_Implementation)implementation))
+		{
+			printf("  %-28s not supported\n", ToUniform_ImplementationName((ToUniform_Implementation)implementation));
+			continue;
+		}
+
+		ToUniform_Stream* stream = ToUniform_CreateStream(ToUniform_BlueNoisePolynomial, c_seed, c_sequence);
+		size_t fills = std::max(sampleCount / c_fillSize, size_t(1));
+		double ns = NanosecondsPerSample(fills, [&]() {
+			ToUniform_Fill(stream, values.data(), values.size());
+			return values[0];
+		}) / double(c_fillSize);
+		ToUniform_DestroyStream(stream);
+
+		char label[64];
+		sprintf_s(label, "Polynomial %s", ToUniform_ImplementationName((ToUniform_Implementation)implementation));
+		printf("  %-28s %8.3f ns/sample  %8.1f M samples/s\n", label, ns, 1000.0 / ns);
+	}
+	ToUniform_SetImplementation(ToUniform_Auto);
+}
+
+// Each dispatched kernel on each instruction set the CPU has, in blocks like the experiment driver and out of core runs
+void BenchmarkDispatch(size_t sampleCount)
+{
+	static const size_t c_blockSize = 4096;
+	static const size_t c_bins = 1024;
+	static const float c_kernel[] = { 0.5f, -1.0f, 0.5f };
+	static const float c_polynomial[16] = {
+		5.25964f, 0.039474f, 0.000708779f, 0.0f,
+		-5.20987f, 7.82905f, -1.93105f, 0.159677f,
+		-5.22644f, 7.8272f, -1.91677f, 0.15507f,
+		5.23882f, -15.761f, 15.8054f, -4.28323f
+	};
+
+	printf("\nDispatched kernels (%zu samples, %zu per call, CPU supports %s, TOUNIFORM_ISA picks %s)\n", sampleCount, c_blockSize,
+		DispatchISAName(DetectedISA()), DispatchISAName(Kernels().ISA));
+
+	std::vector<float> table(65);
+	for (size_t index = 0; index < 64; ++index)
+		table[index] = float(index) / 63.0f;
+	table[64] = table[63];
+
+	std::vector<float> in(c_blockSize);
+	std::vector<float> out(c_blockSize);
+	std::vector<uint64_t> bins(c_bins);
+	const size_t calls = std::max(sampleCount / c_blockSize, size_t(1));
+
+	for (int ISA = 0; ISA < (int)DispatchISA::Count; ++ISA)
+	{
+		const NoiseKernels* kernels = KernelsFor((DispatchISA)ISA);
+		if (!kernels)
+		{
+			printf("  %-8s not supported\n", DispatchISAName((DispatchISA)ISA));
+			continue;
+		}
+
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, 0xa000b800, 0);
+		kernels->UniformFloats(rng, in.data(), in.size());
+
+		double uniform = NanosecondsPerSample(calls, [&]() { kernels->UniformFloats(rng, out.data(), out.size()); return out[0]; }) / double(c_blockSize);
+		double FIR = NanosecondsPerSample(calls, [&]() { kernels->FIR(in.data(), in.size(), c_kernel, _countof(c_kernel), out.data()); return out[0]; }) / double(c_blockSize);
+		double LUT = NanosecondsPerSample(calls, [&]() { kernels->RemapLUT(table.data(), 64, in.data(), out.data(), in.size()); return out[0]; }) / double(c_blockSize);
+		double polynomial = NanosecondsPerSample(calls, [&]() { kernels->RemapPolynomial(c_polynomial, 4, in.data(), out.data(), in.size()); return out[0]; }) / double(c_blockSize);
+		double histogram = NanosecondsPerSample(calls, [&]() { kernels->Histogram(in.data(), in.size(), bins.data(), bins.size()); return float(bins[0]); }) / double(c_blockSize);
+
+		printf("  %-8s ns/sample: UniformFloats %6.3f  FIR %6.3f  RemapLUT %6.3f  RemapPolynomial %6.3f  Histogram %6.3f\n",
+			DispatchISAName((DispatchISA)ISA), uniform, FIR, LUT, polynomial, histogram);
+	}
+}
+
+// Times the sort used to make the CDF tables against std::sort, on values in [0,1] like SequenceTest sorts
+void BenchmarkSorts(pcg32_random_t& rng, size_t maxSortCount)
+{
+	printf("\nSorting floats in [0,1]\n");
+	for (size_t count = 10000000; count <= maxSortCount; count *= 10)
+	{
+		std::vector<float> values(count);
+		for (float& f : values)
+			f = ldexpf((float)pcg32_random_r(&rng), -32);
+		std::vector<float> valuesCopy = values;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::sort(valuesCopy.begin(), valuesCopy.end());
+		auto end = std::chrono::high_resolution_clock::now();
+		double stdSortSeconds = std::chrono::duration<double>(end - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		RadixSortFloats(values);
+		end = std::chrono::high_resolution_clock::now();
+		double radixSortSeconds = std::chrono::duration<double>(end - start).count();
+
+		printf("  %12zu: std::sort %8.3f s, RadixSortFloats %8.3f s (%u threads), %5.2fx%s\n", count, stdSortSeconds, radixSortSeconds,
+			std::max(std::thread::hardware_concurrency(), 1u), stdSortSeconds / radixSortSeconds, (values == valuesCopy) ? "" : " MISMATCH");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t sampleCount = (argc > 1) ? (size_t)strtoull(argv[1], nullptr, 10) : c_defaultSampleCount;
+	size_t maxSortCount = (argc > 2) ? (size_t)strtoull(argv[2], nullptr, 10) : c_defaultMaxSortCount;
+
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 0xa000b800, 0);
+
+	BenchmarkStreams(rng, sampleCount);
+	BenchmarkStreamsSPMD(rng, sampleCount);
+	BenchmarkStreamsSeekable(rng, sampleCount / 10);
+	BenchmarkStreamsFIR(rng, sampleCount);
+	BenchmarkTableSharing(rng, sampleCount);
+	BenchmarkStreamPool(sampleCount);
+	BenchmarkChannels(sampleCount);
+	BenchmarkCAPI(sampleCount);
+	BenchmarkDispatch(sampleCount);
+	BenchmarkSorts(rng, maxSortCount);
+
+	return 0;
+}
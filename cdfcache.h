@@ -0,0 +1,236 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "cdftable.h"
+#include "leastsquaresfit.h"
+#include "platform.h"
+
+// A cache of the fitted CDF tables on disk, so that repeated runs don't have to generate, sort and fit them again.
+// The key is the filter that made the noise and the sizes involved. The tables only depend on those when the
+// noise is normalized with analytic bounds, so the cache is only used in that case.
+
+struct CDFCacheKey
+{
+	std::vector<float> xCoefficients;
+	std::vector<float> yCoefficients;
+	uint64_t sampleCount = 0;
+	uint32_t tableSizeFull = 0;
+	uint32_t tableSizeSmall = 0;
+	uint32_t pyramidMinSize = 0;
+	uint32_t pyramidMaxSize = 0;
+};
+
+// Only the pyramid is stored in the file. CDFFull and CDFSmall are copies of its levels of the key's table sizes.
+struct CDFCacheEntry
+{
+	CDFTablePyramid pyramid;
+	std::vector<float> CDFFull;
+	std::vector<float> CDFSmall;
+	PiecewisePolynomial polynomial;
+};
+
+static const char* c_CDFCacheDirectory = "cdfcache";
+static const uint32_t c_CDFCacheMagic = 0x43435554; // "TUCC"
+static const uint32_t c_CDFCacheVersion = 2;
+
+// Limit on the polynomial order and piece count read from a file, which are far smaller than this in practice
+static const int32_t c_CDFCacheMaxPolynomialSize = 1024;
+
+namespace CDFCacheInternal
+{
+	// FNV-1a
+	inline uint64_t Hash(uint64_t hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	inline void WriteVector(FILE* file, const std::vector<float>& values)
+	{
+		uint32_t count = (uint32_t)values.size();
+		fwrite(&count, sizeof(count), 1, file);
+		if (count > 0)
+			fwrite(values.data(), sizeof(float), count, file);
+	}
+
+	inline void WriteVector(FILE* file, const std::vector<double>& values)
+	{
+		uint32_t count = (uint32_t)values.size();
+		fwrite(&count, sizeof(count), 1, file);
+		if (count > 0)
+			fwrite(values.data(), sizeof(double), count, file);
+	}
+
+	// Fails if the file says there are more than maxCount values, which the key limits, so a corrupt count can't make
+	// a huge allocation before the read runs out of file
+	template <typename T>
+	inline bool ReadVector(FILE* file, std::vector<T>& values, size_t maxCount)
+	{
+		uint32_t count = 0;
+		if (fread(&count, sizeof(count), 1, file) != 1 || count > maxCount)
+			return false;
+		values.resize(count);
+		return count == 0 || fread(values.data(), sizeof(T), count, file) == count;
+	}
+
+	inline void WriteKey(FILE* file, const CDFCacheKey& key)
+	{
+		WriteVector(file, key.xCoefficients);
+		WriteVector(file, key.yCoefficients);
+		fwrite(&key.sampleCount, sizeof(key.sampleCount), 1, file);
+		fwrite(&key.tableSizeFull, sizeof(key.tableSizeFull), 1, file);
+		fwrite(&key.tableSizeSmall, sizeof(key.tableSizeSmall), 1, file);
+		fwrite(&key.pyramidMinSize, sizeof(key.pyramidMinSize), 1, file);
+		fwrite(&key.pyramidMaxSize, sizeof(key.pyramidMaxSize), 1, file);
+	}
+
+	// The file's key has to match expected for the entry to be used, so its vectors can't be longer than expected's
+	inline bool ReadKey(FILE* file, const CDFCacheKey& expected, CDFCacheKey& key)
+	{
+		return
+			ReadVector(file, key.xCoefficients, expected.xCoefficients.size()) &&
+			ReadVector(file, key.yCoefficients, expected.yCoefficients.size()) &&
+			fread(&key.sampleCount, sizeof(key.sampleCount), 1, file) == 1 &&
+			fread(&key.tableSizeFull, sizeof(key.tableSizeFull), 1, file) == 1 &&
+			fread(&key.tableSizeSmall, sizeof(key.tableSizeSmall), 1, file) == 1 &&
+			fread(&key.pyramidMinSize, sizeof(key.pyramidMinSize), 1, file) == 1 &&
+			fread(&key.pyramidMaxSize, sizeof(key.pyramidMaxSize), 1, file) == 1;
+	}
+
+	inline void WritePyramid(FILE* file, const CDFTablePyramid& pyramid)
+	{
+		uint32_t count = (uint32_t)pyramid.levels.size();
+		fwrite(&count, sizeof(count), 1, file);
+		for (const CDFTableLevel& level : pyramid.levels)
+		{
+			WriteVector(file, level.table);
+			fwrite(&level.RMSE, sizeof(level.RMSE), 1, file);
+			fwrite(&level.maxError, sizeof(level.maxError), 1, file);
+		}
+	}
+
+	// The levels are powers of 2 up to the key's max size, so there are at most 33 of them
+	inline bool ReadPyramid(FILE* file, const CDFCacheKey& key, CDFTablePyramid& pyramid)
+	{
+		static const uint32_t c_maxLevels = 33;
+		uint32_t count = 0;
+		if (fread(&count, sizeof(count), 1, file) != 1 || count == 0 || count > c_maxLevels)
+			return false;
+		pyramid.levels.resize(count);
+		for (CDFTableLevel& level : pyramid.levels)
+		{
+			if (!ReadVector(file, level.table, key.pyramidMaxSize) ||
+				fread(&level.RMSE, sizeof(level.RMSE), 1, file) != 1 ||
+				fread(&level.maxError, sizeof(level.maxError), 1, file) != 1)
+				return false;
+		}
+		return true;
+	}
+}
+
+inline uint64_t CDFCacheHash(const CDFCacheKey& key)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	uint32_t xCount = (uint32_t)key.xCoefficients.size();
+	uint32_t yCount = (uint32_t)key.yCoefficients.size();
+	hash = CDFCacheInternal::Hash(hash, &xCount, sizeof(xCount));
+	hash = CDFCacheInternal::Hash(hash, key.xCoefficients.data(), xCount * sizeof(float));
+	hash = CDFCacheInternal::Hash(hash, &yCount, sizeof(yCount));
+	hash = CDFCacheInternal::Hash(hash, key.yCoefficients.data(), yCount * sizeof(float));
+	hash = CDFCacheInternal::Hash(hash, &key.sampleCount, sizeof(key.sampleCount));
+	hash = CDFCacheInternal::Hash(hash, &key.tableSizeFull, sizeof(key.tableSizeFull));
+	hash = CDFCacheInternal::Hash(hash, &key.tableSizeSmall, sizeof(key.tableSizeSmall));
+	hash = CDFCacheInternal::Hash(hash, &key.pyramidMinSize, sizeof(key.pyramidMinSize));
+	hash = CDFCacheInternal::Hash(hash, &key.pyramidMaxSize, sizeof(key.pyramidMaxSize));
+	return hash;
+}
+
+inline std::string CDFCacheFileName(const CDFCacheKey& key)
+{
+	char fileName[256];
+	snprintf(fileName, sizeof(fileName), "%s/%016llx.bin", c_CDFCacheDirectory, (unsigned long long)CDFCacheHash(key));
+	return fileName;
+}
+
+// Returns false if the entry isn't in the cache, or the file is from an older version or a hash collision.
+inline bool LoadCDFCache(const CDFCacheKey& key, CDFCacheEntry& entry)
+{
+	FILE* file = nullptr;
+	fopen_s(&file, CDFCacheFileName(key).c_str(), "rb");
+	if (!file)
+		return false;
+
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	CDFCacheKey fileKey;
+	int32_t order = 0;
+	int32_t pieces = 0;
+	bool ok =
+		fread(&magic, sizeof(magic), 1, file) == 1 && magic == c_CDFCacheMagic &&
+		fread(&version, sizeof(version), 1, file) == 1 && version == c_CDFCacheVersion &&
+		CDFCacheInternal::ReadKey(file, key, fileKey) &&
+		fileKey.xCoefficients == key.xCoefficients &&
+		fileKey.yCoefficients == key.yCoefficients &&
+		fileKey.sampleCount == key.sampleCount &&
+		fileKey.tableSizeFull == key.tableSizeFull &&
+		fileKey.tableSizeSmall == key.tableSizeSmall &&
+		fileKey.pyramidMinSize == key.pyramidMinSize &&
+		fileKey.pyramidMaxSize == key.pyramidMaxSize &&
+		CDFCacheInternal::ReadPyramid(file, key, entry.pyramid) &&
+		fread(&order, sizeof(order), 1, file) == 1 &&
+		fread(&pieces, sizeof(pieces), 1, file) == 1 &&
+		order >= 0 && order < c_CDFCacheMaxPolynomialSize && pieces > 0 && pieces < c_CDFCacheMaxPolynomialSize &&
+		fread(&entry.polynomial.RMSE, sizeof(entry.polynomial.RMSE), 1, file) == 1 &&
+		CDFCacheInternal::ReadVector(file, entry.polynomial.coefficients, size_t((order + 1) * pieces)) &&
+		entry.polynomial.coefficients.size() == size_t((order + 1) * pieces);
+
+	entry.polynomial.order = order;
+	entry.polynomial.pieces = pieces;
+
+	fclose(file);
+
+	if (!ok)
+		return false;
+
+	const CDFTableLevel* full = entry.pyramid.Level(key.tableSizeFull);
+	const CDFTableLevel* small = entry.pyramid.Level(key.tableSizeSmall);
+	if (!full || !small)
+		return false;
+	entry.CDFFull = full->table;
+	entry.CDFSmall = small->table;
+	return true;
+}
+
+inline void SaveCDFCache(const CDFCacheKey& key, const CDFCacheEntry& entry)
+{
+	std::error_code error;
+	std::filesystem::create_directories(c_CDFCacheDirectory, error);
+
+	FILE* file = nullptr;
+	fopen_s(&file, CDFCacheFileName(key).c_str(), "wb");
+	if (!file)
+		return;
+
+	int32_t order = entry.polynomial.order;
+	int32_t pieces = entry.polynomial.pieces;
+
+	fwrite(&c_CDFCacheMagic, sizeof(c_CDFCacheMagic), 1, file);
+	fwrite(&c_CDFCacheVersion, sizeof(c_CDFCacheVersion), 1, file);
+	CDFCacheInternal::WriteKey(file, key);
+	CDFCacheInternal::WritePyramid(file, entry.pyramid);
+	fwrite(&order, sizeof(order), 1, file);
+	fwrite(&pieces, sizeof(pieces), 1, file);
+	fwrite(&entry.polynomial.RMSE, sizeof(entry.polynomial.RMSE), 1, file);
+	CDFCacheInternal::WriteVector(file, entry.polynomial.coefficients);
+
+	fclose(file);
+}
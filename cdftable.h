@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "mathutils.h"
+#include "radixsort.h"
+
+// CDF tables of every power of two size between a min and max size, made from the same values.
+// Different uses want different sizes: a 16 or 32 entry table fits in registers, while offline use can afford 4096
+// entries, so one characterization run makes all of them, and a stream picks the one it wants.
+
+struct CDFTableLevel
+{
+	std::vector<float> table;
+
+	// Error of this level compared to the largest level, sampled the way the streams sample the tables
+	float RMSE = 0.0f;
+	float maxError = 0.0f;
+};
+
+struct CDFTablePyramid
+{
+	// smallest first, each twice the size of the one before
+	std::vector<CDFTableLevel> levels;
+
+	// Returns nullptr if there is no level of that size
+	const CDFTableLevel* Level(size_t size) const
+	{
+		for (const CDFTableLevel& level : levels)
+		{
+			if (level.table.size() == size)
+				return &level;
+		}
+		return nullptr;
+	}
+
+	// The largest level that is no larger than size, or the smallest level if they are all larger
+	const CDFTableLevel& LevelAtMost(size_t size) const
+	{
+		const CDFTableLevel* ret = &levels[0];
+		for (const CDFTableLevel& level : levels)
+		{
+			if (level.table.size() <= size)
+				ret = &level;
+		}
+		return *ret;
+	}
+
+	// The smallest level with a max error within the budget, or the largest level if none are
+	const CDFTableLevel& LevelForMaxError(float maxError) const
+	{
+		for (const CDFTableLevel& level : levels)
+		{
+			if (level.maxError <= maxError)
+				return level;
+		}
+		return levels.back();
+	}
+};
+
+// Makes CDF tables of the sizes minSize, minSize*2, ... up to maxSize, from values in [0,1].
+// Entry i of a table of size N is the CDF at (i + 0.5) / N.
+// The values are sorted once, and then all the tables are made in a single pass over the sorted values, by walking
+// the sample points of every level in increasing order, instead of a binary search per entry per table.
+inline CDFTablePyramid MakeCDFTablePyramid(const std::vector<float>& values, size_t minSize, size_t maxSize)
+{
+	// sort the values, so that sampling this list as [0,1] samples the ICDF.
+	// add an explicit 0.0f and 1.0f if they aren't there
+	std::vector<float> valuesSorted = values;
+	if (valuesSorted[0] > 0.0f)
+		valuesSorted.insert(valuesSorted.begin(), 0.0f);
+	if (valuesSorted[valuesSorted.size() - 1] < 1.0f)
+		valuesSorted.push_back(1.0f);
+	RadixSortFloats(valuesSorted);
+
+	CDFTablePyramid pyramid;
+	for (size_t size = minSize; size <= maxSize; size *= 2)
+	{
+		pyramid.levels.emplace_back();
+		pyramid.levels.back().table.resize(size);
+	}
+
+	// every entry of every level, sorted by where it samples the CDF
+	struct SamplePoint
+	{
+		float percent;
+		unsigned int level;
+		unsigned int index;
+	};
+	std::vector<SamplePoint> samplePoints;
+	for (unsigned int level = 0; level < (unsigned int)pyramid.levels.size(); ++level)
+	{
+		size_t size = pyramid.levels[level].table.size();
+		for (unsigned int i = 0; i < (unsigned int)size; ++i)
+			samplePoints.push_back({ (float(i) + 0.5f) / float(size), level, i });
+	}
+	std::sort(samplePoints.begin(), samplePoints.end(), [](const SamplePoint& A, const SamplePoint& B) { return A.percent < B.percent; });
+
+	// walk the sorted values once
+	size_t index = 0;
+	for (const SamplePoint& samplePoint : samplePoints)
+	{
+		// find the index of the first value >= x.
+		// it is size if all values are less than x.
+		float percent = samplePoint.percent;
+		while (index < valuesSorted.size() && valuesSorted[index] < percent)
+			index++;
+
+		// find the percent 0 to 1 that the value occurs in the list, using linear interpolation to get more precise
+		// than an integer index.
+		float& out = pyramid.levels[samplePoint.level].table[samplePoint.index];
+		if (index == 0)
+			out = 0.0f;
+		else if (index == valuesSorted.size())
+			out = 1.0f;
+		else
+		{
+			size_t index1 = index - 1;
+			size_t index2 = index;
+			float min = valuesSorted[index1];
+			float max = valuesSorted[index2];
+			float indexFract = (percent - min) / (max - min);
+			out = (float(index1) + indexFract) / float(valuesSorted.size());
+		}
+	}
+
+	// measure each level against the largest
+	const std::vector<float>& reference = pyramid.levels.back().table;
+	for (CDFTableLevel& level : pyramid.levels)
+	{
+		float RMSE = 0.0f;
+		float maxError = 0.0f;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			float x = float(i) / float(reference.size() - 1);
+			float error = std::abs(SampleTable(level.table, x) - reference[i]);
+			RMSE = Lerp(RMSE, error * error, 1.0f / float(i + 1));
+			maxError = std::max(maxError, error);
+		}
+		level.RMSE = std::sqrt(RMSE);
+		level.maxError = maxError;
+	}
+
+	return pyramid;
+}
@@ -0,0 +1,782 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "platform.h"
+
+// A compact file format for columns of generated noise, for archiving the bluenoise folder and out.csv.
+//
+// Each column is split into blocks of c_columnStoreBlockSize values, which are compressed on their own:
+// * Index columns (like the void and cluster ranks, which are 17 bits stored in 64) are bit packed to the bits that
+//   the largest value in the block needs.
+// * Float columns are quantized to a step size that keeps every value within the column's max error, and the
+//   quantized values are stored as the fewest bytes that hold them, with the bytes shuffled so that all the first
+//   bytes are together, then all the second bytes and so on. The high bytes are mostly the same, so they compress.
+//   If bit packing the quantized values is smaller, that is used instead.
+//   If quantizing doesn't keep to the max error (a max error of 0, or any value in the block that isn't finite), the
+//   floats are stored as they are, shuffled the same way.
+// * Then every block goes through a small LZ compressor, and keeps the result if it is smaller.
+//
+// File layout:
+//   magic, version, block size
+//   the blocks, one after another
+//   the directory: each column's label, kind, max error and value count, and each block's offset, size and count
+//   the offset of the directory, magic
+// The directory is at the end so that blocks are written as they are made. A reader reads the directory first, and
+// then any block can be read and decompressed on its own, so a column is read a block per thread, or only the blocks
+// that are needed are read.
+// Everything the reader sizes memory with is checked against limits and against the rest of the directory first, so a
+// truncated or corrupt file fails to open, instead of making the reader allocate or write what the file says.
+
+static const uint32_t c_columnStoreMagic = 0x4C4F4354; // "TCOL"
+static const uint32_t c_columnStoreVersion = 2;
+
+// Values per block
+static const size_t c_columnStoreBlockSize = 1 << 16;
+
+// The most values per block, and the longest label, a file can have
+static const size_t c_columnStoreMaxBlockSize = 1 << 20;
+static const size_t c_columnStoreMaxLabelLength = 4096;
+
+enum class ColumnKind : uint32_t
+{
+	Index,
+	Float
+};
+
+struct ColumnStoreBlockInfo
+{
+	uint64_t offset = 0;
+	uint32_t size = 0;
+	uint32_t count = 0;
+};
+
+struct ColumnStoreColumnInfo
+{
+	std::string label;
+	ColumnKind kind = ColumnKind::Index;
+	float maxError = 0.0f;
+	uint64_t valueCount = 0;
+	std::vector<ColumnStoreBlockInfo> blocks;
+};
+
+namespace ColumnStoreInternal
+{
+	enum class BlockEncoding : uint8_t
+	{
+		BitPacked,          // indices, bit packed
+		QuantizedShuffled,  // quantized floats, byte shuffled
+		QuantizedBitPacked, // quantized floats, bit packed
+		RawFloat            // floats as they are, byte shuffled
+	};
+
+	// The header at the start of every block
+	struct BlockHeader
+	{
+		BlockEncoding encoding = BlockEncoding::BitPacked;
+		uint8_t compressed = 0;   // 1 if the payload went through the LZ compressor
+		uint8_t width = 0;        // bits per value when bit packed, bytes per value when shuffled
+		uint8_t unused = 0;
+		uint32_t count = 0;       // values in the block
+		uint32_t payloadSize = 0; // size of the payload before LZ
+		float step = 0.0f;        // quantization step
+		double base = 0.0;        // the value that quantizes to 0
+	};
+	static_assert(sizeof(BlockHeader) == 24, "BlockHeader is written as is, so should have no surprise padding");
+
+	// Bits needed to store value
+	inline uint8_t BitWidth(uint64_t value)
+	{
+		uint8_t width = 0;
+		while (value > 0)
+		{
+			width++;
+			value >>= 1;
+		}
+		return width;
+	}
+
+	inline void BitPack(const uint64_t* values, size_t count, uint8_t width, std::vector<uint8_t>& out)
+	{
+		out.assign((count * width + 7) / 8, 0);
+		size_t bit = 0;
+		for (size_t index = 0; index < count; ++index)
+		{
+			uint64_t value = values[index];
+			int remaining = width;
+			while (remaining > 0)
+			{
+				int bitInByte = int(bit & 7);
+				int take = std::min(remaining, 8 - bitInByte);
+				out[bit >> 3] |= uint8_t((value & ((1u << take) - 1)) << bitInByte);
+				value >>= take;
+				remaining -= take;
+				bit += take;
+			}
+		}
+	}
+
+	inline void BitUnpack(const uint8_t* in, size_t count, uint8_t width, uint64_t* values)
+	{
+		size_t bit = 0;
+		for (size_t index = 0; index < count; ++index)
+		{
+			uint64_t value = 0;
+			int done = 0;
+			while (done < width)
+			{
+				int bitInByte = int(bit & 7);
+				int take = std::min(width - done, 8 - bitInByte);
+				value |= uint64_t((in[bit >> 3] >> bitInByte) & ((1u << take) - 1)) << done;
+				done += take;
+				bit += take;
+			}
+			values[index] = value;
+		}
+	}
+
+	// Stores the low width bytes of each value, byte 0 of every value first, then byte 1 and so on
+	inline void ShuffleBytes(const uint32_t* values, size_t count, uint8_t width, std::vector<uint8_t>& out)
+	{
+		out.resize(count * width);
+		for (uint8_t byteIndex = 0; byteIndex < width; ++byteIndex)
+		{
+			uint8_t* plane = &out[byteIndex * count];
+			for (size_t index = 0; index < count; ++index)
+				plane[index] = uint8_t(values[index] >> (byteIndex * 8));
+		}
+	}
+
+	inline void UnshuffleBytes(const uint8_t* in, size_t count, uint8_t width, uint32_t* values)
+	{
+		std::fill(values, values + count, 0);
+		for (uint8_t byteIndex = 0; byteIndex < width; ++byteIndex)
+		{
+			const uint8_t* plane = &in[byteIndex * count];
+			for (size_t index = 0; index < count; ++index)
+				values[index] |= uint32_t(plane[index]) << (byteIndex * 8);
+		}
+	}
+
+	// The LZ compressor. The output is a list of a run of literal bytes and then a match:
+	//   literal count, literal bytes, match length - c_lzMinMatch, match offset
+	// where the counts are varints. The last run has no match after it. Matches are found with a hash table of the
+	// last position each 4 bytes were seen at, like LZ4.
+	static const size_t c_lzMinMatch = 4;
+	static const int c_lzHashBits = 16;
+
+	inline void WriteVarint(uint64_t value, std::vector<uint8_t>& out)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(uint8_t(value) | 0x80);
+			value >>= 7;
+		}
+		out.push_back(uint8_t(value));
+	}
+
+	inline bool ReadVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && in < end; shift += 7)
+		{
+			uint8_t byte = *in++;
+			value |= uint64_t(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	inline uint32_t LZHash(const uint8_t* bytes)
+	{
+		uint32_t value;
+		memcpy(&value, bytes, sizeof(value));
+		return (value * 2654435761u) >> (32 - c_lzHashBits);
+	}
+
+	inline void LZCompress(const std::vector<uint8_t>& in, std::vector<uint8_t>& out)
+	{
+		out.clear();
+		std::vector<uint32_t> lastSeen(size_t(1) << c_lzHashBits, 0xffffffff);
+
+		size_t literalStart = 0;
+		size_t position = 0;
+		while (position + c_lzMinMatch <= in.size())
+		{
+			uint32_t hash = LZHash(&in[position]);
+			size_t candidate = lastSeen[hash];
+			lastSeen[hash] = uint32_t(position);
+
+			if (candidate == 0xffffffff || memcmp(&in[candidate], &in[position], c_lzMinMatch) != 0)
+			{
+				position++;
+				continue;
+			}
+
+			size_t length = c_lzMinMatch;
+			while (position + length < in.size() && in[candidate + length] == in[position + length])
+				length++;
+
+			WriteVarint(position - literalStart, out);
+			out.insert(out.end(), in.begin() + literalStart, in.begin() + position);
+			WriteVarint(length - c_lzMinMatch, out);
+			WriteVarint(position - candidate, out);
+
+			position += length;
+			literalStart = position;
+		}
+
+		WriteVarint(in.size() - literalStart, out);
+		out.insert(out.end(), in.begin() + literalStart, in.end());
+	}
+
+	inline bool LZDecompress(const uint8_t* in, size_t inSize, std::vector<uint8_t>& out, size_t outSize)
+	{
+		out.resize(outSize);
+		const uint8_t* end = in + inSize;
+		size_t position = 0;
+		while (true)
+		{
+			uint64_t literalCount;
+			if (!ReadVarint(in, end, literalCount) || literalCount > size_t(end - in) || literalCount > outSize - position)
+				return false;
+			memcpy(out.data() + position, in, literalCount);
+			in += literalCount;
+			position += literalCount;
+
+			if (in == end)
+				return position == outSize;
+
+			uint64_t length, offset;
+			if (!ReadVarint(in, end, length) || !ReadVarint(in, end, offset))
+				return false;
+			length += c_lzMinMatch;
+			if (offset == 0 || offset > position || length > outSize - position)
+				return false;
+
+			// byte at a time, since the match can overlap what it is copying
+			for (uint64_t index = 0; index < length; ++index)
+				out[position + index] = out[position + index - offset];
+			position += length;
+		}
+	}
+
+	// Header, then the payload, LZ compressed if that is smaller
+	inline void FinishBlock(BlockHeader header, const std::vector<uint8_t>& payload, std::vector<uint8_t>& out)
+	{
+		std::vector<uint8_t> compressed;
+		LZCompress(payload, compressed);
+
+		header.payloadSize = uint32_t(payload.size());
+		header.compressed = (compressed.size() < payload.size()) ? 1 : 0;
+		const std::vector<uint8_t>& stored = header.compressed ? compressed : payload;
+
+		out.resize(sizeof(header) + stored.size());
+		memcpy(out.data(), &header, sizeof(header));
+		if (!stored.empty())
+			memcpy(&out[sizeof(header)], stored.data(), stored.size());
+	}
+
+	inline void EncodeIndexBlock(const uint64_t* values, size_t count, std::vector<uint8_t>& out)
+	{
+		BlockHeader header;
+		header.encoding = BlockEncoding::BitPacked;
+		header.count = uint32_t(count);
+		header.width = BitWidth(*std::max_element(values, values + count));
+
+		std::vector<uint8_t> payload;
+		BitPack(values, count, header.width, payload);
+		FinishBlock(header, payload, out);
+	}
+
+	inline float Dequantize(const BlockHeader& header, uint32_t quantized)
+	{
+		return float(header.base + double(quantized) * double(header.step));
+	}
+
+	inline void EncodeFloatBlock(const float* values, size_t count, float maxError, std::vector<uint8_t>& out)
+	{
+		BlockHeader header;
+		header.count = uint32_t(count);
+
+		// Quantize with a step of maxError, so rounding to a step is off by at most half of maxError, which leaves
+		// the other half for the float rounding of the dequantized value. Every value is checked, to be sure.
+		// min_element and max_element skip over NaNs, since they compare false, so each value is checked for being
+		// finite, and a block with any NaN or infinity is stored raw.
+		bool quantize = maxError > 0.0f;
+		float minValue = values[0];
+		float maxValue = values[0];
+		for (size_t index = 0; index < count && quantize; ++index)
+		{
+			quantize = std::isfinite(values[index]);
+			minValue = std::min(minValue, values[index]);
+			maxValue = std::max(maxValue, values[index]);
+		}
+		quantize = quantize && double(maxValue - minValue) / double(maxError) < 4294967295.0;
+
+		std::vector<uint32_t> quantized(count);
+		uint32_t maxQuantized = 0;
+		if (quantize)
+		{
+			header.base = minValue;
+			header.step = maxError;
+			for (size_t index = 0; index < count && quantize; ++index)
+			{
+				quantized[index] = uint32_t(std::round((double(values[index]) - header.base) / double(header.step)));
+				maxQuantized = std::max(maxQuantized, quantized[index]);
+				quantize = std::abs(Dequantize(header, quantized[index]) - values[index]) <= maxError;
+			}
+		}
+
+		std::vector<uint8_t> payload;
+		if (!quantize)
+		{
+			header.encoding = BlockEncoding::RawFloat;
+			header.base = 0.0;
+			header.step = 0.0f;
+			header.width = sizeof(float);
+			memcpy(quantized.data(), values, count * sizeof(float));
+			ShuffleBytes(quantized.data(), count, header.width, payload);
+			FinishBlock(header, payload, out);
+			return;
+		}
+
+		// Shuffled bytes compress well when the values cluster, like a histogram with a peak, but noise that is
+		// spread evenly doesn't compress, and then bit packing is smaller, since it doesn't round up to whole bytes.
+		header.encoding = BlockEncoding::QuantizedShuffled;
+		header.width = uint8_t((BitWidth(maxQuantized) + 7) / 8);
+		ShuffleBytes(quantized.data(), count, header.width, payload);
+		FinishBlock(header, payload, out);
+
+		std::vector<uint64_t> quantized64(quantized.begin(), quantized.end());
+		std::vector<uint8_t> bitPacked;
+		header.encoding = BlockEncoding::QuantizedBitPacked;
+		header.width = BitWidth(maxQuantized);
+		BitPack(quantized64.data(), count, header.width, payload);
+		FinishBlock(header, payload, bitPacked);
+		if (bitPacked.size() < out.size())
+			out.swap(bitPacked);
+	}
+
+	// Decodes a block into values, which are uint64_t for index columns and float for float columns
+	inline bool DecodeBlock(const std::vector<uint8_t>& block, uint64_t* indexValues, float* floatValues, size_t count)
+	{
+		BlockHeader header;
+		if (block.size() < sizeof(header))
+			return false;
+		memcpy(&header, block.data(), sizeof(header));
+		if (header.count != count || header.payloadSize > count * sizeof(uint64_t))
+			return false;
+
+		const uint8_t* stored = block.data() + sizeof(header);
+		const size_t storedSize = block.size() - sizeof(header);
+		std::vector<uint8_t> decompressed;
+		const uint8_t* payload = stored;
+		if (header.compressed)
+		{
+			if (!LZDecompress(stored, storedSize, decompressed, header.payloadSize))
+				return false;
+			payload = decompressed.data();
+		}
+		else if (storedSize != header.payloadSize)
+			return false;
+
+		switch (header.encoding)
+		{
+			case BlockEncoding::BitPacked:
+			{
+				if (!indexValues || header.width > 64 || header.payloadSize != (count * header.width + 7) / 8)
+					return false;
+				BitUnpack(payload, count, header.width, indexValues);
+				return true;
+			}
+			case BlockEncoding::QuantizedBitPacked:
+			{
+				if (!floatValues || header.width > 32 || header.payloadSize != (count * header.width + 7) / 8)
+					return false;
+				std::vector<uint64_t> quantized(count);
+				BitUnpack(payload, count, header.width, quantized.data());
+				for (size_t index = 0; index < count; ++index)
+					floatValues[index] = Dequantize(header, uint32_t(quantized[index]));
+				return true;
+			}
+			case BlockEncoding::QuantizedShuffled:
+			case BlockEncoding::RawFloat:
+			{
+				if (!floatValues || header.width > sizeof(uint32_t) || header.payloadSize != count * header.width)
+					return false;
+				std::vector<uint32_t> quantized(count);
+				UnshuffleBytes(payload, count, header.width, quantized.data());
+				if (header.encoding == BlockEncoding::RawFloat)
+					memcpy(floatValues, quantized.data(), count * sizeof(float));
+				else
+				{
+					for (size_t index = 0; index < count; ++index)
+						floatValues[index] = Dequantize(header, quantized[index]);
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Runs work(itemIndex) for itemCount items, spread over threadCount threads. A threadCount of 0 uses all the cores.
+	template <typename LAMBDA>
+	inline void ParallelFor(size_t itemCount, unsigned int threadCount, const LAMBDA& work)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		threadCount = (unsigned int)std::max<size_t>(std::min<size_t>(threadCount, itemCount), 1);
+
+		std::vector<std::thread> threads;
+		for (unsigned int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+		{
+			threads.emplace_back([&, threadIndex]()
+				{
+					for (size_t index = threadIndex; index < itemCount; index += threadCount)
+						work(index);
+				}
+			);
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+}
+
+// Writes a column store file. Columns are compressed a block per thread, and written as each column is added.
+class ColumnStoreWriter
+{
+public:
+	// blockSize is clamped to [1, c_columnStoreMaxBlockSize]
+	ColumnStoreWriter(const char* fileName, size_t blockSize = c_columnStoreBlockSize, unsigned int threadCount = 0)
+		: m_blockSize(std::min(std::max(blockSize, size_t(1)), c_columnStoreMaxBlockSize))
+		, m_threadCount(threadCount)
+	{
+		fopen_s(&m_file, fileName, "wb");
+		if (m_file)
+		{
+			fwrite(&c_columnStoreMagic, sizeof(c_columnStoreMagic), 1, m_file);
+			uint32_t blockSize32 = uint32_t(m_blockSize);
+			fwrite(&c_columnStoreVersion, sizeof(c_columnStoreVersion), 1, m_file);
+			fwrite(&blockSize32, sizeof(blockSize32), 1, m_file);
+			m_offset = sizeof(c_columnStoreMagic) + sizeof(c_columnStoreVersion) + sizeof(blockSize32);
+		}
+	}
+
+	ColumnStoreWriter(const ColumnStoreWriter&) = delete;
+	ColumnStoreWriter& operator=(const ColumnStoreWriter&) = delete;
+
+	~ColumnStoreWriter()
+	{
+		Close();
+	}
+
+	bool IsOpen() const
+	{
+		return m_file != nullptr;
+	}
+
+	// Lossless, and bit packed, so is best for values that are much smaller than their type, like ranks
+	void AddIndexColumn(const char* label, const std::vector<size_t>& values)
+	{
+		std::vector<uint64_t> values64(values.begin(), values.end());
+		AddColumn(label, ColumnKind::Index, 0.0f, values.size(),
+			[&](size_t begin, size_t count, std::vector<uint8_t>& out)
+			{
+				ColumnStoreInternal::EncodeIndexBlock(&values64[begin], count, out);
+			}
+		);
+	}
+
+	// Every value read back is within maxError of the value written. A maxError of 0 is lossless.
+	void AddFloatColumn(const char* label, const std::vector<float>& values, float maxError)
+	{
+		AddColumn(label, ColumnKind::Float, maxError, values.size(),
+			[&](size_t begin, size_t count, std::vector<uint8_t>& out)
+			{
+				ColumnStoreInternal::EncodeFloatBlock(&values[begin], count, maxError, out);
+			}
+		);
+	}
+
+	// Writes the directory and closes the file. Called by the destructor. Returns false if anything failed to write.
+	bool Close()
+	{
+		if (!m_file)
+			return false;
+
+		uint64_t directoryOffset = m_offset;
+		uint32_t columnCount = uint32_t(m_columns.size());
+		Write(&columnCount, sizeof(columnCount));
+		for (const ColumnStoreColumnInfo& column : m_columns)
+		{
+			uint32_t labelLength = uint32_t(column.label.size());
+			uint32_t blockCount = uint32_t(column.blocks.size());
+			Write(&labelLength, sizeof(labelLength));
+			Write(column.label.data(), labelLength);
+			Write(&column.kind, sizeof(column.kind));
+			Write(&column.maxError, sizeof(column.maxError));
+			Write(&column.valueCount, sizeof(column.valueCount));
+			Write(&blockCount, sizeof(blockCount));
+			for (const ColumnStoreBlockInfo& block : column.blocks)
+			{
+				Write(&block.offset, sizeof(block.offset));
+				Write(&block.size, sizeof(block.size));
+				Write(&block.count, sizeof(block.count));
+			}
+		}
+		Write(&directoryOffset, sizeof(directoryOffset));
+		Write(&c_columnStoreMagic, sizeof(c_columnStoreMagic));
+
+		bool ok = !m_failed;
+		ok = (fclose(m_file) == 0) && ok;
+		m_file = nullptr;
+		return ok;
+	}
+
+	// Bytes written so far
+	uint64_t Size() const
+	{
+		return m_offset;
+	}
+
+private:
+	template <typename LAMBDA>
+	void AddColumn(const char* label, ColumnKind kind, float maxError, size_t valueCount, const LAMBDA& encodeBlock)
+	{
+		if (!m_file)
+			return;
+
+		ColumnStoreColumnInfo column;
+		column.label = label;
+		column.kind = kind;
+		column.maxError = maxError;
+		column.valueCount = valueCount;
+
+		const size_t blockCount = (valueCount + m_blockSize - 1) / m_blockSize;
+		std::vector<std::vector<uint8_t>> blocks(blockCount);
+		ColumnStoreInternal::ParallelFor(blockCount, m_threadCount,
+			[&](size_t blockIndex)
+			{
+				size_t begin = blockIndex * m_blockSize;
+				encodeBlock(begin, std::min(m_blockSize, valueCount - begin), blocks[blockIndex]);
+			}
+		);
+
+		for (size_t blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+		{
+			ColumnStoreBlockInfo info;
+			info.offset = m_offset;
+			info.size = uint32_t(blocks[blockIndex].size());
+			info.count = uint32_t(std::min(m_blockSize, valueCount - blockIndex * m_blockSize));
+			column.blocks.push_back(info);
+			Write(blocks[blockIndex].data(), blocks[blockIndex].size());
+		}
+
+		m_columns.push_back(std::move(column));
+	}
+
+	void Write(const void* data, size_t size)
+	{
+		if (fwrite(data, 1, size, m_file) != size)
+			m_failed = true;
+		m_offset += size;
+	}
+
+	FILE* m_file = nullptr;
+	size_t m_blockSize;
+	unsigned int m_threadCount;
+	uint64_t m_offset = 0;
+	bool m_failed = false;
+	std::vector<ColumnStoreColumnInfo> m_columns;
+};
+
+// Reads a column store file. Reading a block is safe from any thread: the file reads take turns, and the
+// decompression happens in parallel.
+class ColumnStoreReader
+{
+public:
+	ColumnStoreReader() = default;
+	ColumnStoreReader(const ColumnStoreReader&) = delete;
+	ColumnStoreReader& operator=(const ColumnStoreReader&) = delete;
+
+	~ColumnStoreReader()
+	{
+		if (m_file)
+			fclose(m_file);
+	}
+
+	// Reads the directory. Returns false if the file isn't there, isn't a column store, or the directory doesn't add up:
+	// a label or block too big, a block outside of the blocks, or block counts that don't sum to the column's count.
+	bool Open(const char* fileName)
+	{
+		fopen_s(&m_file, fileName, "rb");
+		if (!m_file)
+			return false;
+
+		const uint64_t c_firstBlockOffset = sizeof(uint32_t) * 3;
+		uint32_t magic = 0, version = 0, blockSize = 0;
+		uint64_t directoryOffset = 0;
+		bool ok =
+			fread(&magic, sizeof(magic), 1, m_file) == 1 && magic == c_columnStoreMagic &&
+			fread(&version, sizeof(version), 1, m_file) == 1 && version == c_columnStoreVersion &&
+			fread(&blockSize, sizeof(blockSize), 1, m_file) == 1 && blockSize > 0 && blockSize <= c_columnStoreMaxBlockSize &&
+			_fseeki64(m_file, -int64_t(sizeof(directoryOffset) + sizeof(magic)), SEEK_END) == 0 &&
+			fread(&directoryOffset, sizeof(directoryOffset), 1, m_file) == 1 &&
+			fread(&magic, sizeof(magic), 1, m_file) == 1 && magic == c_columnStoreMagic &&
+			directoryOffset >= c_firstBlockOffset &&
+			_fseeki64(m_file, int64_t(directoryOffset), SEEK_SET) == 0;
+
+		uint32_t columnCount = 0;
+		ok = ok && fread(&columnCount, sizeof(columnCount), 1, m_file) == 1;
+		for (uint32_t columnIndex = 0; ok && columnIndex < columnCount; ++columnIndex)
+		{
+			ColumnStoreColumnInfo column;
+			uint32_t labelLength = 0, blockCount = 0;
+			ok = fread(&labelLength, sizeof(labelLength), 1, m_file) == 1 && labelLength <= c_columnStoreMaxLabelLength;
+			column.label.resize(ok ? labelLength : 0);
+			ok = ok &&
+				fread(&column.label[0], 1, labelLength, m_file) == labelLength &&
+				fread(&column.kind, sizeof(column.kind), 1, m_file) == 1 &&
+				(column.kind == ColumnKind::Index || column.kind == ColumnKind::Float) &&
+				fread(&column.maxError, sizeof(column.maxError), 1, m_file) == 1 &&
+				fread(&column.valueCount, sizeof(column.valueCount), 1, m_file) == 1 &&
+				fread(&blockCount, sizeof(blockCount), 1, m_file) == 1;
+
+			// the writer makes every block full but the last, so the block count follows from the value count.
+			// Every block has a header, so there can't be more of them than fit before the directory.
+			const uint64_t blockHeaderSize = sizeof(ColumnStoreInternal::BlockHeader);
+			ok = ok &&
+				blockCount <= (directoryOffset - c_firstBlockOffset) / blockHeaderSize &&
+				column.valueCount <= uint64_t(blockCount) * blockSize &&
+				blockCount == (column.valueCount + blockSize - 1) / blockSize;
+
+			column.blocks.resize(ok ? blockCount : 0);
+			uint64_t valueSum = 0;
+			for (ColumnStoreBlockInfo& block : column.blocks)
+			{
+				ok = ok &&
+					fread(&block.offset, sizeof(block.offset), 1, m_file) == 1 &&
+					fread(&block.size, sizeof(block.size), 1, m_file) == 1 &&
+					fread(&block.count, sizeof(block.count), 1, m_file) == 1 &&
+					block.count > 0 && block.count <= blockSize &&
+					block.size >= blockHeaderSize &&
+					block.offset >= c_firstBlockOffset && block.offset <= directoryOffset &&
+					block.size <= directoryOffset - block.offset;
+				valueSum += block.count;
+			}
+			ok = ok && valueSum == column.valueCount;
+			m_columns.push_back(std::move(column));
+		}
+
+		if (!ok)
+		{
+			fclose(m_file);
+			m_file = nullptr;
+			m_columns.clear();
+		}
+		return ok;
+	}
+
+	const std::vector<ColumnStoreColumnInfo>& Columns() const
+	{
+		return m_columns;
+	}
+
+	// The index of the column with this label, or -1 if there isn't one
+	int FindColumn(const char* label) const
+	{
+		for (size_t index = 0; index < m_columns.size(); ++index)
+		{
+			if (m_columns[index].label == label)
+				return int(index);
+		}
+		return -1;
+	}
+
+	// Reads one block of an index column into values, which needs room for the block's count.
+	bool ReadBlock(size_t column, size_t block, size_t* values)
+	{
+		std::vector<uint64_t> values64(m_columns[column].blocks[block].count);
+		if (m_columns[column].kind != ColumnKind::Index || !ReadAndDecode(column, block, values64.data(), nullptr))
+			return false;
+		std::copy(values64.begin(), values64.end(), values);
+		return true;
+	}
+
+	// Reads one block of a float column into values, which needs room for the block's count.
+	bool ReadBlock(size_t column, size_t block, float* values)
+	{
+		return m_columns[column].kind == ColumnKind::Float && ReadAndDecode(column, block, nullptr, values);
+	}
+
+	// Reads whole columns, with the blocks of all of them spread over the threads. A threadCount of 0 uses all the cores.
+	template <typename T>
+	bool ReadColumns(const std::vector<size_t>& columns, std::vector<std::vector<T>>& values, unsigned int threadCount = 0)
+	{
+		struct Work
+		{
+			size_t column;
+			size_t block;
+			T* out;
+		};
+
+		values.resize(columns.size());
+		std::vector<Work> work;
+		for (size_t index = 0; index < columns.size(); ++index)
+		{
+			const ColumnStoreColumnInfo& column = m_columns[columns[index]];
+			values[index].resize(column.valueCount);
+			size_t begin = 0;
+			for (size_t block = 0; block < column.blocks.size(); ++block)
+			{
+				work.push_back({ columns[index], block, values[index].data() + begin });
+				begin += column.blocks[block].count;
+			}
+		}
+
+		std::vector<uint8_t> failed(work.size(), 0);
+		ColumnStoreInternal::ParallelFor(work.size(), threadCount,
+			[&](size_t index)
+			{
+				failed[index] = !ReadBlock(work[index].column, work[index].block, work[index].out);
+			}
+		);
+		return std::count(failed.begin(), failed.end(), 1) == 0;
+	}
+
+	template <typename T>
+	bool ReadColumn(size_t column, std::vector<T>& values, unsigned int threadCount = 0)
+	{
+		std::vector<std::vector<T>> columnValues;
+		if (!ReadColumns({ column }, columnValues, threadCount))
+			return false;
+		values = std::move(columnValues[0]);
+		return true;
+	}
+
+private:
+	bool ReadAndDecode(size_t column, size_t block, uint64_t* indexValues, float* floatValues)
+	{
+		const ColumnStoreBlockInfo& info = m_columns[column].blocks[block];
+		std::vector<uint8_t> bytes(info.size);
+		{
+			std::lock_guard<std::mutex> lock(m_fileMutex);
+			if (_fseeki64(m_file, int64_t(info.offset), SEEK_SET) != 0 || fread(bytes.data(), 1, bytes.size(), m_file) != bytes.size())
+				return false;
+		}
+		return ColumnStoreInternal::DecodeBlock(bytes, indexValues, floatValues, info.count);
+	}
+
+	FILE* m_file = nullptr;
+	std::mutex m_fileMutex;
+	std::vector<ColumnStoreColumnInfo> m_columns;
+};
@@ -2,6 +2,11 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <future>
+#include "platform.h"
+#include "asyncwriter.h"
+#include "columnstore.h"
 
 struct Column
 {
@@ -10,10 +15,10 @@ struct Column
 };
 typedef std::vector<Column> CSV;
 
+// The formatting is done on this thread and the disk writes on a background thread, so they overlap
 inline void WriteCSV(const CSV& csv, const char* fileName)
 {
-	FILE* file = nullptr;
-	fopen_s(&file, fileName, "wb");
+	AsyncFileWriter file(fileName, "wb");
 
 	if (csv.size() > 0)
 	{
@@ -22,11 +27,11 @@ inline void WriteCSV(const CSV& csv, const char* fileName)
 		bool first = true;
 		for (const Column& column : csv)
 		{
-			fprintf(file, "%s\"%s\"", first ? "" : ",", column.label.c_str());
+			file.Printf("%s\"%s\"", first ? "" : ",", column.label.c_str());
 			maxColSize = std::max(maxColSize, column.values.size());
 			first = false;
 		}
-		fprintf(file, "\n");
+		file.Printf("\n");
 
 		// write data
 		for (size_t i = 0; i < maxColSize; ++i)
@@ -35,14 +40,62 @@ inline void WriteCSV(const CSV& csv, const char* fileName)
 			for (const Column& column : csv)
 			{
 				if (column.values.size() > i)
-					fprintf(file, "%s\"%f\"", first ? "" : ",", column.values[i]);
+					file.Printf("%s\"%f\"", first ? "" : ",", column.values[i]);
 				else
-					fprintf(file, "%s\"\"", first ? "" : ",");
+					file.Printf("%s\"\"", first ? "" : ",");
 				first = false;
 			}
-			fprintf(file, "\n");
+			file.Printf("\n");
 		}
 	}
+}
 
-	fclose(file);
-}
\ No newline at end of file
+// Writes the CSV on another thread, for when there is other work to do meanwhile. Wait on the future before using
+// the file.
+inline std::future<void> WriteCSVAsync(CSV&& csv, const char* fileName)
+{
+	return std::async(std::launch::async,
+		[](CSV csv, std::string fileName)
+		{
+			WriteCSV(csv, fileName.c_str());
+		},
+		std::move(csv), std::string(fileName)
+	);
+}
+
+// Writes the CSV as a column store (see columnstore.h), which is much smaller, and can be read a column at a time.
+// Every value is within maxError of the one in the CSV.
+inline bool WriteCSVColumnStore(const CSV& csv, const char* fileName, float maxError)
+{
+	ColumnStoreWriter writer(fileName);
+	for (const Column& column : csv)
+		writer.AddFloatColumn(column.label.c_str(), column.values, maxError);
+	return writer.Close();
+}
+
+// Reads a CSV from a column store, decompressing the blocks on all cores
+inline bool ReadCSVColumnStore(const char* fileName, CSV& csv)
+{
+	ColumnStoreReader reader;
+	if (!reader.Open(fileName))
+		return false;
+
+	std::vector<size_t> columns;
+	for (size_t index = 0; index < reader.Columns().size(); ++index)
+	{
+		if (reader.Columns()[index].kind == ColumnKind::Float)
+			columns.push_back(index);
+	}
+
+	std::vector<std::vector<float>> values;
+	if (!reader.ReadColumns(columns, values))
+		return false;
+
+	csv.resize(columns.size());
+	for (size_t index = 0; index < columns.size(); ++index)
+	{
+		csv[index].label = reader.Columns()[columns[index]].label;
+		csv[index].values = std::move(values[index]);
+	}
+	return true;
+}
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "pcg/pcg_basic.h"
+#include "mathutils.h"
+#include "spmd.h"
+#include "platform.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+// Picks the fastest version of each hot kernel for the CPU it's running on, so one binary runs well on everything
+// from SSE4.2 to AVX-512.
+// * The CPU is checked with cpuid the first time Kernels() is called, which fills in a table of function pointers
+//   to the best version of each kernel. After that, a call is one indirect call.
+// * Setting the environment variable TOUNIFORM_ISA to scalar, sse4.2, avx2 or avx512 forces a path, for testing.
+//   If the CPU can't run it, the best path it can run is used instead.
+// * Every path gives the same bits, which DispatchSelfTest() checks, in the Dispatch test that ctest runs with each
+//   TOUNIFORM_ISA. The kernels are the same code compiled for each instruction set, and FMA contraction is off, so
+//   vectorizing only changes how many outputs are made at once, not the math of any one of them. The ToUniformStream
+//   CMake target passes -ffp-contract=off to everything that links it. Code built some other way needs it too.
+// GCC and Clang compile the kernels for each instruction set with the target attribute. MSVC has no per function
+// target, so there every path is compiled for the instruction set of the build, which gives the same bits, but
+// isn't any faster.
+
+enum class DispatchISA
+{
+	Scalar,
+	SSE42,
+	AVX2,
+	AVX512,
+	Count
+};
+
+inline const char* DispatchISAName(DispatchISA ISA)
+{
+	switch (ISA)
+	{
+		case DispatchISA::Scalar: return "scalar";
+		case DispatchISA::SSE42: return "sse4.2";
+		case DispatchISA::AVX2: return "avx2";
+		case DispatchISA::AVX512: return "avx512";
+		default: return "unknown";
+	}
+}
+
+struct NoiseKernels
+{
+	DispatchISA ISA;
+
+	// Writes count uniform white noise values in [0,1) and advances rng past them. The same values as count calls to
+	// ldexpf((float)pcg32_random_r(&rng), -32).
+	void (*UniformFloats)(pcg32_random_t& rng, float* out, size_t count);
+
+	// out[i] = the sum of in[i - tap] * kernel[tap], for the taps where i - tap >= 0, which is the first count
+	// values of Convolve(in, kernel). out can't be in.
+	void (*FIR)(const float* in, size_t count, const float* kernel, size_t taps, float* out);
+
+	// SamplePaddedTable of each x, with a table of size entries, plus the padding entry
+	void (*RemapLUT)(const float* paddedTable, size_t size, const float* x, float* out, size_t count);
+
+	// A piecewise cubic polynomial of each x, with the pieces evenly spaced in [0,1], and 4 Horner coefficients per
+	// piece, highest power first, like BlueNoisePolynomialProgram
+	void (*RemapPolynomial)(const float* coefficients, int pieces, const float* x, float* out, size_t count);
+
+	// Counts each x, clamped to [0,1], into bins[min(x * binCount, binCount - 1)]. binCount has to fit in an int.
+	void (*Histogram)(const float* x, size_t count, uint64_t* bins, size_t binCount);
+};
+
+// How many outputs the FIR and histogram kernels work on at a time
+static const size_t c_dispatchBlockSize = 256;
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DISPATCH_X86_TARGETS() true
+#else
+#define DISPATCH_X86_TARGETS() false
+#endif
+
+// The scalar path has the vectorizer turned off, where the compiler allows that per function
+#define DISPATCH_KERNEL_NAMESPACE DispatchScalar
+#if defined(__GNUC__) && !defined(__clang__)
+#define DISPATCH_KERNEL_TARGET __attribute__((optimize("no-tree-vectorize", "no-tree-slp-vectorize")))
+#else
+#define DISPATCH_KERNEL_TARGET
+#endif
+#define DISPATCH_KERNEL_WIDTH 1
+#include "dispatchkernels.h"
+#undef DISPATCH_KERNEL_NAMESPACE
+#undef DISPATCH_KERNEL_TARGET
+#undef DISPATCH_KERNEL_WIDTH
+
+#define DISPATCH_KERNEL_NAMESPACE DispatchSSE42
+#if DISPATCH_X86_TARGETS()
+#define DISPATCH_KERNEL_TARGET __attribute__((target("sse4.2")))
+#else
+#define DISPATCH_KERNEL_TARGET
+#endif
+#define DISPATCH_KERNEL_WIDTH 4
+#include "dispatchkernels.h"
+#undef DISPATCH_KERNEL_NAMESPACE
+#undef DISPATCH_KERNEL_TARGET
+#undef DISPATCH_KERNEL_WIDTH
+
+#define DISPATCH_KERNEL_NAMESPACE DispatchAVX2
+#if DISPATCH_X86_TARGETS()
+#define DISPATCH_KERNEL_TARGET __attribute__((target("avx2")))
+#else
+#define DISPATCH_KERNEL_TARGET
+#endif
+#define DISPATCH_KERNEL_WIDTH 8
+#include "dispatchkernels.h"
+#undef DISPATCH_KERNEL_NAMESPACE
+#undef DISPATCH_KERNEL_TARGET
+#undef DISPATCH_KERNEL_WIDTH
+
+#define DISPATCH_KERNEL_NAMESPACE DispatchAVX512
+#if DISPATCH_X86_TARGETS()
+#define DISPATCH_KERNEL_TARGET __attribute__((target("avx512f,avx512dq,avx512vl,avx512bw")))
+#else
+#define DISPATCH_KERNEL_TARGET
+#endif
+#define DISPATCH_KERNEL_WIDTH 16
+#include "dispatchkernels.h"
+#undef DISPATCH_KERNEL_NAMESPACE
+#undef DISPATCH_KERNEL_TARGET
+#undef DISPATCH_KERNEL_WIDTH
+
+namespace DispatchInternal
+{
+	inline void CPUID(unsigned int leaf, unsigned int subleaf, unsigned int registers[4])
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		__cpuidex((int*)registers, int(leaf), int(subleaf));
+#elif defined(__x86_64__) || defined(__i386__)
+		if (!__get_cpuid_count(leaf, subleaf, &registers[0], &registers[1], &registers[2], &registers[3]))
+			registers[0] = registers[1] = registers[2] = registers[3] = 0;
+#else
+		(void)leaf;
+		(void)subleaf;
+		registers[0] = registers[1] = registers[2] = registers[3] = 0;
+#endif
+	}
+
+	// Which register state the OS saves on a context switch. Wide registers can't be used unless it saves them.
+	inline uint64_t XCR0()
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		return _xgetbv(0);
+#elif defined(__x86_64__) || defined(__i386__)
+		unsigned int eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (uint64_t(edx) << 32) | eax;
+#else
+		return 0;
+#endif
+	}
+
+	// The best instruction set this CPU and OS can run, of the ones there are kernels for
+	inline DispatchISA DetectISA()
+	{
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || defined(__x86_64__) || defined(__i386__)
+		unsigned int registers[4];
+		CPUID(0, 0, registers);
+		const unsigned int maxLeaf = registers[0];
+
+		CPUID(1, 0, registers);
+		const bool SSE42 = (registers[2] & (1u << 20)) != 0;
+		const bool OSXSAVE = (registers[2] & (1u << 27)) != 0;
+		if (!SSE42)
+			return DispatchISA::Scalar;
+
+		// the OS has to save the SSE and AVX state for AVX2, and the AVX-512 state too for AVX-512
+		const uint64_t xcr0 = OSXSAVE ? XCR0() : 0;
+		const bool OSAVX = (xcr0 & 0x6) == 0x6;
+		const bool OSAVX512 = (xcr0 & 0xe6) == 0xe6;
+		if (maxLeaf < 7 || !OSAVX)
+			return DispatchISA::SSE42;
+
+		CPUID(7, 0, registers);
+		const bool AVX2 = (registers[1] & (1u << 5)) != 0;
+		const unsigned int AVX512Bits = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31); // F, DQ, BW, VL
+		const bool AVX512 = (registers[1] & AVX512Bits) == AVX512Bits;
+
+		if (AVX512 && AVX2 && OSAVX512)
+			return DispatchISA::AVX512;
+		if (AVX2)
+			return DispatchISA::AVX2;
+		return DispatchISA::SSE42;
+#else
+		return DispatchISA::Scalar;
+#endif
+	}
+
+	// TOUNIFORM_ISA, or Count if it isn't set or isn't one of the names
+	inline DispatchISA ISAOverride()
+	{
+		const char* name = getenv("TOUNIFORM_ISA");
+		if (!name || !name[0])
+			return DispatchISA::Count;
+		for (int ISA = 0; ISA < (int)DispatchISA::Count; ++ISA)
+		{
+			if (strcmp(name, DispatchISAName((DispatchISA)ISA)) == 0)
+				return (DispatchISA)ISA;
+		}
+		printf("TOUNIFORM_ISA=%s isn't scalar, sse4.2, avx2 or avx512, so is ignored\n", name);
+		return DispatchISA::Count;
+	}
+
+	inline NoiseKernels MakeKernels(DispatchISA ISA)
+	{
+		switch (ISA)
+		{
+			case DispatchISA::AVX512: return DispatchAVX512::MakeKernels(ISA);
+			case DispatchISA::AVX2: return DispatchAVX2::MakeKernels(ISA);
+			case DispatchISA::SSE42: return DispatchSSE42::MakeKernels(ISA);
+			default: return DispatchScalar::MakeKernels(DispatchISA::Scalar);
+		}
+	}
+
+	inline DispatchISA SelectISA()
+	{
+		const DispatchISA detected = DetectISA();
+		DispatchISA ISA = ISAOverride();
+		if (ISA == DispatchISA::Count)
+			return detected;
+		if ((int)ISA > (int)detected)
+		{
+			printf("TOUNIFORM_ISA=%s, but this CPU can only run up to %s\n", DispatchISAName(ISA), DispatchISAName(detected));
+			ISA = detected;
+		}
+		return ISA;
+	}
+}
+
+// The best instruction set the CPU can run, ignoring TOUNIFORM_ISA
+inline DispatchISA DetectedISA()
+{
+	static const DispatchISA ISA = DispatchInternal::DetectISA();
+	return ISA;
+}
+
+// The kernels for the CPU, or for TOUNIFORM_ISA if it's set
+inline const NoiseKernels& Kernels()
+{
+	static const NoiseKernels kernels = DispatchInternal::MakeKernels(DispatchInternal::SelectISA());
+	return kernels;
+}
+
+// The kernels for a specific instruction set, for testing and timing each path. Returns nullptr if the CPU can't
+// run it.
+inline const NoiseKernels* KernelsFor(DispatchISA ISA)
+{
+	static NoiseKernels kernels[(int)DispatchISA::Count] = {
+		DispatchInternal::MakeKernels(DispatchISA::Scalar),
+		DispatchInternal::MakeKernels(DispatchISA::SSE42),
+		DispatchInternal::MakeKernels(DispatchISA::AVX2),
+		DispatchInternal::MakeKernels(DispatchISA::AVX512)
+	};
+	if ((int)ISA >= (int)DispatchISA::Count || (int)ISA > (int)DetectedISA())
+		return nullptr;
+	return &kernels[(int)ISA];
+}
+
+// The 3 tap filter and remap of a NoiseStreamSPMD program over a block of white noise, compiled for each instruction
+// set like the kernels above, for the bulk fills of the C API. The kernels can't be in NoiseKernels, since there is
+// one per program. values has the two values before the block in front, oldest first, so out[i] is the program's
+// output for values[i + 2], after values[i + 1] and values[i]. Every path gives the same bits as
+// NoiseStreamSPMD<1, PROGRAM>::Evaluate, for the same reason the kernels above do.
+// The loops are kept out of line, because GCC doesn't vectorize them once they are inlined into another function.
+template <typename PROGRAM>
+struct DispatchProgram
+{
+	static void Remap(DispatchISA ISA, const PROGRAM& program, const float* values, float* out, size_t count)
+	{
+		switch (ISA)
+		{
+			case DispatchISA::AVX512: RemapAVX512(program, values, out, count); break;
+			case DispatchISA::AVX2: RemapAVX2(program, values, out, count); break;
+			case DispatchISA::SSE42: RemapSSE42(program, values, out, count); break;
+			default: RemapScalar(program, values, out, count); break;
+		}
+	}
+
+private:
+#if defined(_MSC_VER)
+#define DISPATCH_PROGRAM_NOINLINE __declspec(noinline)
+#else
+#define DISPATCH_PROGRAM_NOINLINE __attribute__((noinline))
+#endif
+#define DISPATCH_PROGRAM_REMAP(NAME, TARGET) \
+	static DISPATCH_PROGRAM_NOINLINE TARGET void NAME(const PROGRAM& program, const float* __restrict values, float* __restrict out, size_t count) \
+	{ \
+		for (size_t index = 0; index < count; ++index) \
+			out[index] = NoiseStreamSPMD<1, PROGRAM>::Evaluate(program, values[index + 2], values[index + 1], values[index]); \
+	}
+
+#if defined(__GNUC__) && !defined(__clang__)
+	DISPATCH_PROGRAM_REMAP(RemapScalar, __attribute__((optimize("no-tree-vectorize", "no-tree-slp-vectorize"))))
+#else
+	DISPATCH_PROGRAM_REMAP(RemapScalar, )
+#endif
+#if DISPATCH_X86_TARGETS()
+	DISPATCH_PROGRAM_REMAP(RemapSSE42, __attribute__((target("sse4.2"))))
+	DISPATCH_PROGRAM_REMAP(RemapAVX2, __attribute__((target("avx2"))))
+	DISPATCH_PROGRAM_REMAP(RemapAVX512, __attribute__((target("avx512f,avx512dq,avx512vl,avx512bw"))))
+#else
+	DISPATCH_PROGRAM_REMAP(RemapSSE42, )
+	DISPATCH_PROGRAM_REMAP(RemapAVX2, )
+	DISPATCH_PROGRAM_REMAP(RemapAVX512, )
+#endif
+#undef DISPATCH_PROGRAM_REMAP
+#undef DISPATCH_PROGRAM_NOINLINE
+};
+
+// Runs every kernel on every path the CPU can run, and checks they all give the same bits as the scalar path.
+// Prints what differs and returns false if any don't.
+inline bool DispatchSelfTest()
+{
+	static const size_t c_count = 100003;
+	static const size_t c_bins = 1000;
+	static const float c_kernel[] = { 0.0002f, -0.0060f, 0.0606f, -0.2417f, 0.3829f, -0.2417f, 0.0606f, -0.0060f, 0.0002f };
+	static const float c_polynomial[16] = {
+		5.25964f, 0.039474f, 0.000708779f, 0.0f,
+		-5.20987f, 7.82905f, -1.93105f, 0.159677f,
+		-5.22644f, 7.8272f, -1.91677f, 0.15507f,
+		5.23882f, -15.761f, 15.8054f, -4.28323f
+	};
+
+	struct Results
+	{
+		std::vector<float> uniform, filtered, LUT, polynomial;
+		std::vector<uint64_t> histogram;
+		uint64_t rngState = 0;
+	};
+
+	std::vector<float> table(65);
+	for (size_t index = 0; index < 64; ++index)
+		table[index] = float(index * index) / float(63 * 63);
+	table[64] = table[63];
+
+	// an odd count, so the vector loops have a remainder, and values outside [0,1] for the histogram clamps
+	auto Run = [&](const NoiseKernels& kernels)
+	{
+		Results results;
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, 0xa000b800, 7);
+		results.uniform.resize(c_count);
+		kernels.UniformFloats(rng, results.uniform.data(), c_count);
+		results.rngState = rng.state;
+
+		results.filtered.resize(c_count);
+		kernels.FIR(results.uniform.data(), c_count, c_kernel, _countof(c_kernel), results.filtered.data());
+
+		results.LUT.resize(c_count);
+		kernels.RemapLUT(table.data(), 64, results.uniform.data(), results.LUT.data(), c_count);
+
+		results.polynomial.resize(c_count);
+		kernels.RemapPolynomial(c_polynomial, 4, results.uniform.data(), results.polynomial.data(), c_count);
+
+		results.histogram.resize(c_bins, 0);
+		std::vector<float> histogramValues = results.filtered;
+		for (float& value : histogramValues)
+			value = value * 2.0f + 0.5f;
+		kernels.Histogram(histogramValues.data(), c_count, results.histogram.data(), c_bins);
+		return results;
+	};
+
+	Results reference = Run(*KernelsFor(DispatchISA::Scalar));
+
+	// the scalar path has to match the code it replaces, too
+	{
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, 0xa000b800, 7);
+		std::vector<float> uniform(c_count);
+		for (float& value : uniform)
+			value = ldexpf((float)pcg32_random_r(&rng), -32);
+		std::vector<float> convolved = Convolve(uniform, std::vector<float>(c_kernel, c_kernel + _countof(c_kernel)));
+		convolved.resize(c_count);
+		if (uniform != reference.uniform || rng.state != reference.rngState || convolved != reference.filtered)
+		{
+			printf("Dispatch test failed: the scalar kernels don't match pcg32_random_r and Convolve\n");
+			return false;
+		}
+	}
+
+	bool ret = true;
+	for (int ISA = (int)DispatchISA::SSE42; ISA < (int)DispatchISA::Count; ++ISA)
+	{
+		const NoiseKernels* kernels = KernelsFor((DispatchISA)ISA);
+		if (!kernels)
+			continue;
+
+		Results results = Run(*kernels);
+		const char* mismatch = nullptr;
+		if (results.uniform != reference.uniform || results.rngState != reference.rngState)
+			mismatch = "UniformFloats";
+		else if (results.filtered != reference.filtered)
+			mismatch = "FIR";
+		else if (results.LUT != reference.LUT)
+			mismatch = "RemapLUT";
+		else if (results.polynomial != reference.polynomial)
+			mismatch = "RemapPolynomial";
+		else if (results.histogram != reference.histogram)
+			mismatch = "Histogram";
+
+		if (mismatch)
+		{
+			printf("Dispatch test failed: %s differs between %s and scalar\n", mismatch, DispatchISAName((DispatchISA)ISA));
+			ret = false;
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,123 @@
+// The kernels of dispatch.h, for one instruction set. This has no include guard, because dispatch.h includes it once
+// per instruction set, with these defined:
+//   DISPATCH_KERNEL_NAMESPACE  the namespace the kernels go in
+//   DISPATCH_KERNEL_TARGET     the attribute that compiles them for the instruction set
+//   DISPATCH_KERNEL_WIDTH      how many PCG lanes UniformFloats runs at once
+//
+// The loops are written so that every output is made with the same float operations in the same order, no matter
+// how many outputs the compiler does at once, so every instruction set gives the same bits.
+
+namespace DISPATCH_KERNEL_NAMESPACE
+{
+	DISPATCH_KERNEL_TARGET inline void UniformFloats(pcg32_random_t& rng, float* __restrict out, size_t count)
+	{
+		const int c_width = DISPATCH_KERNEL_WIDTH;
+		uint64_t state = rng.state;
+		const uint64_t inc = rng.inc;
+
+		// Lane k starts k steps ahead, and every lane jumps c_width steps at a time, which is a single LCG step with
+		// this multiplier and increment, so the lanes don't depend on each other
+		if (c_width > 1 && count >= size_t(c_width))
+		{
+			uint64_t strideMult = 1;
+			uint64_t stridePlus = 0;
+			for (int step = 0; step < c_width; ++step)
+			{
+				strideMult = strideMult * SPMDInternal::c_pcg32Multiplier;
+				stridePlus = stridePlus * SPMDInternal::c_pcg32Multiplier + inc;
+			}
+
+			alignas(64) uint64_t lanes[c_width];
+			lanes[0] = state;
+			for (int lane = 1; lane < c_width; ++lane)
+				lanes[lane] = lanes[lane - 1] * SPMDInternal::c_pcg32Multiplier + inc;
+
+			const size_t lanesCount = count / c_width * c_width;
+			for (size_t index = 0; index < lanesCount; index += c_width)
+			{
+				for (int lane = 0; lane < c_width; ++lane)
+				{
+					out[index + lane] = float(SPMDInternal::PCG32Output(lanes[lane])) * SPMDInternal::c_uint32ToFloat01;
+					lanes[lane] = lanes[lane] * strideMult + stridePlus;
+				}
+			}
+
+			// lane 0 has taken all lanesCount steps
+			state = lanes[0];
+			out += lanesCount;
+			count -= lanesCount;
+		}
+
+		for (size_t index = 0; index < count; ++index)
+		{
+			out[index] = float(SPMDInternal::PCG32Output(state)) * SPMDInternal::c_uint32ToFloat01;
+			state = state * SPMDInternal::c_pcg32Multiplier + inc;
+		}
+		rng.state = state;
+	}
+
+	// Convolve adds the terms of an output from the last tap to the first, so this does too, but a tap at a time
+	// across a block of outputs, which vectorizes
+	DISPATCH_KERNEL_TARGET inline void FIR(const float* __restrict in, size_t count, const float* __restrict kernel, size_t taps, float* __restrict out)
+	{
+		for (size_t blockBegin = 0; blockBegin < count; blockBegin += c_dispatchBlockSize)
+		{
+			const size_t blockEnd = std::min(blockBegin + c_dispatchBlockSize, count);
+			for (size_t index = blockBegin; index < blockEnd; ++index)
+				out[index] = 0.0f;
+
+			for (size_t tap = taps; tap-- > 0;)
+			{
+				const float weight = kernel[tap];
+				for (size_t index = std::max(blockBegin, tap); index < blockEnd; ++index)
+					out[index] += in[index - tap] * weight;
+			}
+		}
+	}
+
+	DISPATCH_KERNEL_TARGET inline void RemapLUT(const float* __restrict paddedTable, size_t size, const float* __restrict x, float* __restrict out, size_t count)
+	{
+		for (size_t index = 0; index < count; ++index)
+			out[index] = SamplePaddedTable(paddedTable, size, x[index]);
+	}
+
+	DISPATCH_KERNEL_TARGET inline void RemapPolynomial(const float* __restrict coefficients, int pieces, const float* __restrict x, float* __restrict out, size_t count)
+	{
+		for (size_t index = 0; index < count; ++index)
+		{
+			const float value = x[index];
+			const int first = std::min(int(value * float(pieces)), pieces - 1) * 4;
+			out[index] = coefficients[first + 3] + value * (coefficients[first + 2] + value * (coefficients[first + 1] + value * coefficients[first + 0]));
+		}
+	}
+
+	// The bins are found a block at a time, which vectorizes, and then counted
+	DISPATCH_KERNEL_TARGET inline void Histogram(const float* __restrict x, size_t count, uint64_t* __restrict bins, size_t binCount)
+	{
+		const int lastBin = int(binCount) - 1;
+		alignas(64) uint32_t binIndices[c_dispatchBlockSize];
+		for (size_t blockBegin = 0; blockBegin < count; blockBegin += c_dispatchBlockSize)
+		{
+			const size_t blockCount = std::min(c_dispatchBlockSize, count - blockBegin);
+			for (size_t index = 0; index < blockCount; ++index)
+			{
+				const float value = std::min(std::max(x[blockBegin + index], 0.0f), 1.0f);
+				binIndices[index] = uint32_t(std::min(int(value * float(binCount)), lastBin));
+			}
+			for (size_t index = 0; index < blockCount; ++index)
+				bins[binIndices[index]]++;
+		}
+	}
+
+	inline NoiseKernels MakeKernels(DispatchISA ISA)
+	{
+		NoiseKernels ret;
+		ret.ISA = ISA;
+		ret.UniformFloats = &UniformFloats;
+		ret.FIR = &FIR;
+		ret.RemapLUT = &RemapLUT;
+		ret.RemapPolynomial = &RemapPolynomial;
+		ret.Histogram = &Histogram;
+		return ret;
+	}
+}
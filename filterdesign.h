@@ -0,0 +1,369 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include "mathutils.h"
+
+// Designs the filter kernels for the noise streams from a target power spectrum, instead of by hand with a web
+// calculator (demofox.org/DSPFIR, demofox.org/DSPIIR). The kernels come out in the form FIRTest and IIRTest take.
+//
+// The target is a function that gives the power the filtered white noise should have at frequency f, in cycles per
+// sample, from 0 to 0.5. Only the shape matters, since the streams normalize the filtered noise to [0,1] anyway.
+//
+// * FIR, window method: the inverse FFT of the target amplitude (the square root of the power) is an impulse response
+//   that is zero phase and infinitely long. It's cut down to the taps around the middle with a Hann window.
+// * FIR, least squares: the taps are symmetric, so the amplitude response is a cosine series, a0 + 2 sum ak cos(2 pi k f).
+//   The coefficients are the least squares fit of that series to the target amplitude, over the FFT frequencies.
+// * IIR: the poles come from the autocorrelation of the target (the inverse FFT of the power), with the Yule-Walker
+//   equations, solved by Levinson-Durbin, which always gives a stable filter. Poles alone can make peaks, but not the
+//   zero at DC that blue noise needs, so the zeros are an FIR least squares fit to the power the poles don't make.
+//
+// Every design is checked by taking the FFT of its impulse response and comparing the power spectrum to the target.
+
+// The size of the FFT that the designs and the checks use. The frequencies are multiples of 1 / c_filterDesignFFTSize.
+static const size_t c_filterDesignFFTSize = 1024;
+
+struct DesignedFilter
+{
+	std::string method;
+
+	// The same as FIRTest and IIRTest take. An FIR filter has no yCoefficients.
+	std::vector<float> xCoefficients;
+	std::vector<float> yCoefficients;
+
+	// How far the power spectrum of the filter is from the target, after scaling it to the same average power.
+	// Relative to the average power of the target.
+	double RMSError = 0.0;
+	double maxError = 0.0;
+
+	std::string Description() const
+	{
+		std::stringstream description;
+		description << method << ": RMS Error = " << RMSError << ", Max Error = " << maxError;
+		return description.str();
+	}
+
+	// The coefficients as initializer lists, to paste into FIRTest or IIRTest
+	std::string Code() const
+	{
+		std::stringstream code;
+		code.precision(9);
+
+		auto WriteList = [&](const std::vector<float>& coefficients)
+		{
+			code << "{";
+			for (size_t index = 0; index < coefficients.size(); ++index)
+				code << ((index == 0) ? " " : ", ") << coefficients[index] << "f";
+			code << " }";
+		};
+
+		WriteList(xCoefficients);
+		if (!yCoefficients.empty())
+		{
+			code << ", ";
+			WriteList(yCoefficients);
+		}
+		return code.str();
+	}
+};
+
+namespace FilterDesignInternal
+{
+	static const double c_pi = 3.14159265358979323846;
+
+	// In place radix 2 FFT. The size has to be a power of 2. The inverse is scaled by 1/size.
+	inline void FFT(std::vector<std::complex<double>>& data, bool inverse)
+	{
+		const size_t size = data.size();
+
+		// bit reversed order
+		for (size_t index = 1, reversed = 0; index < size; ++index)
+		{
+			size_t bit = size >> 1;
+			for (; reversed & bit; bit >>= 1)
+				reversed ^= bit;
+			reversed ^= bit;
+			if (index < reversed)
+				std::swap(data[index], data[reversed]);
+		}
+
+		for (size_t length = 2; length <= size; length <<= 1)
+		{
+			double angle = 2.0 * c_pi / double(length) * (inverse ? 1.0 : -1.0);
+			std::complex<double> step(std::cos(angle), std::sin(angle));
+			for (size_t start = 0; start < size; start += length)
+			{
+				std::complex<double> twiddle(1.0, 0.0);
+				for (size_t index = 0; index < length / 2; ++index)
+				{
+					std::complex<double> even = data[start + index];
+					std::complex<double> odd = data[start + index + length / 2] * twiddle;
+					data[start + index] = even + odd;
+					data[start + index + length / 2] = even - odd;
+					twiddle *= step;
+				}
+			}
+		}
+
+		if (inverse)
+		{
+			for (std::complex<double>& value : data)
+				value /= double(size);
+		}
+	}
+
+	// The target power at every FFT frequency, with the negative frequencies mirroring the positive ones
+	template <typename LAMBDA>
+	inline std::vector<double> SampleTarget(const LAMBDA& targetPower, size_t fftSize)
+	{
+		std::vector<double> ret(fftSize);
+		for (size_t index = 0; index < fftSize; ++index)
+		{
+			size_t frequencyIndex = std::min(index, fftSize - index);
+			ret[index] = std::max(double(targetPower(double(frequencyIndex) / double(fftSize))), 0.0);
+		}
+		return ret;
+	}
+
+	// The inverse FFT of a real, even spectrum, which is real and even too
+	inline std::vector<double> InverseFFTReal(const std::vector<double>& spectrum)
+	{
+		std::vector<std::complex<double>> data(spectrum.begin(), spectrum.end());
+		FFT(data, true);
+		std::vector<double> ret(data.size());
+		for (size_t index = 0; index < data.size(); ++index)
+			ret[index] = data[index].real();
+		return ret;
+	}
+
+	// Least squares fit of a symmetric FIR filter's amplitude response to amplitude, which is sampled at every FFT frequency
+	inline std::vector<float> LeastSquaresFIR(const std::vector<double>& amplitude, int halfTaps)
+	{
+		const size_t fftSize = amplitude.size();
+		const int size = halfTaps + 1;
+
+		// basis k at frequency f is 1 for k = 0, and 2 cos(2 pi k f) for the rest
+		auto Basis = [&](int k, size_t frequencyIndex)
+		{
+			return (k == 0) ? 1.0 : 2.0 * std::cos(2.0 * c_pi * double(k) * double(frequencyIndex) / double(fftSize));
+		};
+
+		std::vector<double> A(size * size, 0.0);
+		std::vector<double> b(size, 0.0);
+		for (size_t frequencyIndex = 0; frequencyIndex <= fftSize / 2; ++frequencyIndex)
+		{
+			for (int row = 0; row < size; ++row)
+			{
+				double basisRow = Basis(row, frequencyIndex);
+				b[row] += basisRow * amplitude[frequencyIndex];
+				for (int column = 0; column < size; ++column)
+					A[row * size + column] += basisRow * Basis(column, frequencyIndex);
+			}
+		}
+
+		std::vector<float> taps(2 * halfTaps + 1, 0.0f);
+		if (!SolveLinearSystem(A, b, size))
+			return taps;
+
+		for (int k = 0; k <= halfTaps; ++k)
+		{
+			taps[halfTaps - k] = float(b[k]);
+			taps[halfTaps + k] = float(b[k]);
+		}
+		return taps;
+	}
+
+	// The Yule-Walker equations for the all pole filter with the autocorrelation r, solved with Levinson-Durbin.
+	// Returns the feedback coefficients in IIRTest's form, out[n] = x[n] + sum a[k] out[n-1-k], and the power of x
+	// that gives the target power.
+	inline std::vector<float> LevinsonDurbin(const std::vector<double>& r, int order, double& noisePower)
+	{
+		std::vector<double> a(order + 1, 0.0);
+		std::vector<double> previous(order + 1, 0.0);
+		a[0] = 1.0;
+		noisePower = r[0];
+		for (int i = 1; i <= order && noisePower > 0.0; ++i)
+		{
+			double reflection = r[i];
+			for (int j = 1; j < i; ++j)
+				reflection += a[j] * r[i - j];
+			reflection = -reflection / noisePower;
+
+			previous = a;
+			for (int j = 1; j < i; ++j)
+				a[j] = previous[j] + reflection * previous[i - j];
+			a[i] = reflection;
+			noisePower *= 1.0 - reflection * reflection;
+		}
+
+		// a is the polynomial 1 + a1 z^-1 + ..., so the feedback is the negative
+		std::vector<float> ret(order);
+		for (int i = 0; i < order; ++i)
+			ret[i] = float(-a[i + 1]);
+		return ret;
+	}
+}
+
+// The first count values of the filter's response to an impulse, filtered the same way as IIRTest
+inline std::vector<double> ImpulseResponse(const std::vector<float>& xCoefficients, const std::vector<float>& yCoefficients, size_t count)
+{
+	std::vector<double> ret(count, 0.0);
+	for (size_t index = 0; index < count; ++index)
+	{
+		double h = (index < xCoefficients.size()) ? xCoefficients[index] : 0.0;
+		for (size_t yIndex = 0; yIndex < yCoefficients.size() && yIndex < index; ++yIndex)
+			h += yCoefficients[yIndex] * ret[index - yIndex - 1];
+		ret[index] = h;
+	}
+	return ret;
+}
+
+// The power spectrum of the filter at frequencies 0 to 0.5, from the FFT of its impulse response.
+// An IIR filter's impulse response is cut off at fftSize values, so it needs to have decayed by then.
+inline std::vector<double> FilterPowerSpectrum(const std::vector<float>& xCoefficients, const std::vector<float>& yCoefficients, size_t fftSize = c_filterDesignFFTSize)
+{
+	std::vector<double> impulseResponse = ImpulseResponse(xCoefficients, yCoefficients, fftSize);
+	std::vector<std::complex<double>> data(impulseResponse.begin(), impulseResponse.end());
+	FilterDesignInternal::FFT(data, false);
+
+	std::vector<double> ret(fftSize / 2 + 1);
+	for (size_t index = 0; index < ret.size(); ++index)
+		ret[index] = std::norm(data[index]);
+	return ret;
+}
+
+// Fills in the errors of the design against the target
+template <typename LAMBDA>
+inline void VerifyFilterDesign(DesignedFilter& filter, const LAMBDA& targetPower, size_t fftSize = c_filterDesignFFTSize)
+{
+	std::vector<double> power = FilterPowerSpectrum(filter.xCoefficients, filter.yCoefficients, fftSize);
+	std::vector<double> target = FilterDesignInternal::SampleTarget(targetPower, fftSize);
+	target.resize(power.size());
+
+	double powerMean = 0.0;
+	double targetMean = 0.0;
+	for (size_t index = 0; index < power.size(); ++index)
+	{
+		powerMean += power[index];
+		targetMean += target[index];
+	}
+	double scale = (powerMean > 0.0) ? targetMean / powerMean : 0.0;
+	targetMean /= double(power.size());
+
+	filter.RMSError = 0.0;
+	filter.maxError = 0.0;
+	for (size_t index = 0; index < power.size(); ++index)
+	{
+		double error = std::abs(power[index] * scale - target[index]) / targetMean;
+		filter.RMSError += error * error;
+		filter.maxError = std::max(filter.maxError, error);
+	}
+	filter.RMSError = std::sqrt(filter.RMSError / double(power.size()));
+}
+
+// An FIR filter with taps taps, by the window method. Taps is rounded up to an odd number, so the filter is symmetric.
+template <typename LAMBDA>
+inline DesignedFilter DesignFIRWindow(const LAMBDA& targetPower, int taps, size_t fftSize = c_filterDesignFFTSize)
+{
+	using namespace FilterDesignInternal;
+
+	std::vector<double> amplitude = SampleTarget(targetPower, fftSize);
+	for (double& value : amplitude)
+		value = std::sqrt(value);
+	std::vector<double> impulseResponse = InverseFFTReal(amplitude);
+
+	const int halfTaps = taps / 2;
+	DesignedFilter ret;
+	ret.method = "FIR Window " + std::to_string(2 * halfTaps + 1);
+	ret.xCoefficients.resize(2 * halfTaps + 1);
+	for (int k = -halfTaps; k <= halfTaps; ++k)
+	{
+		double window = 0.5 + 0.5 * std::cos(c_pi * double(k) / double(halfTaps + 1));
+		ret.xCoefficients[halfTaps + k] = float(impulseResponse[(k + fftSize) % fftSize] * window);
+	}
+
+	VerifyFilterDesign(ret, targetPower, fftSize);
+	return ret;
+}
+
+// An FIR filter with taps taps, by least squares. Taps is rounded up to an odd number, so the filter is symmetric.
+template <typename LAMBDA>
+inline DesignedFilter DesignFIRLeastSquares(const LAMBDA& targetPower, int taps, size_t fftSize = c_filterDesignFFTSize)
+{
+	using namespace FilterDesignInternal;
+
+	std::vector<double> amplitude = SampleTarget(targetPower, fftSize);
+	for (double& value : amplitude)
+		value = std::sqrt(value);
+
+	DesignedFilter ret;
+	ret.method = "FIR Least Squares " + std::to_string(2 * (taps / 2) + 1);
+	ret.xCoefficients = LeastSquaresFIR(amplitude, taps / 2);
+
+	VerifyFilterDesign(ret, targetPower, fftSize);
+	return ret;
+}
+
+// An IIR filter with poles feedback coefficients, and an FIR part with zeroTaps taps (rounded up to odd) for the zeros.
+// The poles and zeros are fit one after the other, both ways around, and the one closer to the target is returned:
+// * Poles first: they fit the target, then the zeros fit what is left, the target divided by what the poles make.
+// * Zeros first: they fit the target, then the poles fit what is left. This is better when the target has a zero,
+//   like blue noise at DC, which poles can't make.
+template <typename LAMBDA>
+inline DesignedFilter DesignIIR(const LAMBDA& targetPower, int zeroTaps, int poles, size_t fftSize = c_filterDesignFFTSize)
+{
+	using namespace FilterDesignInternal;
+
+	const std::vector<double> target = SampleTarget(targetPower, fftSize);
+	const std::string method = "IIR " + std::to_string(2 * (zeroTaps / 2) + 1) + " zero taps " + std::to_string(poles) + " poles";
+
+	// The power spectrum of the poles is noisePower / |A|^2, where |A|^2 is the power spectrum of the FIR filter 1, -y1, -y2, ...
+	auto PolesPower = [&](const std::vector<float>& yCoefficients)
+	{
+		std::vector<float> A(yCoefficients.size() + 1, 1.0f);
+		for (size_t i = 0; i < yCoefficients.size(); ++i)
+			A[i + 1] = -yCoefficients[i];
+		return FilterPowerSpectrum(A, {}, fftSize);
+	};
+
+	DesignedFilter polesFirst;
+	{
+		double noisePower = 0.0;
+		polesFirst.method = method + ", poles first";
+		polesFirst.yCoefficients = LevinsonDurbin(InverseFFTReal(target), poles, noisePower);
+
+		std::vector<double> APower = PolesPower(polesFirst.yCoefficients);
+		std::vector<double> amplitude(fftSize);
+		for (size_t index = 0; index < fftSize; ++index)
+			amplitude[index] = std::sqrt(target[index] * APower[std::min(index, fftSize - index)] / std::max(noisePower, 1e-300));
+
+		polesFirst.xCoefficients = LeastSquaresFIR(amplitude, zeroTaps / 2);
+		VerifyFilterDesign(polesFirst, targetPower, fftSize);
+	}
+
+	DesignedFilter zerosFirst;
+	{
+		std::vector<double> amplitude(fftSize);
+		for (size_t index = 0; index < fftSize; ++index)
+			amplitude[index] = std::sqrt(target[index]);
+		zerosFirst.method = method + ", zeros first";
+		zerosFirst.xCoefficients = LeastSquaresFIR(amplitude, zeroTaps / 2);
+
+		// where the zeros are (close to) 0, what is left isn't defined, so is limited
+		std::vector<double> BPower = FilterPowerSpectrum(zerosFirst.xCoefficients, {}, fftSize);
+		double BPowerFloor = *std::max_element(BPower.begin(), BPower.end()) * 1e-6;
+		std::vector<double> remaining(fftSize);
+		for (size_t index = 0; index < fftSize; ++index)
+			remaining[index] = target[index] / std::max(BPower[std::min(index, fftSize - index)], BPowerFloor);
+
+		double noisePower = 0.0;
+		zerosFirst.yCoefficients = LevinsonDurbin(InverseFFTReal(remaining), poles, noisePower);
+		VerifyFilterDesign(zerosFirst, targetPower, fftSize);
+	}
+
+	return (zerosFirst.RMSError < polesFirst.RMSError) ? zerosFirst : polesFirst;
+}
@@ -1,27 +1,69 @@
 #pragma once
 
 #include <array>
+#include <vector>
+#include <algorithm>
+#include <cmath>
 
+// Pieces are evenly spaced in [0,1] unless SetKnots() is called.
+// Points can be weighted, to make the fit care more about some points than others, such as the tails of a CDF.
 template <size_t ORDER, size_t PIECES>
 class LeastSquaresPolynomialFit
 {
 public:
+	typedef std::array<float, PIECES + 1> Knots;
 
-	void AddPoint(float x, float y)
+	LeastSquaresPolynomialFit()
 	{
-		int bucket = std::min(int(x * float(PIECES)), (int)PIECES - 1);
+		for (size_t i = 0; i <= PIECES; ++i)
+			m_knots[i] = float(i) / float(PIECES);
+	}
+
+	// Piece i covers [knots[i], knots[i+1]), with knots[0] = 0 and knots[PIECES] = 1.
+	// Has to be called before any points are added.
+	void SetKnots(const Knots& knots)
+	{
+		m_knots = knots;
+		m_uniformKnots = false;
+	}
+
+	const Knots& GetKnots() const
+	{
+		return m_knots;
+	}
+
+	bool UniformKnots() const
+	{
+		return m_uniformKnots;
+	}
+
+	// Which piece x is in. For uneven knots, this is a sum of compares, so it doesn't branch.
+	int Bucket(float x) const
+	{
+		if (m_uniformKnots)
+			return std::min(int(x * float(PIECES)), (int)PIECES - 1);
+
+		int bucket = 0;
+		for (size_t i = 1; i < PIECES; ++i)
+			bucket += (x >= m_knots[i]) ? 1 : 0;
+		return bucket;
+	}
+
+	void AddPoint(float x, float y, float weight = 1.0f)
+	{
+		int bucket = Bucket(x);
 
 		double xpow = 1.0;
 		for (int i = 0; i < m_ATA[bucket].size(); ++i)
 		{
-			m_ATA[bucket][i] += xpow;
+			m_ATA[bucket][i] += xpow * weight;
 			xpow *= x;
 		}
 
 		xpow = 1.0;
 		for (int i = 0; i < m_ATY[bucket].size(); ++i)
 		{
-			m_ATY[bucket][i] += xpow * y;
+			m_ATY[bucket][i] += xpow * y * weight;
 			xpow *= x;
 		}
 	}
@@ -88,7 +130,7 @@ public:
 
 			int row = ATAMatrixHeightNoConstraints + constraint + 2;
 
-			float x = float(pieceIndex2) / float(PIECES);
+			float x = m_knots[pieceIndex2];
 
 			double xpow = 1.0;
 			for (int index = 0; index < ATAPieceWidth; ++index)
@@ -115,7 +157,7 @@ public:
 
 				int row = ATAMatrixHeightNoConstraints + constraint + 2 + PIECES - 1;
 
-				float x = float(pieceIndex2) / float(PIECES);
+				float x = m_knots[pieceIndex2];
 
 				double xpow = 1.0;
 				for (int index = 0; index < ATAPieceWidth; ++index)
@@ -179,9 +221,9 @@ public:
 			m_coefficients[coefficientIndex / ATAPieceWidth][coefficientIndex % ATAPieceWidth] = ATA[coefficientIndex][ATAMtrixAugmentedWidth - 1];
 	}
 
-	float Evaluate(float x)
+	float Evaluate(float x) const
 	{
-		int bucket = std::min(int(x * float(PIECES)), (int)PIECES - 1);
+		int bucket = Bucket(x);
 
 		double ret = 0.0;
 
@@ -201,4 +243,221 @@ public:
 private:
 	std::array<std::array<double, (ORDER + 1) * 2 - 1>, PIECES> m_ATA = {};
 	std::array<std::array<double, ORDER + 1>, PIECES> m_ATY = {};
+	Knots m_knots;
+	bool m_uniformKnots = true;
+};
+
+// A piecewise polynomial with the order and piece count decided at runtime, such as the best fit found
+// by FindBestPolynomialFit, or one loaded from the CDF cache.
+// Pieces are evenly spaced in [0,1] unless knots is set, and coefficients are stored in the same order as
+// LeastSquaresPolynomialFit::m_coefficients, so coefficients[piece * (order + 1) + i] is the coefficient for x^i of that piece.
+// The CDF cache doesn't store knots, so only evenly spaced fits go in it.
+struct PiecewisePolynomial
+{
+	int order = 0;
+	int pieces = 0;
+	float RMSE = 0.0f;
+	std::vector<double> coefficients;
+
+	// Empty for evenly spaced pieces, else pieces + 1 values, like LeastSquaresPolynomialFit::SetKnots()
+	std::vector<float> knots;
+
+	template <size_t ORDER, size_t PIECES>
+	void Set(const LeastSquaresPolynomialFit<ORDER, PIECES>& fit, float rmse)
+	{
+		order = (int)ORDER;
+		pieces = (int)PIECES;
+		RMSE = rmse;
+		coefficients.resize((ORDER + 1) * PIECES);
+		for (size_t pieceIndex = 0; pieceIndex < PIECES; ++pieceIndex)
+			for (size_t index = 0; index < ORDER + 1; ++index)
+				coefficients[pieceIndex * (ORDER + 1) + index] = fit.m_coefficients[pieceIndex][index];
+
+		knots.clear();
+		if (!fit.UniformKnots())
+			knots.assign(fit.GetKnots().begin(), fit.GetKnots().end());
+	}
+
+	// Where the piece starts. PieceStart(pieces) is 1.
+	float PieceStart(int piece) const
+	{
+		return knots.empty() ? float(piece) / float(pieces) : knots[piece];
+	}
+
+	int Bucket(float x) const
+	{
+		if (knots.empty())
+			return std::min(int(x * float(pieces)), pieces - 1);
+
+		int bucket = 0;
+		for (int i = 1; i < pieces; ++i)
+			bucket += (x >= knots[i]) ? 1 : 0;
+		return bucket;
+	}
+
+	float Evaluate(float x) const
+	{
+		int bucket = Bucket(x);
+
+		double ret = 0.0;
+
+		double xpow = 1.0;
+		for (int index = 0; index < order + 1; ++index)
+		{
+			ret += xpow * coefficients[bucket * (order + 1) + index];
+			xpow *= x;
+		}
+
+		return (float)ret;
+	}
+};
+
+// How to weight the points of a CDF table when fitting it.
+// The tails are where fit errors show up as spikes in the histogram, since the CDF is nearly flat there, so a small
+// error in y is a large error in where the values end up.
+enum class CDFFitWeighting
+{
+	Uniform,         // every point the same, which minimizes the RMSE
+	InverseDensity,  // 1 / the slope of the CDF, so low density regions like the tails count more
+	RelativeError,   // 1 / the distance to the nearest of 0 or 1 squared, which minimizes the error relative to the tail probability
 };
+
+inline const char* CDFFitWeightingName(CDFFitWeighting weighting)
+{
+	switch (weighting)
+	{
+		case CDFFitWeighting::InverseDensity: return "Inverse Density";
+		case CDFFitWeighting::RelativeError: return "Relative Error";
+		default: return "Uniform";
+	}
+}
+
+namespace LeastSquaresFitInternal
+{
+	// Keeps the weights finite where the CDF is flat or at 0 and 1
+	static const float c_minDensity = 0.01f;
+	static const float c_minTailDistance = 0.001f;
+
+	// How many times to move the knots and refit in FitCDFEqualizedKnots
+	static const int c_knotIterations = 8;
+}
+
+// A weight per point of the CDF table. Any other weights can be made by the caller and used the same way.
+inline std::vector<float> CDFFitWeights(const std::vector<float>& CDF, CDFFitWeighting weighting)
+{
+	using namespace LeastSquaresFitInternal;
+
+	std::vector<float> weights(CDF.size(), 1.0f);
+	const float dx = 1.0f / float(CDF.size() - 1);
+	for (size_t i = 0; i < CDF.size(); ++i)
+	{
+		switch (weighting)
+		{
+			case CDFFitWeighting::InverseDensity:
+			{
+				size_t i0 = (i > 0) ? i - 1 : i;
+				size_t i1 = std::min(i + 1, CDF.size() - 1);
+				float density = (CDF[i1] - CDF[i0]) / (float(i1 - i0) * dx);
+				weights[i] = 1.0f / std::max(density, c_minDensity);
+				break;
+			}
+			case CDFFitWeighting::RelativeError:
+			{
+				float tailDistance = std::max(std::min(CDF[i], 1.0f - CDF[i]), c_minTailDistance);
+				weights[i] = 1.0f / (tailDistance * tailDistance);
+				break;
+			}
+			default: break;
+		}
+	}
+	return weights;
+}
+
+// Fits the CDF table with the weights, one per point, using the fit's knots
+template <size_t ORDER, size_t PIECES>
+void FitCDF(LeastSquaresPolynomialFit<ORDER, PIECES>& fit, const std::vector<float>& CDF, const std::vector<float>& weights)
+{
+	for (size_t i = 0; i < CDF.size(); ++i)
+	{
+		float x = float(i) / float(CDF.size() - 1.0f);
+		fit.AddPoint(x, CDF[i], weights[i]);
+	}
+	fit.CalculateCoefficients();
+}
+
+// Fits the CDF table with the weights, moving the knots so that each piece has about the same weighted max error.
+// That puts smaller pieces where the CDF is hard to fit, such as the tails. The error of a piece of order N goes as
+// its width to the N+1 power, so each iteration places the knots to split the sum of error^(1/(N+1)) evenly
+// (de Boor's equidistribution), refits, and keeps the fit with the lowest weighted max error.
+template <size_t ORDER, size_t PIECES>
+LeastSquaresPolynomialFit<ORDER, PIECES> FitCDFEqualizedKnots(const std::vector<float>& CDF, const std::vector<float>& weights)
+{
+	typedef LeastSquaresPolynomialFit<ORDER, PIECES> Fit;
+
+	// the weighted max error, and the weighted max error of each piece
+	auto Errors = [&](const Fit& fit, std::array<double, PIECES>& pieceErrors)
+	{
+		pieceErrors.fill(0.0);
+		for (size_t i = 0; i < CDF.size(); ++i)
+		{
+			float x = float(i) / float(CDF.size() - 1.0f);
+			double error = std::abs(double(CDF[i]) - double(fit.Evaluate(x))) * std::sqrt(double(weights[i]));
+			int bucket = fit.Bucket(x);
+			pieceErrors[bucket] = std::max(pieceErrors[bucket], error);
+		}
+		return *std::max_element(pieceErrors.begin(), pieceErrors.end());
+	};
+
+	Fit best;
+	FitCDF(best, CDF, weights);
+	std::array<double, PIECES> pieceErrors;
+	double bestError = Errors(best, pieceErrors);
+	if (PIECES == 1)
+		return best;
+
+	// each piece needs enough points to fit
+	const float minWidth = float(2 * (ORDER + 2)) / float(CDF.size() - 1);
+
+	typename Fit::Knots knots = best.GetKnots();
+	for (int iteration = 0; iteration < LeastSquaresFitInternal::c_knotIterations; ++iteration)
+	{
+		std::array<double, PIECES> amounts;
+		double total = 0.0;
+		for (size_t piece = 0; piece < PIECES; ++piece)
+		{
+			amounts[piece] = std::pow(std::max(pieceErrors[piece], 1e-12), 1.0 / double(ORDER + 1));
+			total += amounts[piece];
+		}
+
+		// walk the pieces, putting a knot each time the running sum crosses the next even split
+		typename Fit::Knots newKnots = knots;
+		double sum = 0.0;
+		size_t piece = 0;
+		for (size_t knot = 1; knot < PIECES; ++knot)
+		{
+			double target = total * double(knot) / double(PIECES);
+			while (piece < PIECES - 1 && sum + amounts[piece] < target)
+				sum += amounts[piece++];
+			double fraction = (target - sum) / amounts[piece];
+			newKnots[knot] = float(double(knots[piece]) + fraction * double(knots[piece + 1] - knots[piece]));
+		}
+
+		for (size_t knot = 1; knot < PIECES; ++knot)
+			newKnots[knot] = std::max(newKnots[knot], newKnots[knot - 1] + minWidth);
+		for (size_t knot = PIECES - 1; knot > 0; --knot)
+			newKnots[knot] = std::min(newKnots[knot], newKnots[knot + 1] - minWidth);
+		knots = newKnots;
+
+		Fit fit;
+		fit.SetKnots(knots);
+		FitCDF(fit, CDF, weights);
+		double error = Errors(fit, pieceErrors);
+		if (error < bestError)
+		{
+			bestError = error;
+			best = fit;
+		}
+	}
+
+	return best;
+}
@@ -1,5 +1,8 @@
 #include <random>
 #include <vector>
+#include <algorithm>
+#include <cfloat>
+#include "platform.h"
 #include "pcg/pcg_basic.h"
 #include <string>
 #include "csv.h"
@@ -7,9 +10,60 @@
 #include "leastsquaresfit.h"
 #include <sstream>
 #include "BlueNoiseStream.h"
+#include "cdfcache.h"
+#include "cdftable.h"
+#include "monotonecubicfit.h"
+#include "minimaxfit.h"
+#include "targetdistribution.h"
+#include "voidandcluster.h"
+#include "autotune.h"
+#include "outofcore.h"
+#include "asyncwriter.h"
+#include "columnstore.h"
+#include "filterdesign.h"
+#include "dispatch.h"
+#include <chrono>
 
 #define DETERMINISTIC() false
 
+// If true, FIR and IIR noise is normalized to [0,1] using the range the filter kernel can output, instead of the
+// min and max of the generated values. This makes the CDF tables independent of the seed, so they are reusable.
+#define ANALYTIC_BOUNDS() true
+
+// If true, the CDF tables and polynomial fits for FIR and IIR noise are cached in the cdfcache folder, keyed by the filter.
+// Only used when ANALYTIC_BOUNDS() is true. Delete the folder to refit everything.
+#define USE_CDF_CACHE() true
+
+// If true, VoidAndClusterTest makes a single void and cluster sequence as long as c_numberCount, instead of reading
+// the sequences in the bluenoise folder and repeating them.
+#define GENERATE_VOID_AND_CLUSTER() false
+
+// If true, the sequences in the bluenoise folder are made again before the tests run.
+#define REMAKE_VOID_AND_CLUSTER_FILES() false
+
+// If true, SequenceTest compares the ToUniform1024 and ToUniform64 remaps against the table lookup they used to do,
+// which had branches, and a bug where the 1024 table's check for the last entry used the size of the 64 table.
+// Expected differences are only from the 1024 bug: x in [63/1023, 64/1023), which used to become 1, and x = 1, which
+// used to become the last table entry instead of 1.
+#define CHECK_TABLE_REMAP() false
+
+// If true, the program only runs the autotuner, which times the CDF approximations for the blue noise stream on this
+// CPU, and writes the fastest one within c_autotuneErrorBudget to tuning.txt, for BlueNoiseStreamTuned to load.
+#define AUTOTUNE() false
+
+// If true, the program only runs the out of core characterization, which runs the filters for
+// c_outOfCoreSampleCount samples in chunks on all cores, to find rare events in the tails. See outofcore.h.
+// Progress is saved in the outofcore folder, so a run that is stopped continues where it left off.
+#define OUT_OF_CORE() false
+
+// If true, the program only designs filters for the noise colors in c_noiseColorTargets (see filterdesign.h), and
+// runs the designs through FIRTest and IIRTest, and the FIR design as a stream, to make the CDF tables and fits for them.
+#define DESIGN_FILTERS() false
+
+// If true, out.csv is also written as out.col, a compressed column store (see columnstore.h) that is kept to the
+// precision out.csv has, for archiving.
+#define WRITE_COLUMN_STORE() true
+
 // The size of the list of random numbers output
 static const size_t c_numberCount = 10000000;
 
@@ -20,13 +74,87 @@ static const size_t c_outputSequenceCount = 25;
 static const size_t c_CDFTableSizeFull = 1024;
 static const size_t c_CDFTableSizeSmall = 64;
 
+// The range of sizes in the CDF table pyramid, which has the two sizes above in it
+static const size_t c_CDFPyramidMinSize = 16;
+static const size_t c_CDFPyramidMaxSize = 4096;
+
+// The void and cluster sequences in the bluenoise folder
+static const int c_voidAndClusterFileCount = 100;
+static const size_t c_voidAndClusterFileLength = 100000;
+
+// The same sequences, one per column, in a column store, with the hash of each. It's remade from the files above
+// whenever the hashes don't match them, and is only read in place of the files when they aren't there.
+static const char* c_voidAndClusterColumnFile = "bluenoise/bn100k.col";
+
+// out.csv writes values with "%f", so they are off by up to half of the 6th decimal. out.col is kept to the same.
+static const float c_columnStoreMaxError = 0.0000005f;
+
+// How many entries the tabulated exponential ICDF of FusedDistributionTests has
+static const size_t c_tabulatedICDFSize = 4096;
+
+// The piece counts of the monotone cubic Hermite fits to compare against the polynomial fit
+static const int c_hermitePieces[] = { 4, 8, 16 };
+
+// The noise colors DESIGN_FILTERS() designs filters for, by the power spectrum they should have at frequency f, in
+// cycles per sample from 0 to 0.5
+struct NoiseColorTarget
+{
+	const char* label;
+	double (*power)(double f);
+};
+static const NoiseColorTarget c_noiseColorTargets[] =
+{
+	{ "Blue", [](double f) { return f; } },       // +3dB per octave
+	{ "Violet", [](double f) { return f * f; } }, // +6dB per octave
+};
+
+// The sizes of the filters DESIGN_FILTERS() makes. The FIR taps are a template parameter of BlueNoiseStreamFIR.
+static const size_t c_designedFIRTaps = 9;
+static_assert(c_designedFIRTaps % 2 == 1, "The filter design rounds the taps up to odd, so an even count would make more taps than BlueNoiseStreamFIR<c_designedFIRTaps> runs");
+static const int c_designedIIRZeroTaps = 3;
+static const int c_designedIIRPoles = 2;
+
+// The out of core characterization. The seed is fixed, so that a stopped run can be resumed.
+// IIR filters are warmed up for c_outOfCoreIIRWarmup samples, FIR filters for their length.
+static const uint64_t c_outOfCoreSampleCount = 10000000000ull;
+static const uint64_t c_outOfCoreChunkSize = 1 << 26;
+static const uint64_t c_outOfCoreSeed = 0xa000b800;
+static const uint32_t c_outOfCoreIIRWarmup = 4096;
+
+// The minimax fit candidates: polynomial orders and piece counts, and rational function orders and piece counts
+static const int c_minimaxPolynomialOrders[] = { 1, 2, 3, 4, 5 };
+static const int c_minimaxPolynomialPieces[] = { 1, 2, 4 };
+static const int c_minimaxRationalOrders[][2] = { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 }, { 3, 1 }, { 3, 2 }, { 3, 3 } };
+static const int c_minimaxRationalPieces[] = { 1, 2 };
+
+// The weighted fits are compared to the best fit by their max error in the tails, which are x within this of 0 or 1
+static const float c_tailWidth = 0.05f;
+
+// The autotuner candidates, and how far from the 1024 entry CDF table an approximation is allowed to be
+static const int c_autotuneLUTSizes[] = { 16, 32, 64, 128, 256, 1024 };
+static const float c_autotuneErrorBudget = 0.005f;
+static const size_t c_autotuneSampleCount = 1000000;
+
 float PCGRandomFloat01(pcg32_random_t& rng)
 {
 	return ldexpf((float)pcg32_random_r(&rng), -32);
 }
 
+CDFCacheKey MakeCDFCacheKey(const std::vector<float>& xCoefficients, const std::vector<float>& yCoefficients)
+{
+	CDFCacheKey key;
+	key.xCoefficients = xCoefficients;
+	key.yCoefficients = yCoefficients;
+	key.sampleCount = c_numberCount;
+	key.tableSizeFull = (uint32_t)c_CDFTableSizeFull;
+	key.tableSizeSmall = (uint32_t)c_CDFTableSizeSmall;
+	key.pyramidMinSize = (uint32_t)c_CDFPyramidMinSize;
+	key.pyramidMaxSize = (uint32_t)c_CDFPyramidMaxSize;
+	return key;
+}
+
 template <size_t ORDER, size_t PIECES>
-void FindBestPolynomialFit_Order_Pieces(const std::vector<float>& CDF, float& lowestRMSE, std::string& bestFormula, CSV& csv, CSV& CDFcsv, int csvcolumnIndex, int cdfcsvcolumnIndex, const char* label)
+void FindBestPolynomialFit_Order_Pieces(const std::vector<float>& CDF, PiecewisePolynomial& best)
 {
 	// fit a piecewise polynomial to the CDF
 	LeastSquaresPolynomialFit<ORDER, PIECES> fit;
@@ -50,20 +178,119 @@ void FindBestPolynomialFit_Order_Pieces(const std::vector<float>& CDF, float& lo
 	RMSE = std::sqrt(RMSE);
 
 	// if the RMSE is higher, don't take this fit
-	if (RMSE >= lowestRMSE)
+	if (RMSE >= best.RMSE)
 		return;
 
-	// write the function so the best one can be printed out later
+	best.Set(fit, RMSE);
+}
+
+template <size_t ORDER>
+void FindBestPolynomialFit_Order(const std::vector<float>& CDF, PiecewisePolynomial& best)
+{
+	FindBestPolynomialFit_Order_Pieces<ORDER, 1>(CDF, best);
+	FindBestPolynomialFit_Order_Pieces<ORDER, 2>(CDF, best);
+	FindBestPolynomialFit_Order_Pieces<ORDER, 3>(CDF, best);
+	FindBestPolynomialFit_Order_Pieces<ORDER, 4>(CDF, best);
+	//FindBestPolynomialFit_Order_Pieces<ORDER, 5>(CDF, best);
+}
+
+// Every fit in the FindBestPolynomialFit search, not just the one with the lowest RMSE, for the autotuner
+template <size_t ORDER>
+void AllPolynomialFits_Order(const std::vector<float>& CDF, std::vector<PiecewisePolynomial>& fits)
+{
+	PiecewisePolynomial fit;
+	fit.RMSE = FLT_MAX;
+	FindBestPolynomialFit_Order_Pieces<ORDER, 1>(CDF, fit);
+	fits.push_back(fit);
+
+	fit.RMSE = FLT_MAX;
+	FindBestPolynomialFit_Order_Pieces<ORDER, 2>(CDF, fit);
+	fits.push_back(fit);
+
+	fit.RMSE = FLT_MAX;
+	FindBestPolynomialFit_Order_Pieces<ORDER, 3>(CDF, fit);
+	fits.push_back(fit);
+
+	fit.RMSE = FLT_MAX;
+	FindBestPolynomialFit_Order_Pieces<ORDER, 4>(CDF, fit);
+	fits.push_back(fit);
+}
+
+std::vector<PiecewisePolynomial> AllPolynomialFits(const std::vector<float>& CDF)
+{
+	std::vector<PiecewisePolynomial> fits;
+	AllPolynomialFits_Order<1>(CDF, fits);
+	AllPolynomialFits_Order<2>(CDF, fits);
+	AllPolynomialFits_Order<3>(CDF, fits);
+	return fits;
+}
+
+// A weighted fit of the CDF, with evenly spaced or equalized knots. See FitCDFEqualizedKnots.
+template <size_t ORDER, size_t PIECES>
+void WeightedPolynomialFits_Order_Pieces(const std::vector<float>& CDF, const std::vector<float>& weights, bool equalizeKnots, std::vector<PiecewisePolynomial>& fits)
+{
+	LeastSquaresPolynomialFit<ORDER, PIECES> fit;
+	if (equalizeKnots)
+		fit = FitCDFEqualizedKnots<ORDER, PIECES>(CDF, weights);
+	else
+		FitCDF(fit, CDF, weights);
+
+	float RMSE = 0.0f;
+	for (size_t i = 0; i < CDF.size(); ++i)
+	{
+		float percent = float(i) / float(CDF.size() - 1);
+		float error = CDF[i] - fit.Evaluate(percent);
+		RMSE = Lerp(RMSE, error * error, 1.0f / float(i + 1));
+	}
+
+	fits.emplace_back();
+	fits.back().Set(fit, std::sqrt(RMSE));
+}
+
+template <size_t ORDER>
+void WeightedPolynomialFits_Order(const std::vector<float>& CDF, const std::vector<float>& weights, bool equalizeKnots, std::vector<PiecewisePolynomial>& fits)
+{
+	WeightedPolynomialFits_Order_Pieces<ORDER, 1>(CDF, weights, equalizeKnots, fits);
+	WeightedPolynomialFits_Order_Pieces<ORDER, 2>(CDF, weights, equalizeKnots, fits);
+	WeightedPolynomialFits_Order_Pieces<ORDER, 3>(CDF, weights, equalizeKnots, fits);
+	WeightedPolynomialFits_Order_Pieces<ORDER, 4>(CDF, weights, equalizeKnots, fits);
+}
+
+// The same orders and piece counts as FindBestPolynomialFit, lowest order first, then fewest pieces
+std::vector<PiecewisePolynomial> WeightedPolynomialFits(const std::vector<float>& CDF, const std::vector<float>& weights, bool equalizeKnots)
+{
+	std::vector<PiecewisePolynomial> fits;
+	WeightedPolynomialFits_Order<1>(CDF, weights, equalizeKnots, fits);
+	WeightedPolynomialFits_Order<2>(CDF, weights, equalizeKnots, fits);
+	WeightedPolynomialFits_Order<3>(CDF, weights, equalizeKnots, fits);
+	return fits;
+}
+
+PiecewisePolynomial FindBestPolynomialFit(const std::vector<float>& CDF)
+{
+	PiecewisePolynomial best;
+	best.RMSE = FLT_MAX;
+	FindBestPolynomialFit_Order<1>(CDF, best);
+	FindBestPolynomialFit_Order<2>(CDF, best);
+	FindBestPolynomialFit_Order<3>(CDF, best);
+	//FindBestPolynomialFit_Order<4>(CDF, best);
+	//FindBestPolynomialFit_Order<5>(CDF, best);
+	return best;
+}
+
+std::string PolynomialFormula(const PiecewisePolynomial& polynomial)
+{
+	// write the function so it can be printed out
 	std::stringstream formula;
-	formula << " Order " << ORDER << " with " << PIECES << " pieces. RMSE = " << RMSE << "\n";
-	for (size_t pieceIndex = 0; pieceIndex < PIECES; ++pieceIndex)
+	formula << " Order " << polynomial.order << " with " << polynomial.pieces << " pieces. RMSE = " << polynomial.RMSE << "\n";
+	for (int pieceIndex = 0; pieceIndex < polynomial.pieces; ++pieceIndex)
 	{
-		if (PIECES > 1)
+		if (polynomial.pieces > 1)
 		{
-			float xmin = float(pieceIndex) / float(PIECES);
-			float xmax = float(pieceIndex + 1) / float(PIECES);
+			float xmin = polynomial.PieceStart(pieceIndex);
+			float xmax = polynomial.PieceStart(pieceIndex + 1);
 
-			if (pieceIndex + 1 < PIECES)
+			if (pieceIndex + 1 < polynomial.pieces)
 				formula << " x in [" << xmin << ", " << xmax << ")\n";
 			else
 				formula << " x in [" << xmin << ", " << xmax << "]\n";
@@ -71,29 +298,33 @@ void FindBestPolynomialFit_Order_Pieces(const std::vector<float>& CDF, float& lo
 
 		formula << "  y = ";
 		bool first = true;
-		for (size_t i = 0; i < fit.m_coefficients[pieceIndex].size(); ++i)
+		for (int i = 0; i < polynomial.order + 1; ++i)
 		{
 			if (!first)
 				formula << " + ";
 
-			int xpower = int(fit.m_coefficients[pieceIndex].size() - i - 1);
+			int xpower = polynomial.order - i;
+			double coefficient = polynomial.coefficients[pieceIndex * (polynomial.order + 1) + xpower];
 
 			if (xpower == 0)
-				formula << fit.m_coefficients[pieceIndex][xpower];
+				formula << coefficient;
 			else if (xpower == 1)
-				formula << fit.m_coefficients[pieceIndex][xpower] << " x";
+				formula << coefficient << " x";
 			else
-				formula << fit.m_coefficients[pieceIndex][xpower] << " x^" << xpower;
+				formula << coefficient << " x^" << xpower;
 
 			first = false;
 		}
 		formula << "\n";
 	}
-	bestFormula = formula.str();
+	return formula.str();
+}
 
+void ApplyPolynomialFit(const PiecewisePolynomial& polynomial, const std::vector<float>& CDF, CSV& csv, CSV& CDFcsv, int csvcolumnIndex, int cdfcsvcolumnIndex, const char* label)
+{
 	// Set the label
 	char buffer[1024];
-	sprintf_s(buffer, "%s_ToUniformFit_O%i_C%i", label, (int)ORDER, (int)PIECES);
+	sprintf_s(buffer, "%s_ToUniformFit_O%i_C%i", label, polynomial.order, polynomial.pieces);
 	csv[csvcolumnIndex + 3].label = buffer;
 
 	// Put the values through the polynomial fit CDF (inverted, inverted CDF) to make them be a uniform distribution
@@ -101,7 +332,7 @@ void FindBestPolynomialFit_Order_Pieces(const std::vector<float>& CDF, float& lo
 	for (size_t index = 0; index < c_numberCount; ++index)
 	{
 		float x = csv[csvcolumnIndex].values[index];
-		csv[csvcolumnIndex + 3].values[index] = fit.Evaluate(x);
+		csv[csvcolumnIndex + 3].values[index] = polynomial.Evaluate(x);
 	}
 
 	// Put the fit CDF into the CDF csv
@@ -110,155 +341,306 @@ void FindBestPolynomialFit_Order_Pieces(const std::vector<float>& CDF, float& lo
 	for (size_t i = 0; i < CDF.size(); ++i)
 	{
 		float x = float(i) / float(CDF.size() - 1);
-		CDFcsv[cdfcsvcolumnIndex + 2].values[i] = fit.Evaluate(x);
+		CDFcsv[cdfcsvcolumnIndex + 2].values[i] = polynomial.Evaluate(x);
 	}
 }
 
-template <size_t ORDER>
-void FindBestPolynomialFit_Order(const std::vector<float>& CDF, float& lowestRMSE, std::string& bestFormula, CSV& csv, CSV& CDFcsv, int csvcolumnIndex, int cdfcsvcolumnIndex, const char* label)
+// Keeps the compiler from optimizing away the work being timed
+static volatile float s_sink = 0.0f;
+
+// Returns how many nanoseconds per sample it takes to evaluate the function over the values
+template <typename LAMBDA>
+float NanosecondsPerSample(const std::vector<float>& values, const LAMBDA& lambda)
 {
-	FindBestPolynomialFit_Order_Pieces<ORDER, 1>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	FindBestPolynomialFit_Order_Pieces<ORDER, 2>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	FindBestPolynomialFit_Order_Pieces<ORDER, 3>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	FindBestPolynomialFit_Order_Pieces<ORDER, 4>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	//FindBestPolynomialFit_Order_Pieces<ORDER, 5>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
+	float sum = 0.0f;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (float x : values)
+		sum += lambda(x);
+	auto end = std::chrono::high_resolution_clock::now();
+	s_sink = sum;
+
+	return float(std::chrono::duration<double, std::nano>(end - start).count() / double(values.size()));
 }
 
-std::string FindBestPolynomialFit(const std::vector<float>& CDF, CSV& csv, CSV& CDFcsv, int csvcolumnIndex, int cdfcsvcolumnIndex, const char* label)
+// Calculates the RMSE and max error of a fit against the CDF, as well as how many times it goes down, instead of up.
+template <typename LAMBDA>
+void CDFFitError(const std::vector<float>& CDF, const LAMBDA& lambda, float& RMSE, float& maxError, int& nonMonotonic)
 {
-	float lowestRMSE = FLT_MAX;
-	std::string bestFormula;
-	FindBestPolynomialFit_Order<1>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	FindBestPolynomialFit_Order<2>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	FindBestPolynomialFit_Order<3>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	//FindBestPolynomialFit_Order<4>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	//FindBestPolynomialFit_Order<5>(CDF, lowestRMSE, bestFormula, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
-	printf("%s", bestFormula.c_str());
-	return bestFormula;
+	RMSE = 0.0f;
+	maxError = 0.0f;
+	nonMonotonic = 0;
+	float lastValue = -FLT_MAX;
+	for (size_t i = 0; i < CDF.size(); ++i)
+	{
+		float percent = float(i) / float(CDF.size() - 1);
+		float value = lambda(percent);
+		float error = CDF[i] - value;
+		RMSE = Lerp(RMSE, error * error, 1.0f / float(i + 1));
+		maxError = std::max(maxError, std::abs(error));
+		if (value < lastValue || value < 0.0f || value > 1.0f)
+			nonMonotonic++;
+		lastValue = value;
+	}
+	RMSE = std::sqrt(RMSE);
 }
 
-void SequenceTest(CSV& csv, CSV& CDFcsv, int csvcolumnIndex, const char* label)
+// Compares the polynomial fit with monotone cubic Hermite fits, for accuracy and speed
+std::string CompareCDFApproximations(const std::vector<float>& values, const std::vector<float>& CDF, const PiecewisePolynomial& polynomial)
 {
-	// Normalize it to [0,1] and put it into the csv
-	float themin = csv[csvcolumnIndex].values[0];
-	float themax = csv[csvcolumnIndex].values[0];
-	for (float f : csv[csvcolumnIndex].values)
+	std::stringstream results;
+	results << "CDF approximations:\n";
+
+	float RMSE, maxError;
+	int nonMonotonic;
+	CDFFitError(CDF, [&](float x) { return polynomial.Evaluate(x); }, RMSE, maxError, nonMonotonic);
+	float ns = NanosecondsPerSample(values, [&](float x) { return polynomial.Evaluate(x); });
+	results << " Polynomial O" << polynomial.order << " C" << polynomial.pieces << ": RMSE = " << RMSE << ", Max Error = " << maxError << ", Non Monotonic = " << nonMonotonic << ", " << ns << " ns/sample\n";
+
+	for (int pieces : c_hermitePieces)
 	{
-		themin = std::min(themin, f);
-		themax = std::max(themax, f);
+		MonotoneCubicFit fit;
+		fit.Fit(CDF, pieces);
+		CDFFitError(CDF, [&](float x) { return fit.Evaluate(x); }, RMSE, maxError, nonMonotonic);
+		ns = NanosecondsPerSample(values, [&](float x) { return fit.Evaluate(x); });
+		results << " Monotone Cubic C" << pieces << ": RMSE = " << RMSE << ", Max Error = " << maxError << ", Non Monotonic = " << nonMonotonic << ", " << ns << " ns/sample\n";
 	}
-	for (float& f : csv[csvcolumnIndex].values)
-		f = (f - themin) / (themax - themin);
 
-	// sort the values, so that sampling this list as [0,1] samples the ICDF.
-	// add an explicit 0.0f and 1.0f if they aren't there
-	std::vector<float> valuesSorted = csv[csvcolumnIndex].values;
-	if (valuesSorted[0] > 0.0f)
-		valuesSorted.insert(valuesSorted.begin(), 0.0f);
-	if (valuesSorted[valuesSorted.size() - 1] < 1.0f)
-		valuesSorted.push_back(1.0f);
-	std::sort(valuesSorted.begin(), valuesSorted.end());
-
-	// sample the ICDF at evenly spaced intervals to make the smaller tables
-	std::vector<float> CDFFull(c_CDFTableSizeFull);
-	for (size_t i = 0; i < c_CDFTableSizeFull; ++i)
-	{
-		// get our evenly spaced x value
-		float percent = (float(i) + 0.5f) / float(c_CDFTableSizeFull);
-
-		// find the index of the first value >= x.
-		// returns size if all values are less than x.
-		int index = int(std::lower_bound(valuesSorted.begin(), valuesSorted.end(), percent) - valuesSorted.begin());
-
-		// find the percent 0 to 1 that the value occurs in the list, using linear interpolation to get more precise
-		// than an integer index.
-		if (index == 0)
-			CDFFull[i] = 0.0f;
-		else if (index == valuesSorted.size())
-			CDFFull[i] = 1.0f;
-		else
-		{
-			int index1 = index - 1;
-			int index2 = index;
-			float min = valuesSorted[index1];
-			float max = valuesSorted[index2];
-			float indexFract = (percent - min) / (max - min);
-			CDFFull[i] = (float(index1) + indexFract) / float(valuesSorted.size());
-		}
-	}
-	std::vector<float> CDFSmall(c_CDFTableSizeSmall);
-	for (size_t i = 0; i < c_CDFTableSizeSmall; ++i)
+	return results.str();
+}
+
+// The max error of the fit for x in the tails
+float TailMaxError(const std::vector<float>& CDF, const PiecewisePolynomial& polynomial)
+{
+	float maxError = 0.0f;
+	for (size_t i = 0; i < CDF.size(); ++i)
 	{
-		// get our evenly spaced x value
-		float percent = (float(i) + 0.5f) / float(c_CDFTableSizeSmall);
+		float x = float(i) / float(CDF.size() - 1);
+		if (x > c_tailWidth && x < 1.0f - c_tailWidth)
+			continue;
+		maxError = std::max(maxError, std::abs(CDF[i] - polynomial.Evaluate(x)));
+	}
+	return maxError;
+}
+
+// For each weighting, with and without equalized knots, finds the cheapest polynomial that has a tail max error at
+// least as good as the best fit's
+std::string CompareWeightedPolynomialFits(const std::vector<float>& CDF, const PiecewisePolynomial& best)
+{
+	float bestTailError = TailMaxError(CDF, best);
 
-		// find the index of the first value >= x.
-		// returns size if all values are less than x.
-		int index = int(std::lower_bound(valuesSorted.begin(), valuesSorted.end(), percent) - valuesSorted.begin());
+	std::stringstream results;
+	results << "Weighted fits, cheapest to match the tail max error of O" << best.order << " C" << best.pieces << " (" << bestTailError << "):\n";
 
-		// find the percent 0 to 1 that the value occurs in the list, using linear interpolation to get more precise
-		// than an integer index.
-		if (index == 0)
-			CDFFull[i] = 0.0f;
-		else if (index == valuesSorted.size())
-			CDFFull[i] = 1.0f;
-		else
+	static const CDFFitWeighting c_weightings[] = { CDFFitWeighting::Uniform, CDFFitWeighting::InverseDensity, CDFFitWeighting::RelativeError };
+	for (CDFFitWeighting weighting : c_weightings)
+	{
+		std::vector<float> weights = CDFFitWeights(CDF, weighting);
+		for (int equalizeKnots = 0; equalizeKnots < 2; ++equalizeKnots)
 		{
-			int index1 = index - 1;
-			int index2 = index;
-			float min = valuesSorted[index1];
-			float max = valuesSorted[index2];
-			float indexFract = (percent - min) / (max - min);
-			CDFSmall[i] = (float(index1) + indexFract) / float(valuesSorted.size());
+			results << " " << CDFFitWeightingName(weighting) << (equalizeKnots ? ", equalized knots: " : ", even knots: ");
+
+			bool found = false;
+			for (const PiecewisePolynomial& fit : WeightedPolynomialFits(CDF, weights, equalizeKnots != 0))
+			{
+				float tailError = TailMaxError(CDF, fit);
+				if (tailError > bestTailError)
+					continue;
+
+				float RMSE, maxError;
+				int nonMonotonic;
+				CDFFitError(CDF, [&](float x) { return fit.Evaluate(x); }, RMSE, maxError, nonMonotonic);
+				results << "O" << fit.order << " C" << fit.pieces << ", Tail Max Error = " << tailError << ", Max Error = " << maxError << ", RMSE = " << RMSE;
+				if (!fit.knots.empty())
+				{
+					results << ", knots =";
+					for (float knot : fit.knots)
+						results << " " << knot;
+				}
+				results << "\n";
+				found = true;
+				break;
+			}
+
+			if (!found)
+				results << "none\n";
 		}
 	}
 
-	// Put the values through the full CDF (inverted, inverted CDF) to make them be a uniform distribution
-	csv[csvcolumnIndex + 1].label = std::string(label) + "_ToUniform1024";
-	csv[csvcolumnIndex + 1].values.resize(c_numberCount);
-	for (size_t index = 0; index < c_numberCount; ++index)
+	return results.str();
+}
+
+// Makes every minimax candidate, and reports the max error and cost of each, and the code for the ones on the
+// pareto front of max error and cost
+std::string CompareMinimaxFits(const std::vector<float>& values, const std::vector<float>& CDF)
+{
+	std::vector<RationalFit> fits;
+	auto AddFit = [&](int numeratorOrder, int denominatorOrder, int pieces)
 	{
-		float x = csv[csvcolumnIndex].values[index];
+		RationalFit fit;
+		if (MinimaxFit(CDF, numeratorOrder, denominatorOrder, pieces, fit))
+			fits.push_back(fit);
+	};
+	for (int order : c_minimaxPolynomialOrders)
+		for (int pieces : c_minimaxPolynomialPieces)
+			AddFit(order, 0, pieces);
+	for (const int* orders : c_minimaxRationalOrders)
+		for (int pieces : c_minimaxRationalPieces)
+			AddFit(orders[0], orders[1], pieces);
+
+	std::stringstream results;
+	results << "Minimax fits:\n";
+	for (const RationalFit& fit : fits)
+	{
+		float RMSE, maxError;
+		int nonMonotonic;
+		CDFFitError(CDF, [&](float x) { return fit.Evaluate(x); }, RMSE, maxError, nonMonotonic);
+		float ns = NanosecondsPerSample(values, [&](float x) { return fit.Evaluate(x); });
+		results << " " << fit.Description() << ": Max Error = " << fit.maxError << ", RMSE = " << fit.RMSE << ", Non Monotonic = " << nonMonotonic << ", " << fit.Multiplies() << " multiplies, " << fit.Divides() << " divides, " << ns << " ns/sample\n";
+	}
 
-		float xindexf = std::min(x * float(CDFFull.size() - 1), (float)(CDFFull.size() - 1));
-		int xindex1 = int(xindexf);
-		int xindex2 = std::min(xindex1 + 1, (int)CDFFull.size() - 1);
-		float xindexfract = xindexf - std::floor(xindexf);
+	results << "\nMinimax fits on the pareto front of max error and cost:\n";
+	for (const RationalFit& fit : MinimaxParetoFront(fits))
+		results << "\n" << fit.CoefficientArrays();
 
-		float y1 = CDFFull[xindex1];
-		float y2 = CDFFull[xindex2];
+	return results.str();
+}
 
-		if (xindex1 == 0 && xindexfract == 0.0f)
-			y1 = y2 = 0.0f;
-		else if (xindex1 == CDFSmall.size() - 1)
-			y1 = y2 = 1.0f;
+// out.txt is written by a background thread, so the tests don't wait on the disk. It's emptied when first used.
+AsyncFileWriter& OutTxt()
+{
+	static AsyncFileWriter file("out.txt", "wb");
+	return file;
+}
 
-		csv[csvcolumnIndex + 1].values[index] = Lerp(y1, y2, xindexfract);
+struct SequenceTestOptions
+{
+	// If true, the noise is normalized using boundsMin and boundsMax, instead of the min and max of the values.
+	// The bounds come from the filter kernel (FIRBounds / IIRBounds), so no pass over the data is needed to find them.
+	bool analyticBounds = false;
+	float boundsMin = 0.0f;
+	float boundsMax = 1.0f;
+
+	// If true, the CDF tables and polynomial fit are loaded from the cache if present, else made and saved to the cache.
+	// Only valid with analytic bounds, since otherwise the tables depend on the values generated.
+	bool useCache = false;
+	CDFCacheKey cacheKey;
+};
+
+// Gets the CDF tables and polynomial fit, either from the cache, or by making them from the normalized values
+CDFCacheEntry GetCDFTables(const std::vector<float>& values, const SequenceTestOptions& options)
+{
+	CDFCacheEntry tables;
+	if (options.useCache && LoadCDFCache(options.cacheKey, tables))
+	{
+		printf("Loaded CDF tables from %s\n", CDFCacheFileName(options.cacheKey).c_str());
 	}
-
-	// Put the values through the small CDF (inverted, inverted CDF) to make them be a uniform distribution
-	csv[csvcolumnIndex + 2].label = std::string(label) + "_ToUniform64";
-	csv[csvcolumnIndex + 2].values.resize(c_numberCount);
-	for (size_t index = 0; index < c_numberCount; ++index)
+	else
 	{
-		float x = csv[csvcolumnIndex].values[index];
+		tables.pyramid = MakeCDFTablePyramid(values, c_CDFPyramidMinSize, c_CDFPyramidMaxSize);
+		tables.CDFFull = tables.pyramid.Level(c_CDFTableSizeFull)->table;
+		tables.CDFSmall = tables.pyramid.Level(c_CDFTableSizeSmall)->table;
+		tables.polynomial = FindBestPolynomialFit(tables.CDFFull);
+		if (options.useCache)
+			SaveCDFCache(options.cacheKey, tables);
+	}
+	return tables;
+}
+
+#if CHECK_TABLE_REMAP()
+// The table lookup SequenceTest used to do, where lastIndex was meant to be table.size() - 1, but was 63 for both tables
+float OldTableRemap(const std::vector<float>& table, size_t lastIndex, float x)
+{
+	float xindexf = std::min(x * float(table.size() - 1), (float)(table.size() - 1));
+	int xindex1 = int(xindexf);
+	int xindex2 = std::min(xindex1 + 1, (int)table.size() - 1);
+	float xindexfract = xindexf - std::floor(xindexf);
+
+	float y1 = table[xindex1];
+	float y2 = table[xindex2];
+
+	if (xindex1 == 0 && xindexfract == 0.0f)
+		y1 = y2 = 0.0f;
+	else if (xindex1 == lastIndex)
+		y1 = y2 = 1.0f;
+
+	return Lerp(y1, y2, xindexfract);
+}
 
-		float xindexf = std::min(x * float(CDFSmall.size() - 1), (float)(CDFSmall.size() - 1));
-		int xindex1 = int(xindexf);
-		int xindex2 = std::min(xindex1 + 1, (int)CDFSmall.size() - 1);
-		float xindexfract = xindexf - std::floor(xindexf);
+// Returns a description of how many of the remapped values differ from the old lookup, and where
+std::string CheckTableRemap(const std::vector<float>& x, const std::vector<float>& remapped, const std::vector<float>& table, size_t oldLastIndex)
+{
+	size_t differences = 0;
+	float differenceMin = 1.0f;
+	float differenceMax = 0.0f;
+	float maxDifference = 0.0f;
+	for (size_t index = 0; index < x.size(); ++index)
+	{
+		float old = OldTableRemap(table, oldLastIndex, x[index]);
+		if (old == remapped[index])
+			continue;
+		differences++;
+		differenceMin = std::min(differenceMin, x[index]);
+		differenceMax = std::max(differenceMax, x[index]);
+		maxDifference = std::max(maxDifference, std::abs(old - remapped[index]));
+	}
 
-		float y1 = CDFSmall[xindex1];
-		float y2 = CDFSmall[xindex2];
+	std::stringstream ret;
+	ret << " " << table.size() << " table: " << differences << " of " << x.size() << " differ";
+	if (differences > 0)
+		ret << ", for x in [" << differenceMin << ", " << differenceMax << "], by up to " << maxDifference;
+	ret << "\n";
+	return ret.str();
+}
+#endif
 
-		if (xindex1 == 0 && xindexfract == 0.0f)
-			y1 = y2 = 0.0f;
-		else if (xindex1 == CDFSmall.size() - 1)
-			y1 = y2 = 1.0f;
+void SequenceTest(CSV& csv, CSV& CDFcsv, int csvcolumnIndex, const char* label, const SequenceTestOptions& options = SequenceTestOptions())
+{
+	// Normalize it to [0,1] and put it into the csv
+	float themin = options.boundsMin;
+	float themax = options.boundsMax;
+	if (!options.analyticBounds)
+	{
+		themin = csv[csvcolumnIndex].values[0];
+		themax = csv[csvcolumnIndex].values[0];
+		for (float f : csv[csvcolumnIndex].values)
+		{
+			themin = std::min(themin, f);
+			themax = std::max(themax, f);
+		}
+	}
+	for (float& f : csv[csvcolumnIndex].values)
+		f = (f - themin) / (themax - themin);
 
-		csv[csvcolumnIndex + 2].values[index] = Lerp(y1, y2, xindexfract);
+	// The IIR bounds come from a truncated impulse response, so could be the tiniest bit too small.
+	if (options.analyticBounds)
+	{
+		for (float& f : csv[csvcolumnIndex].values)
+			f = std::min(std::max(f, 0.0f), 1.0f);
 	}
 
+	// Get the CDF tables and polynomial fit
+	CDFCacheEntry tables = GetCDFTables(csv[csvcolumnIndex].values, options);
+	const std::vector<float>& CDFFull = tables.CDFFull;
+	const std::vector<float>& CDFSmall = tables.CDFSmall;
+
+	// Put the values through the full CDF (inverted, inverted CDF) to make them be a uniform distribution
+	csv[csvcolumnIndex + 1].label = std::string(label) + "_ToUniform1024";
+	csv[csvcolumnIndex + 1].values.resize(c_numberCount);
+	std::vector<float> paddedCDFFull = PadTable(CDFFull);
+	Kernels().RemapLUT(paddedCDFFull.data(), CDFFull.size(), csv[csvcolumnIndex].values.data(), csv[csvcolumnIndex + 1].values.data(), c_numberCount);
+
+	// Put the values through the small CDF (inverted, inverted CDF) to make them be a uniform distribution
+	csv[csvcolumnIndex + 2].label = std::string(label) + "_ToUniform64";
+	csv[csvcolumnIndex + 2].values.resize(c_numberCount);
+	std::vector<float> paddedCDFSmall = PadTable(CDFSmall);
+	Kernels().RemapLUT(paddedCDFSmall.data(), CDFSmall.size(), csv[csvcolumnIndex].values.data(), csv[csvcolumnIndex + 2].values.data(), c_numberCount);
+
+#if CHECK_TABLE_REMAP()
+	printf("Remap compared to the old table lookup:\n");
+	printf("%s", CheckTableRemap(csv[csvcolumnIndex].values, csv[csvcolumnIndex + 1].values, CDFFull, CDFSmall.size() - 1).c_str());
+	printf("%s", CheckTableRemap(csv[csvcolumnIndex].values, csv[csvcolumnIndex + 2].values, CDFSmall, CDFSmall.size() - 1).c_str());
+#endif
+
 	// Put the CDF into the CDF csv
 	int cdfcsvcolumnIndex = (int)CDFcsv.size();
 	CDFcsv.resize(cdfcsvcolumnIndex + 3);
@@ -277,44 +659,106 @@ void SequenceTest(CSV& csv, CSV& CDFcsv, int csvcolumnIndex, const char* label)
 		}
 	}
 
-	// Find the best piecewise polynomial fit we can for this CDF, and use that
-	std::string bestFormula = FindBestPolynomialFit(CDFFull, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
+	// Use the best piecewise polynomial fit we could find for this CDF
+	std::string bestFormula = PolynomialFormula(tables.polynomial);
+	printf("%s", bestFormula.c_str());
+	ApplyPolynomialFit(tables.polynomial, CDFFull, csv, CDFcsv, csvcolumnIndex, cdfcsvcolumnIndex, label);
+
+	// See how the monotone cubic fits compare
+	std::string approximations = CompareCDFApproximations(csv[csvcolumnIndex].values, CDFFull, tables.polynomial);
+	printf("%s", approximations.c_str());
+
+	// Weighted fits and moved knots, for lower order fits with good tails
+	std::string weighted = CompareWeightedPolynomialFits(CDFFull, tables.polynomial);
+	printf("%s", weighted.c_str());
+
+	// Minimax polynomials and rational functions, for the lowest max error per multiply
+	std::string minimax = CompareMinimaxFits(csv[csvcolumnIndex].values, CDFFull);
+	printf("%s", minimax.c_str());
+
+	// How much is lost at each table size
+	std::stringstream pyramidErrors;
+	pyramidErrors << "CDF table sizes, compared to " << tables.pyramid.levels.back().table.size() << ":\n";
+	for (const CDFTableLevel& level : tables.pyramid.levels)
+		pyramidErrors << " " << level.table.size() << ": RMSE = " << level.RMSE << ", Max Error = " << level.maxError << "\n";
+	printf("%s", pyramidErrors.str().c_str());
 
 	// write to out.txt
 	{
-		FILE* file = nullptr;
-		fopen_s(&file, "out.txt", "ab");
+		AsyncFileWriter& file = OutTxt();
+
+		file.Printf("\n==========================\n%s\n==========================\n\n", label);
 
-		fprintf(file, "\n==========================\n%s\n==========================\n\n", label);
+		// write how the values were normalized to [0,1], which is needed to use the tables
+		file.Printf("Normalized from [%f, %f]%s\n\n", themin, themax, options.analyticBounds ? " (analytic bounds)" : "");
 
 		// write the polynomial
-		fprintf(file, "%s\n", bestFormula.c_str());
+		file.Printf("%s\n", bestFormula.c_str());
+
+		// write the comparison against the monotone cubic fits
+		file.Printf("%s\n", approximations.c_str());
+
+		// write the weighted fits
+		file.Printf("%s\n", weighted.c_str());
+
+		// write the minimax fits
+		file.Printf("%s\n", minimax.c_str());
+
+		// write the error of each table size
+		file.Printf("%s\n", pyramidErrors.str().c_str());
 
 		// write the small LUT
-		fprintf(file, "float LUT[%i] = {\n", (int)CDFSmall.size());
+		file.Printf("float LUT[%i] = {\n", (int)CDFSmall.size());
 		for (size_t i = 0; i < CDFSmall.size(); ++i)
 		{
 			if (i > 0 && (i % 10) == 0)
-				fprintf(file, "    %ff,  // %i\n", CDFSmall[i], (int)i);
+				file.Printf("    %ff,  // %i\n", CDFSmall[i], (int)i);
 			else
-				fprintf(file, "    %ff,\n", CDFSmall[i]);
+				file.Printf("    %ff,\n", CDFSmall[i]);
 		}
-		fprintf(file, "};\n\n");
+		file.Printf("};\n\n");
 
 		// write the starting numbers
-		fprintf(file, "Raw Numbers:\n");
+		file.Printf("Raw Numbers:\n");
 		for (size_t i = 0; i < c_outputSequenceCount; ++i)
-			fprintf(file, "%s%f", (i == 0) ? "" : ", ", csv[cdfcsvcolumnIndex].values[i]);
-		fprintf(file, "\n");
+			file.Printf("%s%f", (i == 0) ? "" : ", ", csv[cdfcsvcolumnIndex].values[i]);
+		file.Printf("\n");
 
 		// write the toUniform1024 numbers
-		fprintf(file, "\nToUniform1024 Numbers:\n");
+		file.Printf("\nToUniform1024 Numbers:\n");
 		for (size_t i = 0; i < c_outputSequenceCount; ++i)
-			fprintf(file, "%s%f", (i == 0) ? "" : ", ", csv[cdfcsvcolumnIndex + 1].values[i]);
-		fprintf(file, "\n");
+			file.Printf("%s%f", (i == 0) ? "" : ", ", csv[cdfcsvcolumnIndex + 1].values[i]);
+		file.Printf("\n");
+	}
+}
 
-		fclose(file);
+// Gets the CDF tables for an FIR kernel, from the cache if it's there (FIRTest puts it there), else by running a
+// BlueNoiseStreamFIR with the kernel and making the tables from its values
+template <size_t N>
+CDFCacheEntry GetFIRCDFTables(pcg32_random_t& rng, const std::vector<float>& kernel)
+{
+	SequenceTestOptions options;
+#if ANALYTIC_BOUNDS() && USE_CDF_CACHE()
+	options.useCache = true;
+	options.cacheKey = MakeCDFCacheKey(kernel, {});
+#endif
+
+	CDFCacheEntry tables;
+	if (!options.useCache || !LoadCDFCache(options.cacheKey, tables))
+	{
+		BlueNoiseStreamFIR<N> stream(rng, kernel, { 0.0f, 1.0f });
+		std::vector<float> values(c_numberCount);
+		for (float& f : values)
+			f = stream.NextFiltered();
+		tables = GetCDFTables(values, options);
 	}
+	return tables;
+}
+
+template <size_t N>
+BlueNoiseStreamFIR<N> MakeFIRStream(pcg32_random_t& rng, const std::vector<float>& kernel)
+{
+	return BlueNoiseStreamFIR<N>(rng, kernel, GetFIRCDFTables<N>(rng, kernel).CDFSmall);
 }
 
 void FinalBNTests(pcg32_random_t& rng, CSV& csv, CSV& CDFcsv)
@@ -336,6 +780,23 @@ void FinalBNTests(pcg32_random_t& rng, CSV& csv, CSV& CDFcsv)
 		SequenceTest(csv, CDFcsv, csvcolumnIndex, label);
 	}
 
+	// Make uniform BN using integer math, with a Q0.32 LUT approximation of the CDF
+	{
+		const char* label = "Final BN Fixed Point";
+		printf("\n%s\n", label);
+
+		int csvcolumnIndex = (int)csv.size();
+		csv.resize(csv.size() + 4);
+		csv[csvcolumnIndex].label = label;
+
+		BlueNoiseStreamFixedPoint stream(rng);
+		csv[csvcolumnIndex].values.resize(c_numberCount);
+		for (float& f : csv[csvcolumnIndex].values)
+			f = ldexpf((float)stream.Next(), -32);
+
+		SequenceTest(csv, CDFcsv, csvcolumnIndex, label);
+	}
+
 	// Make uniform BN using a polynomial approximation of the CDF 
 	{
 		const char* label = "Final BN Polynomial";
@@ -353,6 +814,58 @@ void FinalBNTests(pcg32_random_t& rng, CSV& csv, CSV& CDFcsv)
 		SequenceTest(csv, CDFcsv, csvcolumnIndex, label);
 	}
 
+	// Make uniform BN using a monotone cubic Hermite approximation of the CDF
+	{
+		const char* label = "Final BN Hermite";
+		printf("\n%s\n", label);
+
+		int csvcolumnIndex = (int)csv.size();
+		csv.resize(csv.size() + 4);
+		csv[csvcolumnIndex].label = label;
+
+		BlueNoiseStreamHermite stream(rng);
+		csv[csvcolumnIndex].values.resize(c_numberCount);
+		for (float& f : csv[csvcolumnIndex].values)
+			f = stream.Next();
+
+		SequenceTest(csv, CDFcsv, csvcolumnIndex, label);
+	}
+
+	// Make uniform BN using the 32 entry CDF table from the pyramid, which is small enough to keep in registers
+	{
+		const char* label = "Final BN Pyramid 32";
+		printf("\n%s\n", label);
+
+		int csvcolumnIndex = (int)csv.size();
+		csv.resize(csv.size() + 4);
+		csv[csvcolumnIndex].label = label;
+
+		CDFCacheEntry tables = GetFIRCDFTables<3>(rng, { 0.5f, -1.0f, 0.5f });
+		BlueNoiseStreamCDFTable stream(rng, tables.pyramid, 32);
+		csv[csvcolumnIndex].values.resize(c_numberCount);
+		for (float& f : csv[csvcolumnIndex].values)
+			f = stream.Next();
+
+		SequenceTest(csv, CDFcsv, csvcolumnIndex, label);
+	}
+
+	// Make uniform BN from the 9 tap Gauss10BlueNoise kernel, using a LUT of its CDF
+	{
+		const char* label = "Final BN FIR Gauss10";
+		printf("\n%s\n", label);
+
+		int csvcolumnIndex = (int)csv.size();
+		csv.resize(csv.size() + 4);
+		csv[csvcolumnIndex].label = label;
+
+		BlueNoiseStreamFIR<9> stream = MakeFIRStream<9>(rng, { 0.0002f, -0.0060f, 0.0606f, -0.2417f, 0.3829f, -0.2417f, 0.0606f, -0.0060f, 0.0002f });
+		csv[csvcolumnIndex].values.resize(c_numberCount);
+		for (float& f : csv[csvcolumnIndex].values)
+			f = stream.Next();
+
+		SequenceTest(csv, CDFcsv, csvcolumnIndex, label);
+	}
+
 	// Make uniform RN using a polynomial approximation of the CDF 
 	{
 		const char* label = "Final RN Polynomial";
@@ -388,6 +901,231 @@ void FinalBNTests(pcg32_random_t& rng, CSV& csv, CSV& CDFcsv)
 	}
 }
 
+// Makes blue noise with a non uniform distribution, by fusing the CDF of the filtered noise with the ICDF of the target
+// distribution into a single LUT, and compares it to going to uniform and then through the ICDF as a second step.
+template <typename LAMBDA>
+void FusedDistributionTest(const char* label, pcg32_random_t& rng, CSV& csv, const LAMBDA& ICDF)
+{
+	printf("\n%s\n", label);
+
+	// reserve space in the CSV for this data
+	// 0) The filtered white noise
+	// 1) To target distribution with the fused 1024 table
+	// 2) To uniform with the 1024 table CDF, then to target distribution with the ICDF
+	// 3) White noise through the ICDF, to show the target distribution
+	int csvcolumnIndex = (int)csv.size();
+	csv.resize(csvcolumnIndex + 4);
+	csv[csvcolumnIndex].label = label;
+
+	// make the same blue noise as the BlueNoiseStream* classes, normalized with analytic bounds
+	std::vector<float> kernel = { 0.5f, -1.0f, 0.5f };
+	std::vector<float> whiteNoise(c_numberCount);
+	Kernels().UniformFloats(rng, whiteNoise.data(), c_numberCount);
+	csv[csvcolumnIndex].values.resize(c_numberCount);
+	Kernels().FIR(whiteNoise.data(), c_numberCount, kernel.data(), kernel.size(), csv[csvcolumnIndex].values.data());
+
+	SequenceTestOptions options;
+	options.analyticBounds = true;
+	FIRBounds(kernel, options.boundsMin, options.boundsMax);
+#if USE_CDF_CACHE()
+	options.useCache = true;
+	options.cacheKey = MakeCDFCacheKey(kernel, {});
+#endif
+	for (float& f : csv[csvcolumnIndex].values)
+		f = (f - options.boundsMin) / (options.boundsMax - options.boundsMin);
+
+	CDFCacheEntry tables = GetCDFTables(csv[csvcolumnIndex].values, options);
+	std::vector<float> fusedLUT = MakeFusedLUT(tables.CDFFull, ICDF, c_CDFTableSizeFull);
+
+	// one lookup, using the stream class
+	csv[csvcolumnIndex + 1].label = std::string(label) + "_Fused1024";
+	csv[csvcolumnIndex + 1].values.resize(c_numberCount);
+	{
+		BlueNoiseStreamFused stream(rng, fusedLUT.data(), fusedLUT.size());
+		for (float& f : csv[csvcolumnIndex + 1].values)
+			f = stream.Next();
+	}
+
+	// two steps
+	csv[csvcolumnIndex + 2].label = std::string(label) + "_ToUniform1024_ICDF";
+	csv[csvcolumnIndex + 2].values.resize(c_numberCount);
+	for (size_t index = 0; index < c_numberCount; ++index)
+		csv[csvcolumnIndex + 2].values[index] = ICDF(SampleTable(tables.CDFFull, csv[csvcolumnIndex].values[index]));
+
+	// the target distribution
+	csv[csvcolumnIndex + 3].label = std::string(label) + "_WhiteNoise_ICDF";
+	csv[csvcolumnIndex + 3].values.resize(c_numberCount);
+	for (size_t index = 0; index < c_numberCount; ++index)
+		csv[csvcolumnIndex + 3].values[index] = ICDF(whiteNoise[index]);
+
+	// Report the mean and standard deviation of each, to compare against the target
+	for (int column = 1; column < 4; ++column)
+	{
+		double mean = 0.0;
+		double meanSquared = 0.0;
+		for (float f : csv[csvcolumnIndex + column].values)
+		{
+			mean += f;
+			meanSquared += double(f) * double(f);
+		}
+		mean /= double(c_numberCount);
+		meanSquared /= double(c_numberCount);
+		printf("  %s: mean = %f, stddev = %f\n", csv[csvcolumnIndex + column].label.c_str(), mean, std::sqrt(std::max(meanSquared - mean * mean, 0.0)));
+	}
+}
+
+void FusedDistributionTests(pcg32_random_t& rng, CSV& csv)
+{
+	FusedDistributionTest("FusedBNGaussian", rng, csv, [](float u) { return GaussianICDF(u); });
+	FusedDistributionTest("FusedBNExponential", rng, csv, [](float u) { return ExponentialICDF(u); });
+
+	// The exponential again, as a table, like a distribution only known from samples would be
+	std::vector<float> exponentialTable(c_tabulatedICDFSize);
+	for (size_t index = 0; index < c_tabulatedICDFSize; ++index)
+		exponentialTable[index] = ExponentialICDF(float(index) / float(c_tabulatedICDFSize - 1));
+	TabulatedICDF tabulatedExponential(exponentialTable);
+
+	float maxDifference = 0.0f;
+	for (size_t index = 0; index < c_numberCount; ++index)
+	{
+		float u = float(index) / float(c_numberCount - 1);
+		maxDifference = std::max(maxDifference, std::abs(tabulatedExponential(u) - ExponentialICDF(u)));
+	}
+	printf("\nTabulated exponential ICDF, %zu entries: max difference from ExponentialICDF = %f\n", c_tabulatedICDFSize, maxDifference);
+
+	FusedDistributionTest("FusedBNTabulatedExponential", rng, csv, tabulatedExponential);
+}
+
+// FNV-1a of a void and cluster sequence's ranks. c_voidAndClusterColumnFile stores one for each sequence, so it can
+// tell if the files in the bluenoise folder have changed since it was made from them.
+uint64_t HashVoidAndClusterSequence(const std::vector<size_t>& sequence)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const uint8_t* bytes = (const uint8_t*)sequence.data();
+	for (size_t index = 0; index < sequence.size() * sizeof(size_t); ++index)
+	{
+		hash ^= bytes[index];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Writes the void and cluster sequences to c_voidAndClusterColumnFile, a column each, and a column of their hashes.
+// The ranks need 17 bits, so bit packing them makes the file about a quarter the size of the files they came from.
+void WriteVoidAndClusterColumnFile(const std::vector<std::vector<size_t>>& sequences)
+{
+	ColumnStoreWriter writer(c_voidAndClusterColumnFile, c_voidAndClusterFileLength);
+	std::vector<size_t> hashes;
+	for (size_t i = 0; i < sequences.size(); ++i)
+	{
+		char label[256];
+		sprintf_s(label, "bn100k_%i", (int)i);
+		writer.AddIndexColumn(label, sequences[i]);
+		hashes.push_back((size_t)HashVoidAndClusterSequence(sequences[i]));
+	}
+	writer.AddIndexColumn("bn100k_hashes", hashes);
+	if (writer.Close())
+		printf("Wrote %s\n", c_voidAndClusterColumnFile);
+}
+
+// Reads the hashes of the sequences c_voidAndClusterColumnFile was made from.
+// Returns false if the file isn't there, or doesn't have them.
+bool ReadVoidAndClusterColumnFileHashes(ColumnStoreReader& reader, std::vector<size_t>& hashes)
+{
+	int column = reader.FindColumn("bn100k_hashes");
+	if (column < 0 || reader.Columns()[column].kind != ColumnKind::Index)
+		return false;
+	return reader.ReadColumn(column, hashes) && hashes.size() == size_t(c_voidAndClusterFileCount);
+}
+
+// Reads the void and cluster sequences from c_voidAndClusterColumnFile, a block per thread.
+// Returns false if the file isn't there, doesn't have all of the sequences, or they don't match their hashes.
+bool ReadVoidAndClusterColumnFile(std::vector<std::vector<size_t>>& sequences)
+{
+	ColumnStoreReader reader;
+	if (!reader.Open(c_voidAndClusterColumnFile))
+		return false;
+
+	std::vector<size_t> columns;
+	for (int i = 0; i < c_voidAndClusterFileCount; ++i)
+	{
+		char label[256];
+		sprintf_s(label, "bn100k_%i", i);
+		int column = reader.FindColumn(label);
+		if (column < 0 || reader.Columns()[column].kind != ColumnKind::Index)
+			return false;
+		columns.push_back(column);
+	}
+
+	std::vector<size_t> hashes;
+	if (!ReadVoidAndClusterColumnFileHashes(reader, hashes) || !reader.ReadColumns(columns, sequences))
+		return false;
+	for (int i = 0; i < c_voidAndClusterFileCount; ++i)
+	{
+		if (hashes[i] != (size_t)HashVoidAndClusterSequence(sequences[i]))
+			return false;
+	}
+	return true;
+}
+
+// True if c_voidAndClusterColumnFile was made from these sequences
+bool VoidAndClusterColumnFileMatches(const std::vector<std::vector<size_t>>& sequences)
+{
+	ColumnStoreReader reader;
+	std::vector<size_t> hashes;
+	if (!reader.Open(c_voidAndClusterColumnFile) || !ReadVoidAndClusterColumnFileHashes(reader, hashes) || hashes.size() != sequences.size())
+		return false;
+	for (size_t i = 0; i < sequences.size(); ++i)
+	{
+		if (hashes[i] != (size_t)HashVoidAndClusterSequence(sequences[i]))
+			return false;
+	}
+	return true;
+}
+
+// Reads the void and cluster sequences from the files in the bluenoise folder.
+// Returns false if any of them are missing or short.
+bool ReadVoidAndClusterFiles(std::vector<std::vector<size_t>>& sequences)
+{
+	sequences.clear();
+	for (int i = 0; i < c_voidAndClusterFileCount; ++i)
+	{
+		char fileName[256];
+		sprintf_s(fileName, "bluenoise/bn100k_%i.bin", i);
+		FILE* file = nullptr;
+		fopen_s(&file, fileName, "rb");
+		if (!file)
+			return false;
+		size_t length = 0;
+		bool ok = fread(&length, sizeof(size_t), 1, file) == 1 && length <= c_voidAndClusterFileLength;
+		if (ok)
+		{
+			sequences.emplace_back(length);
+			ok = fread(sequences.back().data(), sizeof(size_t), length, file) == length;
+		}
+		fclose(file);
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+// Remakes the files in the bluenoise folder. Each sequence is independent, so they are made in parallel.
+void MakeVoidAndClusterFiles(pcg32_random_t& rng)
+{
+	printf("\nMaking %i void and cluster sequences of length %i\n", c_voidAndClusterFileCount, (int)c_voidAndClusterFileLength);
+
+	std::vector<std::vector<size_t>> sequences = MakeVoidAndCluster1DSequences(c_voidAndClusterFileCount, c_voidAndClusterFileLength, pcg32_random_r(&rng));
+	for (int i = 0; i < c_voidAndClusterFileCount; ++i)
+	{
+		char fileName[256];
+		sprintf_s(fileName, "bluenoise/bn100k_%i.bin", i);
+		WriteVoidAndClusterFile(fileName, sequences[i]);
+	}
+
+	WriteVoidAndClusterColumnFile(sequences);
+}
+
 void VoidAndClusterTest(pcg32_random_t& rng, CSV& csv, CSV& CDFcsv)
 {
 	const char* label = "VoidAndCluster";
@@ -402,21 +1140,28 @@ void VoidAndClusterTest(pcg32_random_t& rng, CSV& csv, CSV& CDFcsv)
 	csv.resize(csvcolumnIndex + 4);
 	csv[csvcolumnIndex].label = label;
 
-	// read the data from disk
+#if GENERATE_VOID_AND_CLUSTER()
+	// make a single sequence long enough that it doesn't need to repeat
+	std::vector<size_t> blueNoise = MakeVoidAndCluster1D(c_numberCount, pcg32_random_r(&rng));
+#else
+	// read the data from disk. The files in the bluenoise folder are the source, and the column store is remade
+	// whenever its hashes don't match them. The column store is only read when the files aren't there, like when
+	// only it was archived.
 	std::vector<size_t> blueNoise;
-	for (int i = 0; i < 100; ++i)
+	std::vector<std::vector<size_t>> sequences;
+	if (ReadVoidAndClusterFiles(sequences))
 	{
-		char fileName[256];
-		sprintf_s(fileName, "bluenoise/bn100k_%i.bin", i);
-		FILE* file = nullptr;
-		fopen_s(&file, fileName, "rb");
-		size_t length = 0;
-		fread(&length, sizeof(size_t), 1, file);
-		size_t oldLength = blueNoise.size();
-		blueNoise.resize(oldLength + length);
-		fread(&blueNoise[oldLength], sizeof(size_t), length, file);
-		fclose(file);
+		if (!VoidAndClusterColumnFileMatches(sequences))
+			WriteVoidAndClusterColumnFile(sequences);
 	}
+	else if (!ReadVoidAndClusterColumnFile(sequences))
+	{
+		printf("Couldn't read the void and cluster sequences from the bluenoise folder or %s\n", c_voidAndClusterColumnFile);
+		return;
+	}
+	for (const std::vector<size_t>& sequence : sequences)
+		blueNoise.insert(blueNoise.end(), sequence.begin(), sequence.end());
+#endif
 
 	size_t length = blueNoise.size();
 	if (length > c_numberCount)
@@ -449,8 +1194,7 @@ void IIRTest(const char* label, pcg32_random_t& rng, CSV& csv, CSV& CDFcsv, cons
 
 	// make white noise
 	std::vector<float> whiteNoise(c_numberCount);
-	for (float& f : whiteNoise)
-		f = PCGRandomFloat01(rng);
+	Kernels().UniformFloats(rng, whiteNoise.data(), c_numberCount);
 
 	// filter the white noise
 	std::vector<float> filteredWhiteNoise(c_numberCount, 0.0f);
@@ -479,7 +1223,16 @@ void IIRTest(const char* label, pcg32_random_t& rng, CSV& csv, CSV& CDFcsv, cons
 	csv[csvcolumnIndex].values = filteredWhiteNoise;
 
 	// Do the rest of the testing
-	SequenceTest(csv, CDFcsv, csvcolumnIndex, label);
+	SequenceTestOptions options;
+#if ANALYTIC_BOUNDS()
+	options.analyticBounds = true;
+	IIRBounds(xCoefficients, yCoefficients, options.boundsMin, options.boundsMax);
+#if USE_CDF_CACHE()
+	options.useCache = true;
+	options.cacheKey = MakeCDFCacheKey(xCoefficients, yCoefficients);
+#endif
+#endif
+	SequenceTest(csv, CDFcsv, csvcolumnIndex, label, options);
 }
 
 void FIRTest(const char* label, pcg32_random_t& rng, CSV& csv, CSV& CDFcsv, const std::vector<float>& kernel)
@@ -497,15 +1250,202 @@ void FIRTest(const char* label, pcg32_random_t& rng, CSV& csv, CSV& CDFcsv, cons
 
 	// make white noise
 	std::vector<float> whiteNoise(c_numberCount);
-	for (float& f : whiteNoise)
-		f = PCGRandomFloat01(rng);
+	Kernels().UniformFloats(rng, whiteNoise.data(), c_numberCount);
 
-	// Convolve and truncate the noise
-	csv[csvcolumnIndex].values = Convolve(whiteNoise, kernel);
+	// Convolve the noise, keeping the first c_numberCount values
 	csv[csvcolumnIndex].values.resize(c_numberCount);
+	Kernels().FIR(whiteNoise.data(), c_numberCount, kernel.data(), kernel.size(), csv[csvcolumnIndex].values.data());
 
 	// Do the rest of the testing
-	SequenceTest(csv, CDFcsv, csvcolumnIndex, label);
+	SequenceTestOptions options;
+#if ANALYTIC_BOUNDS()
+	options.analyticBounds = true;
+	FIRBounds(kernel, options.boundsMin, options.boundsMax);
+#if USE_CDF_CACHE()
+	options.useCache = true;
+	options.cacheKey = MakeCDFCacheKey(kernel, {});
+#endif
+#endif
+	SequenceTest(csv, CDFcsv, csvcolumnIndex, label, options);
+}
+
+// Designs filters for each of c_noiseColorTargets, and characterizes them like the hand made ones, ending with the
+// FIR design as a BlueNoiseStreamFIR, which is the filter and the CDF table remap in one, ready to use.
+void DesignFilterTests(pcg32_random_t& rng, CSV& csv, CSV& CDFcsv)
+{
+	std::stringstream results;
+	for (const NoiseColorTarget& target : c_noiseColorTargets)
+	{
+		DesignedFilter windowFIR = DesignFIRWindow(target.power, int(c_designedFIRTaps));
+		DesignedFilter leastSquaresFIR = DesignFIRLeastSquares(target.power, int(c_designedFIRTaps));
+		DesignedFilter IIR = DesignIIR(target.power, c_designedIIRZeroTaps, c_designedIIRPoles);
+		const DesignedFilter& FIR = (windowFIR.RMSError < leastSquaresFIR.RMSError) ? windowFIR : leastSquaresFIR;
+
+		std::stringstream designs;
+		designs << "\n" << target.label << " noise designs, power spectrum error against the target:\n";
+		for (const DesignedFilter* design : { &windowFIR, &leastSquaresFIR, &IIR })
+			designs << " " << design->Description() << "\n   " << design->Code() << "\n";
+		printf("%s", designs.str().c_str());
+		results << designs.str();
+
+		std::string label = std::string("Designed") + target.label;
+		FIRTest((label + "FIR").c_str(), rng, csv, CDFcsv, FIR.xCoefficients);
+		IIRTest((label + "IIR").c_str(), rng, csv, CDFcsv, IIR.xCoefficients, IIR.yCoefficients);
+
+		// FIRTest put the CDF tables in the cache, so the stream uses them
+		{
+			std::string streamLabel = label + " FIR Stream";
+			printf("\n%s\n", streamLabel.c_str());
+
+			int csvcolumnIndex = (int)csv.size();
+			csv.resize(csv.size() + 4);
+			csv[csvcolumnIndex].label = streamLabel;
+
+			BlueNoiseStreamFIR<c_designedFIRTaps> stream = MakeFIRStream<c_designedFIRTaps>(rng, FIR.xCoefficients);
+			csv[csvcolumnIndex].values.resize(c_numberCount);
+			for (float& f : csv[csvcolumnIndex].values)
+				f = stream.Next();
+
+			SequenceTest(csv, CDFcsv, csvcolumnIndex, streamLabel.c_str());
+		}
+	}
+
+	OutTxt().Printf("\n==========================\nDesigned filters\n==========================\n%s\n", results.str().c_str());
+}
+
+// Runs the filter for c_outOfCoreSampleCount samples without keeping them, and reports what is in the tails, how the
+// CDF compares to the one from c_numberCount samples, and how often the 64 entry table remap clamps to 0 or 1
+void OutOfCoreTest(const char* label, const std::vector<float>& xCoefficients, const std::vector<float>& yCoefficients)
+{
+	printf("\n%s\n", label);
+
+	OutOfCoreOptions options;
+	options.name = label;
+	options.xCoefficients = xCoefficients;
+	options.yCoefficients = yCoefficients;
+	if (yCoefficients.empty())
+		FIRBounds(xCoefficients, options.boundsMin, options.boundsMax);
+	else
+		IIRBounds(xCoefficients, yCoefficients, options.boundsMin, options.boundsMax);
+	options.seed = c_outOfCoreSeed;
+	options.sampleCount = c_outOfCoreSampleCount;
+	options.chunkSize = c_outOfCoreChunkSize;
+	options.warmup = yCoefficients.empty() ? uint32_t(xCoefficients.size() - 1) : c_outOfCoreIIRWarmup;
+
+	// The tables from the normal run, if they are in the cache
+	CDFCacheEntry tables;
+	bool haveTables = LoadCDFCache(MakeCDFCacheKey(xCoefficients, yCoefficients), tables);
+	if (haveTables)
+		options.remapTable = tables.CDFSmall;
+	else
+		printf("No cached CDF tables, so the remap isn't checked. Run once with OUT_OF_CORE() false to make them.\n");
+
+	OutOfCoreAccumulator accumulator = RunOutOfCore(options);
+
+	std::stringstream results;
+	results << "Samples = " << accumulator.count << ", Min = " << accumulator.min << ", Max = " << accumulator.max << "\n";
+	results << "Outside of the bounds: " << accumulator.belowZero << " below, " << accumulator.aboveOne << " above\n";
+	results << "Exactly 0 = " << accumulator.exactZero << ", Exactly 1 = " << accumulator.exactOne << "\n";
+
+	results << "Tails, count of values within 2^-N of the end (low, high):\n";
+	for (int bin = 0; bin < c_outOfCoreTailBins; ++bin)
+	{
+		if (accumulator.lowTail[bin] == 0 && accumulator.highTail[bin] == 0)
+			continue;
+		results << " 2^-" << (bin + 1) << ": " << accumulator.lowTail[bin] << ", " << accumulator.highTail[bin] << "\n";
+	}
+
+	if (haveTables)
+	{
+		std::vector<float> CDF = accumulator.CDFTable(c_CDFTableSizeFull);
+		float maxDifference = 0.0f;
+		for (size_t i = 0; i < CDF.size(); ++i)
+			maxDifference = std::max(maxDifference, std::abs(CDF[i] - tables.CDFFull[i]));
+		results << "CDF " << c_CDFTableSizeFull << " compared to the one from " << c_numberCount << " samples: Max Difference = " << maxDifference << "\n";
+
+		// The remapped histogram should be flat
+		double expected = double(accumulator.count) / double(c_outOfCoreRemapBins);
+		double maxDeviation = 0.0;
+		for (uint64_t binCount : accumulator.remappedHistogram)
+			maxDeviation = std::max(maxDeviation, std::abs(double(binCount) - expected) / expected);
+		results << "Remapped with the " << tables.CDFSmall.size() << " entry table: Exactly 0 = " << accumulator.remappedZero << ", Exactly 1 = " << accumulator.remappedOne << ", Max Histogram Deviation = " << maxDeviation * 100.0 << "%\n";
+	}
+
+	printf("%s", results.str().c_str());
+
+	FILE* file = nullptr;
+	fopen_s(&file, (std::string(c_outOfCoreDirectory) + "/" + label + ".txt").c_str(), "wb");
+	if (file)
+	{
+		fprintf(file, "%s", results.str().c_str());
+		fclose(file);
+	}
+}
+
+// The same filters as the normal tests
+void OutOfCoreTests()
+{
+	OutOfCoreTest("Box3BlueNoise", { -1.0f, 1.0f, -1.0f }, {});
+	OutOfCoreTest("Box5BlueNoise1", { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f }, {});
+	OutOfCoreTest("Box5BlueNoise2", { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f }, {});
+	OutOfCoreTest("Gauss10BlueNoise", { 0.0002f, -0.0060f, 0.0606f, -0.2417f, 0.3829f, -0.2417f, 0.0606f, -0.0060f, 0.0002f }, {});
+	OutOfCoreTest("FIRHPF", { 0.5f, -1.0f, 0.5f }, {});
+	OutOfCoreTest("IIRHPF", { 0.5f, -1.0f, 0.5f }, { 0.9f });
+}
+
+// Times the CDF approximations of the blue noise stream on this CPU, and saves the fastest one within the error budget
+void Autotune(pcg32_random_t& rng)
+{
+	printf("\nAutotune\n");
+
+	// make the same noise BlueNoiseStreamLUT makes, normalized to [0,1]
+	static const std::vector<float> xCoefficients = { 0.5f, -1.0f, 0.5f };
+	std::vector<float> values(c_numberCount);
+	float lastValues[2] = { PCGRandomFloat01(rng), PCGRandomFloat01(rng) };
+	for (float& f : values)
+	{
+		float value = PCGRandomFloat01(rng);
+		float y = value * xCoefficients[0] + lastValues[0] * xCoefficients[1] + lastValues[1] * xCoefficients[2];
+		lastValues[1] = lastValues[0];
+		lastValues[0] = value;
+		f = y * 0.5f + 0.5f;
+	}
+
+	// Get the reference CDF. This is the same key as the FIRHPF test, so the cache is shared.
+	SequenceTestOptions options;
+#if USE_CDF_CACHE()
+	options.useCache = true;
+	options.cacheKey = MakeCDFCacheKey(xCoefficients, {});
+#endif
+	CDFCacheEntry tables = GetCDFTables(values, options);
+
+	// make the candidates
+	std::vector<TunedCDF> candidates;
+	for (int size : c_autotuneLUTSizes)
+		candidates.push_back(MakeTunedLUT(tables.CDFFull, size));
+	for (const PiecewisePolynomial& polynomial : AllPolynomialFits(tables.CDFFull))
+		candidates.push_back(MakeTunedPolynomial(polynomial));
+	for (int pieces : c_hermitePieces)
+		candidates.push_back(MakeTunedHermite(tables.CDFFull, pieces));
+
+	// time them on a subset of the noise, so the tables are evaluated in the order the stream would
+	values.resize(std::min(values.size(), c_autotuneSampleCount));
+	TunedCDF tuned = AutotuneCDF(tables.CDFFull, values, candidates, c_autotuneErrorBudget);
+
+	std::stringstream results;
+	results << "Autotune on " << tuned.cpu << ", error budget " << c_autotuneErrorBudget << "\n";
+	for (const TunedCDF& candidate : candidates)
+		results << " " << candidate.Description() << ": Max Error = " << candidate.maxError << ", " << candidate.nsPerSample << " ns/sample" << ((candidate.maxError <= c_autotuneErrorBudget) ? "" : " (over budget)") << "\n";
+	results << "Chose " << tuned.Description() << "\n";
+	printf("%s", results.str().c_str());
+
+	OutTxt().Printf("%s\n", results.str().c_str());
+	OutTxt().Flush();
+
+	if (SaveTunedCDF("tuning.txt", tuned))
+		printf("Wrote tuning.txt\n");
+	else
+		printf("Could not write tuning.txt\n");
 }
 
 int main(int argc, char** argv)
@@ -519,11 +1459,39 @@ int main(int argc, char** argv)
 #endif
 
 	// empty out.txt
+	OutTxt();
+
+	printf("Noise kernels: %s (CPU supports %s)\n", DispatchISAName(Kernels().ISA), DispatchISAName(DetectedISA()));
+
+#if AUTOTUNE()
+	Autotune(rng);
+	return 0;
+#endif
+
+#if OUT_OF_CORE()
+	OutOfCoreTests();
+	return 0;
+#endif
+
+#if DESIGN_FILTERS()
 	{
-		FILE* file = nullptr;
-		fopen_s(&file, "out.txt", "wb");
-		fclose(file);
+		CSV csv, CDFcsv;
+		DesignFilterTests(rng, csv, CDFcsv);
+
+		printf("\nWriting CSVs...\n");
+		WriteCSV(csv, "out.csv");
+		WriteCSV(CDFcsv, "cdf.csv");
+		OutTxt().Flush();
+
+		printf("\nRunning MakeHistograms.py\n");
+		system(PYTHON_COMMAND " MakeHistograms.py");
+		return 0;
 	}
+#endif
+
+#if REMAKE_VOID_AND_CLUSTER_FILES()
+	MakeVoidAndClusterFiles(rng);
+#endif
 
 	// make noise and add to csv
 	CSV csv, CDFcsv;
@@ -548,12 +1516,21 @@ int main(int argc, char** argv)
 
 	FinalBNTests(rng, csv, CDFcsv);
 
+	// CDFcsv is done now, so it goes to disk while the fused tests run
+	std::future<void> CDFcsvWritten = WriteCSVAsync(std::move(CDFcsv), "cdf.csv");
+
+	FusedDistributionTests(rng, csv);
+
 	printf("\nWriting CSVs...\n");
 	WriteCSV(csv, "out.csv");
-	WriteCSV(CDFcsv, "cdf.csv");
+#if WRITE_COLUMN_STORE()
+	WriteCSVColumnStore(csv, "out.col", c_columnStoreMaxError);
+#endif
+	CDFcsvWritten.wait();
+	OutTxt().Flush();
 
 	printf("\nRunning MakeHistograms.py\n");
-	system("python MakeHistograms.py");
+	system(PYTHON_COMMAND " MakeHistograms.py");
 
 	return 0;
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <cmath>
+#include <algorithm>
 
 inline float Lerp(float A, float B, float t)
 {
@@ -36,3 +38,148 @@ inline std::vector<float> Convolve(const std::vector<float>& A, const std::vecto
 
 	return out;
 }
+
+// The range of values an FIR filter outputs when filtering white noise in [0,1].
+// The lowest output is when all the negative taps see a 1 and the positive taps see a 0, and the reverse for the highest.
+inline void FIRBounds(const std::vector<float>& kernel, float& outMin, float& outMax)
+{
+	outMin = 0.0f;
+	outMax = 0.0f;
+	for (float f : kernel)
+	{
+		if (f < 0.0f)
+			outMin += f;
+		else
+			outMax += f;
+	}
+}
+
+// The range of values a stable IIR filter outputs when filtering white noise in [0,1].
+// Same idea as FIRBounds, but using the impulse response of the filter, which is infinitely long.
+// The impulse response is followed until it decays to nothing, which it will do if the filter is stable.
+inline void IIRBounds(const std::vector<float>& xCoefficients, const std::vector<float>& yCoefficients, float& outMin, float& outMax)
+{
+	static const size_t c_maxImpulseLength = 1 << 20;
+	static const double c_impulseEpsilon = 1e-9;
+
+	double minSum = 0.0;
+	double maxSum = 0.0;
+
+	std::vector<double> impulseResponse;
+	for (size_t index = 0; index < c_maxImpulseLength; ++index)
+	{
+		// same filtering as IIRTest, with an impulse as the input
+		double h = (index < xCoefficients.size()) ? xCoefficients[index] : 0.0;
+		for (size_t yIndex = 0; yIndex < yCoefficients.size() && yIndex < index; ++yIndex)
+			h += yCoefficients[yIndex] * impulseResponse[index - yIndex - 1];
+		impulseResponse.push_back(h);
+
+		if (h < 0.0)
+			minSum += h;
+		else
+			maxSum += h;
+
+		// stop when the feedback has died out
+		if (index >= xCoefficients.size())
+		{
+			double recent = 0.0;
+			for (size_t yIndex = 0; yIndex <= yCoefficients.size() && yIndex <= index; ++yIndex)
+				recent += std::abs(impulseResponse[index - yIndex]);
+			if (recent < c_impulseEpsilon)
+				break;
+		}
+	}
+
+	outMin = (float)minSum;
+	outMax = (float)maxSum;
+}
+
+// Samples a table that covers x in [0,1] with evenly spaced entries, using linear interpolation
+inline float SampleTable(const std::vector<float>& table, float x)
+{
+	float indexf = std::min(std::max(x, 0.0f), 1.0f) * float(table.size() - 1);
+	int index1 = std::min(int(indexf), (int)table.size() - 1);
+	int index2 = std::min(index1 + 1, (int)table.size() - 1);
+	float fract = indexf - float(index1);
+	return Lerp(table[index1], table[index2], fract);
+}
+
+// Copies a table that is evenly spaced over [0,1], with the last entry repeated on the end, for SamplePaddedTable
+inline std::vector<float> PadTable(const std::vector<float>& table)
+{
+	std::vector<float> ret = table;
+	ret.push_back(table.back());
+	return ret;
+}
+
+// Samples a table that has size entries evenly spaced over [0,1], plus a copy of the last entry on the end.
+// This gives the same results as the LUT lookup in BlueNoiseStreamLUT for x in [0,1], but without branches, so loops
+// of it can vectorize. The extra entry means the second index never goes past the end, so needs no clamping.
+// The endpoint rules, 0 at x = 0 and 1 at x = 1, are done with math instead of branches or selects, which the
+// vectorizer treats as control flow. That relies on the table being a CDF, with values in [0,1].
+inline float SamplePaddedTable(const float* table, size_t size, float x)
+{
+	float xindexf = std::min(std::max(x, 0.0f), 1.0f) * float(size - 1);
+	int xindex = int(xindexf);
+	float xindexfract = xindexf - float(xindex);
+
+	float y = Lerp(table[xindex], table[xindex + 1], xindexfract);
+	y *= float(xindexf > 0.0f);
+	y = std::max(y, float(xindexf >= float(size - 1)));
+	return y;
+}
+
+// Samples a table padded by PadTable, like SamplePaddedTable, but for tables of any values, such as the fused LUTs
+// that go straight to a target distribution, so there are no endpoint rules. For x in [0,1] this is the same as
+// SampleTable on the unpadded table.
+inline float SamplePaddedLUT(const float* table, size_t size, float x)
+{
+	float xindexf = std::min(std::max(x, 0.0f), 1.0f) * float(size - 1);
+	int xindex = int(xindexf);
+	return Lerp(table[xindex], table[xindex + 1], xindexf - float(xindex));
+}
+
+// Solves the square system A x = b in place with Gauss-Jordan elimination and partial pivoting.
+// A is row major, and x is left in b. Returns false if it is singular.
+inline bool SolveLinearSystem(std::vector<double>& A, std::vector<double>& b, int size)
+{
+	for (int column = 0; column < size; ++column)
+	{
+		int bestRow = column;
+		for (int row = column + 1; row < size; ++row)
+		{
+			if (std::abs(A[row * size + column]) > std::abs(A[bestRow * size + column]))
+				bestRow = row;
+		}
+
+		if (std::abs(A[bestRow * size + column]) < 1e-300)
+			return false;
+
+		if (bestRow != column)
+		{
+			for (int i = 0; i < size; ++i)
+				std::swap(A[bestRow * size + i], A[column * size + i]);
+			std::swap(b[bestRow], b[column]);
+		}
+
+		double pivot = A[column * size + column];
+		for (int i = 0; i < size; ++i)
+			A[column * size + i] /= pivot;
+		b[column] /= pivot;
+
+		for (int row = 0; row < size; ++row)
+		{
+			if (row == column)
+				continue;
+
+			double multiplier = A[row * size + column];
+			if (multiplier == 0.0)
+				continue;
+
+			for (int i = 0; i < size; ++i)
+				A[row * size + i] -= A[column * size + i] * multiplier;
+			b[row] -= b[column] * multiplier;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include "mathutils.h"
+
+// Minimax fits of a CDF: piecewise polynomials and low order rational functions (a polynomial divided by a
+// polynomial, like a Pade approximant) that minimize the max error, instead of the RMSE like LeastSquaresPolynomialFit.
+// For a remap in the hot path, the worst case error and the multiplies per sample are what matter, so each fit
+// reports both, and a rational function can often get the same max error as a polynomial with fewer multiplies.
+//
+// The fits are made with the Remez exchange algorithm on the points of the CDF table:
+// * Solve for the fit whose error has equal size and alternating sign at a reference set of points.
+// * Move the reference to the peaks of the actual error.
+// * Repeat until the largest error is the same as the leveled error, which is the minimax fit.
+// Rational fits linearize the denominator with the one from the previous iteration, the usual way to do rational Remez.
+//
+// The pieces are fit independently, so unlike the least squares fit, there is no continuity constraint between them.
+// The jumps are no bigger than the max error, and are counted by CDFFitError as non monotonic points.
+//
+// The coefficients are stored the way BlueNoiseStreamPolynomial stores them: a float array per piece, highest power
+// first for Horner's method, in terms of x (not t across the piece), so CoefficientArrays() can be pasted in.
+struct RationalFit
+{
+	int numeratorOrder = 0;
+	int denominatorOrder = 0;
+	int pieces = 0;
+
+	// numerator[piece * (numeratorOrder + 1) + i] is the coefficient of x^(numeratorOrder - i) in that piece.
+	// The denominator is the same, and its constant term is always 1.
+	std::vector<float> numerator;
+	std::vector<float> denominator;
+
+	float RMSE = 0.0f;
+	float maxError = 0.0f;
+
+	// The same math as the code from CoefficientArrays(), in float, so the errors are what the stream would see
+	float Evaluate(float x) const
+	{
+		int piece = std::min(int(x * float(pieces)), pieces - 1);
+
+		const float* n = &numerator[piece * (numeratorOrder + 1)];
+		float ret = n[0];
+		for (int i = 1; i <= numeratorOrder; ++i)
+			ret = n[i] + x * ret;
+
+		if (denominatorOrder > 0)
+		{
+			const float* d = &denominator[piece * (denominatorOrder + 1)];
+			float divisor = d[0];
+			for (int i = 1; i <= denominatorOrder; ++i)
+				divisor = d[i] + x * divisor;
+			ret /= divisor;
+		}
+
+		return ret;
+	}
+
+	// Multiplies per sample, counting the one to find the piece
+	int Multiplies() const
+	{
+		return numeratorOrder + denominatorOrder + ((pieces > 1) ? 1 : 0);
+	}
+
+	int Divides() const
+	{
+		return (denominatorOrder > 0) ? 1 : 0;
+	}
+
+	std::string Description() const
+	{
+		std::stringstream description;
+		if (denominatorOrder > 0)
+			description << "Rational " << numeratorOrder << "/" << denominatorOrder;
+		else
+			description << "Polynomial O" << numeratorOrder;
+		description << " C" << pieces;
+		return description.str();
+	}
+
+	// Code for the remap, in the same layout as BlueNoiseStreamPolynomial
+	std::string CoefficientArrays() const
+	{
+		std::stringstream code;
+		code.precision(9);
+
+		auto WriteArray = [&](const char* name, const std::vector<float>& coefficients, int order)
+		{
+			code << "static const float " << name << "[" << coefficients.size() << "] = {\n";
+			for (int piece = 0; piece < pieces; ++piece)
+			{
+				code << "\t";
+				for (int i = 0; i <= order; ++i)
+				{
+					code << coefficients[piece * (order + 1) + i] << "f";
+					if (i < order)
+						code << ", ";
+					else if (piece + 1 < pieces)
+						code << ",";
+				}
+				code << "\n";
+			}
+			code << "};\n";
+		};
+
+		auto WriteHorner = [&](const std::string& name, int order)
+		{
+			std::string horner = name + "[first + 0]";
+			for (int i = 1; i <= order; ++i)
+				horner = name + "[first + " + std::to_string(i) + "] + x * (" + horner + ")";
+			return horner;
+		};
+
+		code << "// " << Description() << ": Max Error = " << maxError << ", RMSE = " << RMSE << ", " << Multiplies() << " multiplies, " << Divides() << " divides\n";
+		WriteArray("numeratorCoefficients", numerator, numeratorOrder);
+		if (denominatorOrder > 0)
+			WriteArray("denominatorCoefficients", denominator, denominatorOrder);
+
+		if (pieces > 1)
+			code << "int piece = std::min(int(x * " << pieces << ".0f), " << (pieces - 1) << ");\n";
+		else
+			code << "int piece = 0;\n";
+
+		code << "int first = piece * " << (numeratorOrder + 1) << ";\n";
+		if (denominatorOrder > 0)
+		{
+			code << "float numerator = " << WriteHorner("numeratorCoefficients", numeratorOrder) << ";\n";
+			code << "first = piece * " << (denominatorOrder + 1) << ";\n";
+			code << "return numerator / (" << WriteHorner("denominatorCoefficients", denominatorOrder) << ");\n";
+		}
+		else
+		{
+			code << "return " << WriteHorner("numeratorCoefficients", numeratorOrder) << ";\n";
+		}
+
+		return code.str();
+	}
+};
+
+namespace MinimaxFitInternal
+{
+	static const int c_maxIterations = 100;
+
+	// Stop once the largest error is within this fraction of the leveled error
+	static const double c_convergence = 1e-6;
+
+	inline double EvaluatePolynomial(const std::vector<double>& coefficients, double x)
+	{
+		// coefficients[i] is for x^i
+		double ret = 0.0;
+		for (size_t i = coefficients.size(); i > 0; --i)
+			ret = coefficients[i - 1] + x * ret;
+		return ret;
+	}
+
+	// The roots of the polynomial in [begin, end], lowest power first like EvaluatePolynomial. Between the roots of
+	// its derivative the polynomial is monotonic, so has at most one root there, which bisection finds. The roots of
+	// the derivative come the same way, one order down.
+	inline std::vector<double> PolynomialRoots(const std::vector<double>& coefficients, double begin, double end)
+	{
+		std::vector<double> stretches = { begin };
+		if (coefficients.size() > 2)
+		{
+			std::vector<double> derivative(coefficients.size() - 1);
+			for (size_t i = 1; i < coefficients.size(); ++i)
+				derivative[i - 1] = coefficients[i] * double(i);
+			std::vector<double> turns = PolynomialRoots(derivative, begin, end);
+			stretches.insert(stretches.end(), turns.begin(), turns.end());
+		}
+		stretches.push_back(end);
+
+		std::vector<double> ret;
+		for (size_t stretch = 0; stretch + 1 < stretches.size(); ++stretch)
+		{
+			double low = stretches[stretch];
+			double high = stretches[stretch + 1];
+			double lowValue = EvaluatePolynomial(coefficients, low);
+			double highValue = EvaluatePolynomial(coefficients, high);
+			if ((lowValue < 0.0) == (highValue < 0.0) && lowValue != 0.0 && highValue != 0.0)
+				continue;
+
+			for (int iteration = 0; iteration < 64; ++iteration)
+			{
+				double middle = 0.5 * (low + high);
+				if ((EvaluatePolynomial(coefficients, middle) < 0.0) == (lowValue < 0.0))
+					low = middle;
+				else
+					high = middle;
+			}
+			ret.push_back(0.5 * (low + high));
+		}
+		return ret;
+	}
+
+	// The smallest value of the polynomial over [begin, end], which is at an end, or where the derivative is 0
+	inline double PolynomialMinimum(const std::vector<double>& coefficients, double begin, double end)
+	{
+		double ret = std::min(EvaluatePolynomial(coefficients, begin), EvaluatePolynomial(coefficients, end));
+		if (coefficients.size() < 3)
+			return ret;
+
+		std::vector<double> derivative(coefficients.size() - 1);
+		for (size_t i = 1; i < coefficients.size(); ++i)
+			derivative[i - 1] = coefficients[i] * double(i);
+		for (double x : PolynomialRoots(derivative, begin, end))
+			ret = std::min(ret, EvaluatePolynomial(coefficients, x));
+		return ret;
+	}
+
+	// Fits P(x)/Q(x) to the points with Remez exchange. P and Q are returned lowest power first, and Q[0] = 1.
+	// Returns false if the system is singular, or there are too few points. A Q that isn't positive everywhere in
+	// [begin, end], the interval the fit is used over, has a pole, and ends the fit, keeping the best before it.
+	inline bool RemezFit(const std::vector<double>& X, const std::vector<double>& Y, double begin, double end, int numeratorOrder, int denominatorOrder, std::vector<double>& P, std::vector<double>& Q)
+	{
+		const int pointCount = (int)X.size();
+		const int referenceCount = numeratorOrder + denominatorOrder + 2;
+		if (pointCount < referenceCount)
+			return false;
+
+		// start the reference at the Chebyshev nodes, which is close to where the minimax error peaks are
+		std::vector<int> reference(referenceCount);
+		for (int k = 0; k < referenceCount; ++k)
+		{
+			double node = 0.5 - 0.5 * std::cos(3.14159265358979323846 * double(k) / double(referenceCount - 1));
+			reference[k] = std::min(std::max(int(std::round(node * double(pointCount - 1))), k), pointCount - referenceCount + k);
+			if (k > 0)
+				reference[k] = std::max(reference[k], reference[k - 1] + 1);
+		}
+
+		std::vector<double> lastQ(pointCount, 1.0);
+		std::vector<double> error(pointCount);
+		std::vector<double> A(referenceCount * referenceCount);
+		std::vector<double> b(referenceCount);
+		std::vector<double> trialP, trialQ;
+		double bestMaxError = HUGE_VAL;
+
+		for (int iteration = 0; iteration < c_maxIterations; ++iteration)
+		{
+			// P(x_k) - y_k * (Q(x_k) - 1) - (-1)^k * E * lastQ(x_k) = y_k
+			for (int k = 0; k < referenceCount; ++k)
+			{
+				int point = reference[k];
+				double x = X[point];
+				double* row = &A[k * referenceCount];
+				int column = 0;
+
+				double xpow = 1.0;
+				for (int i = 0; i <= numeratorOrder; ++i, xpow *= x)
+					row[column++] = xpow;
+
+				xpow = x;
+				for (int i = 1; i <= denominatorOrder; ++i, xpow *= x)
+					row[column++] = -Y[point] * xpow;
+
+				row[column] = ((k % 2 == 0) ? -1.0 : 1.0) * lastQ[point];
+				b[k] = Y[point];
+			}
+
+			if (!SolveLinearSystem(A, b, referenceCount))
+				break;
+
+			trialP.assign(b.begin(), b.begin() + numeratorOrder + 1);
+			trialQ.assign(1, 1.0);
+			trialQ.insert(trialQ.end(), b.begin() + numeratorOrder + 1, b.begin() + numeratorOrder + 1 + denominatorOrder);
+			double leveledError = std::abs(b[referenceCount - 1]);
+
+			// the error at every point, giving up on the fit if there's a pole, which can be between the points
+			bool pole = (denominatorOrder > 0) && (PolynomialMinimum(trialQ, begin, end) <= 0.0);
+			double maxError = 0.0;
+			for (int point = 0; point < pointCount; ++point)
+			{
+				double q = EvaluatePolynomial(trialQ, X[point]);
+				if (q <= 0.0)
+					pole = true;
+				lastQ[point] = q;
+				error[point] = Y[point] - EvaluatePolynomial(trialP, X[point]) / q;
+				maxError = std::max(maxError, std::abs(error[point]));
+			}
+			if (pole)
+				break;
+
+			if (maxError < bestMaxError)
+			{
+				bestMaxError = maxError;
+				P = trialP;
+				Q = trialQ;
+			}
+
+			if (maxError <= leveledError * (1.0 + c_convergence) + 1e-12)
+				break;
+
+			// The new reference is the peak of each run of same signed error, which alternate in sign
+			std::vector<int> peaks;
+			for (int point = 0; point < pointCount; ++point)
+			{
+				if (error[point] == 0.0)
+					continue;
+
+				if (!peaks.empty() && ((error[point] > 0.0) == (error[peaks.back()] > 0.0)))
+				{
+					if (std::abs(error[point]) > std::abs(error[peaks.back()]))
+						peaks.back() = point;
+				}
+				else
+				{
+					peaks.push_back(point);
+				}
+			}
+
+			// too few peaks means the error can't be leveled any more than it is
+			if ((int)peaks.size() < referenceCount)
+				break;
+
+			// drop the smaller end peak until there are the right number, which keeps the largest error in the reference
+			size_t begin = 0;
+			size_t end = peaks.size();
+			while (int(end - begin) > referenceCount)
+			{
+				if (std::abs(error[peaks[begin]]) < std::abs(error[peaks[end - 1]]))
+					begin++;
+				else
+					end--;
+			}
+			reference.assign(peaks.begin() + begin, peaks.begin() + end);
+		}
+
+		return bestMaxError < HUGE_VAL;
+	}
+}
+
+// Makes a piecewise minimax fit of the CDF. A denominatorOrder of 0 makes a polynomial.
+// Returns false if any piece fails to fit, such as a rational function that has a pole in the piece.
+inline bool MinimaxFit(const std::vector<float>& CDF, int numeratorOrder, int denominatorOrder, int pieces, RationalFit& fit)
+{
+	using namespace MinimaxFitInternal;
+
+	fit.numeratorOrder = numeratorOrder;
+	fit.denominatorOrder = denominatorOrder;
+	fit.pieces = pieces;
+	fit.numerator.resize((numeratorOrder + 1) * pieces);
+	fit.denominator.resize((denominatorOrder + 1) * pieces);
+
+	for (int piece = 0; piece < pieces; ++piece)
+	{
+		// the points of the CDF table that Evaluate() puts in this piece
+		std::vector<double> X, Y;
+		for (size_t i = 0; i < CDF.size(); ++i)
+		{
+			float x = float(i) / float(CDF.size() - 1);
+			if (std::min(int(x * float(pieces)), pieces - 1) != piece)
+				continue;
+			X.push_back(x);
+			Y.push_back(CDF[i]);
+		}
+
+		std::vector<double> P, Q;
+		if (!RemezFit(X, Y, double(piece) / double(pieces), double(piece + 1) / double(pieces), numeratorOrder, denominatorOrder, P, Q))
+			return false;
+
+		for (int i = 0; i <= numeratorOrder; ++i)
+			fit.numerator[piece * (numeratorOrder + 1) + i] = float(P[numeratorOrder - i]);
+		for (int i = 0; i <= denominatorOrder; ++i)
+			fit.denominator[piece * (denominatorOrder + 1) + i] = float(Q[denominatorOrder - i]);
+	}
+
+	// measure the error of the float version
+	fit.RMSE = 0.0f;
+	fit.maxError = 0.0f;
+	for (size_t i = 0; i < CDF.size(); ++i)
+	{
+		float x = float(i) / float(CDF.size() - 1);
+		float value = fit.Evaluate(x);
+		if (!std::isfinite(value))
+			return false;
+		float error = std::abs(CDF[i] - value);
+		fit.RMSE += error * error;
+		fit.maxError = std::max(fit.maxError, error);
+	}
+	fit.RMSE = std::sqrt(fit.RMSE / float(CDF.size()));
+
+	return true;
+}
+
+// The fits that are on the pareto front of max error and cost: no other fit is both as cheap and more accurate.
+// The cost counts a divide as c_divideCost multiplies, which is roughly their latency ratio.
+inline std::vector<RationalFit> MinimaxParetoFront(std::vector<RationalFit> fits)
+{
+	static const int c_divideCost = 4;
+	auto Cost = [](const RationalFit& fit) { return fit.Multiplies() + fit.Divides() * c_divideCost; };
+
+	std::sort(fits.begin(), fits.end(),
+		[&](const RationalFit& A, const RationalFit& B)
+		{
+			if (Cost(A) != Cost(B))
+				return Cost(A) < Cost(B);
+			return A.maxError < B.maxError;
+		}
+	);
+
+	std::vector<RationalFit> front;
+	for (const RationalFit& fit : fits)
+	{
+		if (front.empty() || fit.maxError < front.back().maxError)
+			front.push_back(fit);
+	}
+	return front;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// A piecewise cubic Hermite curve fit to a CDF, which is guaranteed to be monotonic and stay in [0,1].
+// The least squares polynomial fits can wiggle, which makes the "devil horns" in the histograms, and can go out of range.
+//
+// The knots are evenly spaced in x, and their y values come from the CDF table, with y(0) = 0 and y(1) = 1.
+// The slopes at the knots are made with the Fritsch-Carlson method, which limits them so each piece can't overshoot.
+// https://en.wikipedia.org/wiki/Monotone_cubic_interpolation
+//
+// Each piece is stored as 4 coefficients for Horner's method, in terms of t in [0,1] across the piece, so it can be
+// evaluated without branching, the same way as BlueNoiseStreamPolynomial.
+class MonotoneCubicFit
+{
+public:
+	void Fit(const std::vector<float>& CDF, int pieces)
+	{
+		m_pieces = pieces;
+
+		// get the knot values from the CDF, making sure they are monotonic, and hit 0 and 1 at the ends.
+		std::vector<double> y(pieces + 1);
+		for (int i = 0; i <= pieces; ++i)
+		{
+			float x = float(i) / float(pieces);
+			y[i] = SampleCDF(CDF, x);
+		}
+		y[0] = 0.0;
+		y[pieces] = 1.0;
+		for (int i = 1; i <= pieces; ++i)
+			y[i] = std::min(std::max(y[i], y[i - 1]), 1.0);
+
+		// the slope of the line between each knot
+		const double h = 1.0 / double(pieces);
+		std::vector<double> secants(pieces);
+		for (int i = 0; i < pieces; ++i)
+			secants[i] = (y[i + 1] - y[i]) / h;
+
+		// initial slopes at the knots are the average of the secants on either side
+		std::vector<double> slopes(pieces + 1);
+		slopes[0] = secants[0];
+		slopes[pieces] = secants[pieces - 1];
+		for (int i = 1; i < pieces; ++i)
+		{
+			if (secants[i - 1] * secants[i] <= 0.0)
+				slopes[i] = 0.0;
+			else
+				slopes[i] = (secants[i - 1] + secants[i]) * 0.5;
+		}
+
+		// limit the slopes so that the pieces are monotonic
+		for (int i = 0; i < pieces; ++i)
+		{
+			if (secants[i] == 0.0)
+			{
+				slopes[i] = 0.0;
+				slopes[i + 1] = 0.0;
+				continue;
+			}
+
+			double alpha = slopes[i] / secants[i];
+			double beta = slopes[i + 1] / secants[i];
+			double length = alpha * alpha + beta * beta;
+			if (length > 9.0)
+			{
+				double tau = 3.0 / std::sqrt(length);
+				slopes[i] = tau * alpha * secants[i];
+				slopes[i + 1] = tau * beta * secants[i];
+			}
+		}
+
+		// convert each piece from Hermite form to a cubic in t, highest power first
+		m_coefficients.resize(pieces * 4);
+		for (int i = 0; i < pieces; ++i)
+		{
+			double y0 = y[i];
+			double y1 = y[i + 1];
+			double m0 = slopes[i] * h;
+			double m1 = slopes[i + 1] * h;
+
+			m_coefficients[i * 4 + 0] = float(2.0 * y0 - 2.0 * y1 + m0 + m1);
+			m_coefficients[i * 4 + 1] = float(-3.0 * y0 + 3.0 * y1 - 2.0 * m0 - m1);
+			m_coefficients[i * 4 + 2] = float(m0);
+			m_coefficients[i * 4 + 3] = float(y0);
+		}
+	}
+
+	float Evaluate(float x) const
+	{
+		float xf = x * float(m_pieces);
+		int piece = std::min(int(xf), m_pieces - 1);
+		float t = xf - float(piece);
+		int first = piece * 4;
+		return m_coefficients[first + 3] + t * (m_coefficients[first + 2] + t * (m_coefficients[first + 1] + t * m_coefficients[first + 0]));
+	}
+
+	int Pieces() const { return m_pieces; }
+	const std::vector<float>& Coefficients() const { return m_coefficients; }
+
+private:
+	// The CDF table entries are at evenly spaced x values in [0,1], like FindBestPolynomialFit treats them.
+	static double SampleCDF(const std::vector<float>& CDF, float x)
+	{
+		float indexf = x * float(CDF.size() - 1);
+		int index1 = std::min(int(indexf), (int)CDF.size() - 1);
+		int index2 = std::min(index1 + 1, (int)CDF.size() - 1);
+		float fract = indexf - float(index1);
+		return CDF[index1] * (1.0f - fract) + CDF[index2] * fract;
+	}
+
+	int m_pieces = 0;
+	std::vector<float> m_coefficients;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "pcg/pcg_basic.h"
+#include "spmd.h"
+#include "dispatch.h"
+
+// Many independent noise channels, such as one per pixel or per particle, advanced together.
+// A stream object per channel keeps its PCG state, filter history and program together, so stepping thousands of
+// them is a loop over objects, each a separate small load and store, which doesn't vectorize.
+// This keeps each part of the state in its own array instead (structure of arrays), 24 bytes per channel:
+// * state and inc, the PCG32 generator of each channel
+// * lastValues0 and lastValues1, the white noise history of the filter
+// A step is one pass over those arrays, with no branches or dependencies between channels, so it vectorizes like
+// NoiseStreamSPMD does, and streams through memory in order. The remap looks up coefficients per channel, which needs
+// the gathers of AVX2, so the step is also compiled for AVX2 and AVX-512, and picked like the kernels of dispatch.h.
+//
+// Channel c gives the same values as a NoiseStreamSPMD<1, PROGRAM> made from the same pcg32_random_t, such as
+// BlueNoiseStreamPolynomial for BlueNoisePolynomialProgram.
+template <typename PROGRAM>
+class NoiseStreamChannels
+{
+public:
+	// How many channels Next(out, steps) runs through all the steps before moving on, which is 12KB of state, so it
+	// stays in L1 for the steps instead of streaming from memory each step
+	static const size_t c_channelBlockSize = 512;
+
+	// rngs has channelCount generators, one per channel
+	NoiseStreamChannels(const pcg32_random_t* rngs, size_t channelCount, const PROGRAM& program = PROGRAM())
+		: m_program(program)
+	{
+		m_state.resize(channelCount);
+		m_inc.resize(channelCount);
+		for (size_t channel = 0; channel < channelCount; ++channel)
+		{
+			m_state[channel] = rngs[channel].state;
+			m_inc[channel] = rngs[channel].inc;
+		}
+		Start();
+	}
+
+	// Makes channelCount channels, all seeded with the same seed, but each with a different stream id, like
+	// NoiseStreamPool
+	NoiseStreamChannels(uint64_t seed, size_t channelCount, const PROGRAM& program = PROGRAM())
+		: m_program(program)
+	{
+		m_state.resize(channelCount);
+		m_inc.resize(channelCount);
+		for (size_t channel = 0; channel < channelCount; ++channel)
+		{
+			pcg32_random_t rng;
+			pcg32_srandom_r(&rng, seed, channel);
+			m_state[channel] = rng.state;
+			m_inc[channel] = rng.inc;
+		}
+		Start();
+	}
+
+	size_t ChannelCount() const
+	{
+		return m_state.size();
+	}
+
+	// Advances every channel one step, writing the value of channel c to out[c]
+	void Next(float* out)
+	{
+		Step(0, ChannelCount(), out);
+	}
+
+	// Advances every channel steps steps, writing the value of channel c at step s to out[s * ChannelCount() + c].
+	// The same values as calling Next(out) steps times, but a block of channels at a time.
+	void Next(float* out, size_t steps)
+	{
+		const size_t channelCount = ChannelCount();
+		for (size_t blockBegin = 0; blockBegin < channelCount; blockBegin += c_channelBlockSize)
+		{
+			const size_t blockEnd = std::min(blockBegin + c_channelBlockSize, channelCount);
+			for (size_t step = 0; step < steps; ++step)
+				Step(blockBegin, blockEnd, out + step * channelCount);
+		}
+	}
+
+	const PROGRAM& Program() const
+	{
+		return m_program;
+	}
+
+private:
+	// The same as NoiseStreamSPMD's constructor, reading the first two values of each channel into the history
+	void Start()
+	{
+		const size_t channelCount = ChannelCount();
+		m_lastValues0.resize(channelCount);
+		m_lastValues1.resize(channelCount);
+		for (size_t channel = 0; channel < channelCount; ++channel)
+		{
+			m_lastValues0[channel] = NextFloat01(m_state[channel], m_inc[channel]);
+			m_lastValues1[channel] = NextFloat01(m_state[channel], m_inc[channel]);
+		}
+	}
+
+	static float NextFloat01(uint64_t& state, uint64_t inc)
+	{
+		uint64_t oldstate = state;
+		state = oldstate * SPMDInternal::c_pcg32Multiplier + inc;
+		return float(SPMDInternal::PCG32Output(oldstate)) * SPMDInternal::c_uint32ToFloat01;
+	}
+
+	void Step(size_t begin, size_t end, float* out)
+	{
+		const DispatchISA ISA = Kernels().ISA;
+		auto step = (ISA == DispatchISA::AVX512) ? &StepAVX512 : (ISA == DispatchISA::AVX2) ? &StepAVX2 : &StepDefault;
+		step(m_program, m_state.data() + begin, m_inc.data() + begin, m_lastValues0.data() + begin, m_lastValues1.data() + begin,
+			out + begin, end - begin);
+	}
+
+	// One step of count channels. The arrays are restrict parameters, so the compiler knows the stores don't change
+	// them or the program's tables, and vectorizes the loop. The loop has to be in the function that is compiled for
+	// the instruction set, not inlined into it, for GCC to vectorize it.
+#define NOISE_STREAM_CHANNELS_STEP(NAME, TARGET) \
+	TARGET static void NAME(const PROGRAM& program, uint64_t* __restrict state, const uint64_t* __restrict inc, \
+		float* __restrict lastValues0, float* __restrict lastValues1, float* __restrict out, size_t count) \
+	{ \
+		for (size_t channel = 0; channel < count; ++channel) \
+		{ \
+			float value = NextFloat01(state[channel], inc[channel]); \
+			out[channel] = NoiseStreamSPMD<1, PROGRAM>::Evaluate(program, value, lastValues0[channel], lastValues1[channel]); \
+			lastValues1[channel] = lastValues0[channel]; \
+			lastValues0[channel] = value; \
+		} \
+	}
+
+	NOISE_STREAM_CHANNELS_STEP(StepDefault, )
+#if DISPATCH_X86_TARGETS()
+	NOISE_STREAM_CHANNELS_STEP(StepAVX2, __attribute__((target("avx2"))))
+	NOISE_STREAM_CHANNELS_STEP(StepAVX512, __attribute__((target("avx512f,avx512dq,avx512vl,avx512bw"))))
+#else
+	NOISE_STREAM_CHANNELS_STEP(StepAVX2, )
+	NOISE_STREAM_CHANNELS_STEP(StepAVX512, )
+#endif
+#undef NOISE_STREAM_CHANNELS_STEP
+
+	PROGRAM m_program;
+	std::vector<uint64_t> m_state;
+	std::vector<uint64_t> m_inc;
+	std::vector<float> m_lastValues0;
+	std::vector<float> m_lastValues1;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "pcg/pcg_basic.h"
+
+// A pool of noise streams for when many threads need noise at once, such as jobs in a job system.
+// The streams have state, so sharing one between threads needs a lock, and making a new stream per job starts the
+// filter over, which loses the blue noise property across the samples of the job.
+// Instead, each slot in the pool is a stream that lives for the life of the pool:
+// * Each slot has its own PCG stream id, so the slots give independent sequences from the same seed.
+// * Slots are cache line aligned, so threads using neighboring slots don't false share.
+// * Checkout() and Return() are a lock free stack, for short lived tasks that want a stream for a little while.
+// * ThreadLocalSlot() keeps a slot checked out for the life of the calling thread, for long lived worker threads.
+// * Each slot has a ring buffer that is refilled in bulk, so most calls to Next() are just a load.
+//
+// STREAM is one of the noise stream classes that is constructed from a pcg32_random_t, such as BlueNoiseStreamLUT.
+template <typename STREAM, size_t RING_SIZE = 256>
+class NoiseStreamPool
+{
+public:
+	typedef decltype(std::declval<STREAM&>().Next()) Value;
+
+	static const size_t c_cacheLineSize = 64;
+
+	struct alignas(c_cacheLineSize) Slot
+	{
+		Slot(pcg32_random_t rng, uint32_t index)
+			: stream(rng)
+			, index(index)
+		{
+		}
+
+		// Only one thread uses a slot at a time, so this needs no synchronization
+		Value Next()
+		{
+			if (ringIndex == RING_SIZE)
+				Refill();
+			return ring[ringIndex++];
+		}
+
+		// Run the stream for a whole ring buffer at once, which keeps the stream state in registers for the loop
+		void Refill()
+		{
+			for (Value& value : ring)
+				value = stream.Next();
+			ringIndex = 0;
+		}
+
+		STREAM stream;
+		Value ring[RING_SIZE];
+		size_t ringIndex = RING_SIZE;
+
+		// for the free list. next is the index + 1 of the next free slot, or 0 for the end of the list.
+		uint32_t index;
+		std::atomic<uint32_t> next{ 0 };
+	};
+
+	// Makes slotCount streams, all seeded with the same seed, but each with a different stream id
+	NoiseStreamPool(uint64_t seed, uint32_t slotCount)
+		: m_id(NextPoolId())
+	{
+		{
+			std::lock_guard<std::mutex> lock(LivePoolsMutex());
+			LivePools().insert(m_id);
+		}
+
+		m_slots.reserve(slotCount);
+		for (uint32_t index = 0; index < slotCount; ++index)
+		{
+			pcg32_random_t rng;
+			pcg32_srandom_r(&rng, seed, index);
+			m_slots.emplace_back(new Slot(rng, index));
+		}
+
+		for (uint32_t index = slotCount; index > 0; --index)
+			Return(m_slots[index - 1].get());
+	}
+
+	// Threads that still have a ThreadLocalSlot() of this pool forget it, and don't return it when they exit
+	~NoiseStreamPool()
+	{
+		std::lock_guard<std::mutex> lock(LivePoolsMutex());
+		LivePools().erase(m_id);
+	}
+
+	NoiseStreamPool(const NoiseStreamPool&) = delete;
+	NoiseStreamPool& operator=(const NoiseStreamPool&) = delete;
+
+	// Returns a free slot, or nullptr if they are all checked out. Lock free.
+	Slot* Checkout()
+	{
+		uint64_t head = m_freeHead.load(std::memory_order_acquire);
+		while (true)
+		{
+			uint32_t slotIndex = uint32_t(head & 0xFFFFFFFF);
+			if (slotIndex == 0)
+				return nullptr;
+
+			Slot* slot = m_slots[slotIndex - 1].get();
+			uint64_t newHead = NextTag(head) | slot->next.load(std::memory_order_relaxed);
+			if (m_freeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+				return slot;
+		}
+	}
+
+	// Gives a slot from Checkout() back to the pool. The stream keeps its state, so the next user continues it. Lock free.
+	void Return(Slot* slot)
+	{
+		uint64_t head = m_freeHead.load(std::memory_order_relaxed);
+		while (true)
+		{
+			slot->next.store(uint32_t(head & 0xFFFFFFFF), std::memory_order_relaxed);
+			uint64_t newHead = NextTag(head) | (slot->index + 1);
+			if (m_freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed))
+				return;
+		}
+	}
+
+	// The slot the calling thread owns in this pool, checked out the first time it's called on a thread, and returned
+	// when the thread exits, if the pool is still alive. Returns nullptr if the pool has run out of slots.
+	// The thread's slots are found by the pool's id, not its address, since a new pool can be made at the address of
+	// one that was destroyed.
+	Slot* ThreadLocalSlot()
+	{
+		thread_local ThreadSlots threadSlots;
+		for (const ThreadSlot& threadSlot : threadSlots.slots)
+		{
+			if (threadSlot.poolId == m_id)
+				return threadSlot.slot;
+		}
+
+		Slot* slot = Checkout();
+		if (slot)
+			threadSlots.slots.push_back({ this, m_id, slot });
+		return slot;
+	}
+
+	uint32_t SlotCount() const
+	{
+		return (uint32_t)m_slots.size();
+	}
+
+	// How many slots are in the free list. Only exact when no other thread is checking out or returning slots, so is
+	// for tests and stats.
+	uint32_t FreeSlotCount() const
+	{
+		uint32_t count = 0;
+		uint32_t slotIndex = uint32_t(m_freeHead.load(std::memory_order_acquire) & 0xFFFFFFFF);
+		while (slotIndex != 0 && count < m_slots.size())
+		{
+			count++;
+			slotIndex = m_slots[slotIndex - 1]->next.load(std::memory_order_relaxed);
+		}
+		return count;
+	}
+
+private:
+	// The free list head is packed as the tag in the high 32 bits, and the index + 1 of the first free slot in the low
+	// 32 bits. The tag changes on every push and pop, so a compare exchange fails if the head was popped and pushed
+	// back in between (the ABA problem).
+	static uint64_t NextTag(uint64_t head)
+	{
+		return ((head >> 32) + 1) << 32;
+	}
+
+	// Every pool gets a different id, for as long as the program runs
+	static uint64_t NextPoolId()
+	{
+		static std::atomic<uint64_t> nextId{ 1 };
+		return nextId++;
+	}
+
+	// The ids of the pools that haven't been destroyed. The mutex is held while a thread that is exiting returns its
+	// slots, so a pool can't be destroyed while that happens.
+	static std::mutex& LivePoolsMutex()
+	{
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	static std::unordered_set<uint64_t>& LivePools()
+	{
+		static std::unordered_set<uint64_t> livePools;
+		return livePools;
+	}
+
+	struct ThreadSlot
+	{
+		NoiseStreamPool* pool;
+		uint64_t poolId;
+		Slot* slot;
+	};
+
+	// The slots of each pool a thread has used, which are returned when the thread exits
+	struct ThreadSlots
+	{
+		~ThreadSlots()
+		{
+			std::lock_guard<std::mutex> lock(LivePoolsMutex());
+			for (const ThreadSlot& threadSlot : slots)
+			{
+				if (LivePools().count(threadSlot.poolId) > 0)
+					threadSlot.pool->Return(threadSlot.slot);
+			}
+		}
+
+		std::vector<ThreadSlot> slots;
+	};
+
+	uint64_t m_id;
+	std::vector<std::unique_ptr<Slot>> m_slots;
+	alignas(c_cacheLineSize) std::atomic<uint64_t> m_freeHead{ 0 };
+};
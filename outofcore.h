@@ -0,0 +1,515 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pcg/pcg_basic.h"
+#include "mathutils.h"
+#include "spmd.h"
+#include "platform.h"
+#include "dispatch.h"
+
+// Characterizing a filter over far more samples than fit in memory, such as 10^10, to find the rare things that
+// 10 million samples don't show, like a value landing exactly on a CDF endpoint once in a billion samples.
+//
+// The samples are made in fixed size chunks, which are independent, so they run on all cores:
+// * Chunk c starts the PCG generator at sample c * chunkSize with a jump (PCG32AdvanceState), so the chunks are the
+//   same sequence that a single run would make, no matter how many threads there are.
+// * Each chunk first runs the filter for warmup samples without keeping them, so the filter history is full.
+//   That is exact for an FIR filter with warmup = taps - 1, and as close as the impulse response has decayed for IIR.
+// * The values are folded into an accumulator (histograms and counts), which merges with the others by adding.
+//   Nothing is kept per sample, so the memory used doesn't depend on the sample count.
+// * After each chunk, the merged accumulator and which chunks are done are saved to a checkpoint file, and the chunk's
+//   own results are added to a CSV. A run that is stopped picks up from the checkpoint when started again.
+//   The checkpoint also has the length of the CSV, which is cut back to that on resume, so the rows of chunks that
+//   finished after the last checkpoint, and will run again, don't show up twice.
+
+static const char* c_outOfCoreDirectory = "outofcore";
+static const uint32_t c_outOfCoreMagic = 0x434F4F54; // "TOOC"
+static const uint32_t c_outOfCoreVersion = 2;
+
+// Resolution of the histogram of the normalized values, which the CDF tables are made from
+static const size_t c_outOfCoreHistogramBins = 1 << 16;
+
+// Resolution of the histogram of the remapped values, which should be flat
+static const size_t c_outOfCoreRemapBins = 1024;
+
+// The tail histograms count values by how many powers of 2 they are from the end, out to 2^-63
+static const int c_outOfCoreTailBins = 64;
+
+struct OutOfCoreOptions
+{
+	// Used for the file names
+	std::string name;
+
+	std::vector<float> xCoefficients;
+	std::vector<float> yCoefficients;
+
+	// Values are normalized to [0,1] with these, like SequenceTest with analytic bounds (FIRBounds, IIRBounds)
+	float boundsMin = 0.0f;
+	float boundsMax = 1.0f;
+
+	uint64_t seed = 0;
+	uint64_t sampleCount = 0;
+	uint64_t chunkSize = 0;
+	uint32_t warmup = 0;
+
+	// The CDF table to remap the normalized values through, to find where the remap clamps. Empty to skip that.
+	std::vector<float> remapTable;
+
+	// 0 uses all the cores
+	unsigned int threadCount = 0;
+};
+
+// Everything kept about the samples. All of it is counts, so accumulators merge by adding.
+struct OutOfCoreAccumulator
+{
+	uint64_t count = 0;
+
+	// normalized values outside of [0,1], before they are clamped. Only an IIR filter should have any.
+	uint64_t belowZero = 0;
+	uint64_t aboveOne = 0;
+	float min = 1.0f;
+	float max = 0.0f;
+
+	// normalized values exactly at the ends, after clamping
+	uint64_t exactZero = 0;
+	uint64_t exactOne = 0;
+
+	// lowTail[i] counts values with 2^-(i+1) <= x < 2^-i, highTail[i] the same for 1 - x.
+	// The last bin also has everything closer than that, other than exactly 0 or 1.
+	uint64_t lowTail[c_outOfCoreTailBins] = {};
+	uint64_t highTail[c_outOfCoreTailBins] = {};
+
+	std::vector<uint64_t> histogram = std::vector<uint64_t>(c_outOfCoreHistogramBins, 0);
+
+	// the remapped values that are exactly 0 or 1, which is where the remap clamps
+	uint64_t remappedZero = 0;
+	uint64_t remappedOne = 0;
+	std::vector<uint64_t> remappedHistogram = std::vector<uint64_t>(c_outOfCoreRemapBins, 0);
+
+	// x are the normalized values, before clamping
+	void Add(const float* x, size_t xCount)
+	{
+		count += xCount;
+		for (size_t index = 0; index < xCount; ++index)
+		{
+			float value = x[index];
+			min = std::min(min, value);
+			max = std::max(max, value);
+			belowZero += (value < 0.0f) ? 1 : 0;
+			aboveOne += (value > 1.0f) ? 1 : 0;
+
+			value = std::min(std::max(value, 0.0f), 1.0f);
+			if (value == 0.0f)
+				exactZero++;
+			else if (value == 1.0f)
+				exactOne++;
+			else if (value < 0.5f)
+				lowTail[TailBin(value)]++;
+			else
+				highTail[TailBin(1.0f - value)]++;
+		}
+
+		// the histogram kernel clamps too
+		Kernels().Histogram(x, xCount, histogram.data(), histogram.size());
+	}
+
+	void AddRemapped(const float* y, size_t yCount)
+	{
+		for (size_t index = 0; index < yCount; ++index)
+		{
+			remappedZero += (y[index] == 0.0f) ? 1 : 0;
+			remappedOne += (y[index] == 1.0f) ? 1 : 0;
+		}
+		Kernels().Histogram(y, yCount, remappedHistogram.data(), remappedHistogram.size());
+	}
+
+	void Merge(const OutOfCoreAccumulator& other)
+	{
+		count += other.count;
+		belowZero += other.belowZero;
+		aboveOne += other.aboveOne;
+		min = std::min(min, other.min);
+		max = std::max(max, other.max);
+		exactZero += other.exactZero;
+		exactOne += other.exactOne;
+		for (int i = 0; i < c_outOfCoreTailBins; ++i)
+		{
+			lowTail[i] += other.lowTail[i];
+			highTail[i] += other.highTail[i];
+		}
+		for (size_t i = 0; i < histogram.size(); ++i)
+			histogram[i] += other.histogram[i];
+		remappedZero += other.remappedZero;
+		remappedOne += other.remappedOne;
+		for (size_t i = 0; i < remappedHistogram.size(); ++i)
+			remappedHistogram[i] += other.remappedHistogram[i];
+	}
+
+	// A CDF table of the given size made from the histogram, in the same layout as MakeCDFTablePyramid, where entry i
+	// is the fraction of values below (i + 0.5) / size. Values are assumed to be spread evenly within a histogram bin.
+	std::vector<float> CDFTable(size_t size) const
+	{
+		std::vector<float> table(size);
+		size_t bin = 0;
+		uint64_t below = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			double percent = (double(i) + 0.5) / double(size);
+			double binf = percent * double(c_outOfCoreHistogramBins);
+			while (bin < histogram.size() && double(bin + 1) <= binf)
+				below += histogram[bin++];
+			double partial = (bin < histogram.size()) ? double(histogram[bin]) * (binf - double(bin)) : 0.0;
+			table[i] = (count > 0) ? float((double(below) + partial) / double(count)) : 0.0f;
+		}
+		return table;
+	}
+
+	static int TailBin(float distance)
+	{
+		int exponent;
+		std::frexp(distance, &exponent);
+		return std::min(-exponent, c_outOfCoreTailBins - 1);
+	}
+};
+
+// Runs the filter of the options from any point in the sequence
+class OutOfCoreFilter
+{
+public:
+	static const size_t c_blockSize = 4096;
+
+	OutOfCoreFilter(const OutOfCoreOptions& options, const pcg32_random_t& rng, uint64_t start)
+		: m_xCoefficients(options.xCoefficients)
+		, m_yCoefficients(options.yCoefficients)
+		, m_state(PCG32AdvanceState(rng.state, rng.inc, start))
+		, m_inc(rng.inc)
+		, m_white(m_xCoefficients.size() - 1 + c_blockSize, 0.0f)
+		, m_filtered(m_yCoefficients.size() + c_blockSize, 0.0f)
+	{
+	}
+
+	// Writes up to c_blockSize values. The first taps - 1 values see zeros as history, which the warmup hides.
+	void Next(float* out, size_t count)
+	{
+		const size_t xHistory = m_xCoefficients.size() - 1;
+		const size_t yHistory = m_yCoefficients.size();
+
+		pcg32_random_t rng = { m_state, m_inc };
+		Kernels().UniformFloats(rng, &m_white[xHistory], count);
+		m_state = rng.state;
+
+		// the same math as IIRTest, once the history is full
+		for (size_t index = 0; index < count; ++index)
+		{
+			float value = 0.0f;
+			for (size_t xIndex = 0; xIndex < m_xCoefficients.size(); ++xIndex)
+				value += m_xCoefficients[xIndex] * m_white[xHistory + index - xIndex];
+			for (size_t yIndex = 0; yIndex < yHistory; ++yIndex)
+				value += m_yCoefficients[yIndex] * m_filtered[yHistory + index - yIndex - 1];
+			m_filtered[yHistory + index] = value;
+			out[index] = value;
+		}
+
+		// keep the end of this block as the history for the next one
+		std::copy(m_white.begin() + count, m_white.begin() + count + xHistory, m_white.begin());
+		std::copy(m_filtered.begin() + count, m_filtered.begin() + count + yHistory, m_filtered.begin());
+	}
+
+private:
+	std::vector<float> m_xCoefficients;
+	std::vector<float> m_yCoefficients;
+	uint64_t m_state;
+	uint64_t m_inc;
+	std::vector<float> m_white;
+	std::vector<float> m_filtered;
+};
+
+namespace OutOfCoreInternal
+{
+	// FNV-1a
+	inline uint64_t Hash(uint64_t hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// Everything that changes the results, so a checkpoint from different options isn't resumed
+	inline uint64_t OptionsHash(const OutOfCoreOptions& options)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		hash = Hash(hash, options.xCoefficients.data(), options.xCoefficients.size() * sizeof(float));
+		hash = Hash(hash, "|", 1);
+		hash = Hash(hash, options.yCoefficients.data(), options.yCoefficients.size() * sizeof(float));
+		hash = Hash(hash, "|", 1);
+		hash = Hash(hash, options.remapTable.data(), options.remapTable.size() * sizeof(float));
+		hash = Hash(hash, &options.boundsMin, sizeof(options.boundsMin));
+		hash = Hash(hash, &options.boundsMax, sizeof(options.boundsMax));
+		hash = Hash(hash, &options.seed, sizeof(options.seed));
+		hash = Hash(hash, &options.sampleCount, sizeof(options.sampleCount));
+		hash = Hash(hash, &options.chunkSize, sizeof(options.chunkSize));
+		hash = Hash(hash, &options.warmup, sizeof(options.warmup));
+		return hash;
+	}
+
+	inline std::string FileName(const OutOfCoreOptions& options, const char* suffix)
+	{
+		return std::string(c_outOfCoreDirectory) + "/" + options.name + suffix;
+	}
+
+	template <typename T>
+	inline bool WriteValue(FILE* file, const T& value)
+	{
+		return fwrite(&value, sizeof(T), 1, file) == 1;
+	}
+
+	template <typename T>
+	inline bool WriteArray(FILE* file, const T* values, size_t count)
+	{
+		uint64_t count64 = count;
+		return
+			fwrite(&count64, sizeof(count64), 1, file) == 1 &&
+			fwrite(values, sizeof(T), count, file) == count;
+	}
+
+	template <typename T>
+	inline bool ReadArray(FILE* file, T* values, size_t count)
+	{
+		uint64_t count64 = 0;
+		return
+			fread(&count64, sizeof(count64), 1, file) == 1 &&
+			count64 == count &&
+			fread(values, sizeof(T), count, file) == count;
+	}
+
+	// Writes to a temporary file and then renames it over the checkpoint, so a run stopped partway through writing
+	// leaves the last checkpoint intact. If any write fails, such as when the disk is full, the temporary file is
+	// deleted and the last checkpoint stays. Returns false if so.
+	inline bool SaveCheckpoint(const OutOfCoreOptions& options, const std::vector<uint8_t>& chunksDone, const OutOfCoreAccumulator& accumulator, uint64_t CSVLength)
+	{
+		std::string fileName = FileName(options, ".bin");
+		std::string tempFileName = fileName + ".tmp";
+
+		FILE* file = nullptr;
+		fopen_s(&file, tempFileName.c_str(), "wb");
+		if (!file)
+			return false;
+
+		uint64_t hash = OptionsHash(options);
+		bool ok =
+			WriteValue(file, c_outOfCoreMagic) &&
+			WriteValue(file, c_outOfCoreVersion) &&
+			WriteValue(file, hash) &&
+			WriteArray(file, chunksDone.data(), chunksDone.size()) &&
+			WriteValue(file, CSVLength) &&
+			WriteValue(file, accumulator.count) &&
+			WriteValue(file, accumulator.belowZero) &&
+			WriteValue(file, accumulator.aboveOne) &&
+			WriteValue(file, accumulator.min) &&
+			WriteValue(file, accumulator.max) &&
+			WriteValue(file, accumulator.exactZero) &&
+			WriteValue(file, accumulator.exactOne) &&
+			WriteArray(file, accumulator.lowTail, c_outOfCoreTailBins) &&
+			WriteArray(file, accumulator.highTail, c_outOfCoreTailBins) &&
+			WriteArray(file, accumulator.histogram.data(), accumulator.histogram.size()) &&
+			WriteValue(file, accumulator.remappedZero) &&
+			WriteValue(file, accumulator.remappedOne) &&
+			WriteArray(file, accumulator.remappedHistogram.data(), accumulator.remappedHistogram.size());
+
+		// buffered writes that fail only show up when the file is closed
+		ok &= (fclose(file) == 0);
+
+		std::error_code error;
+		if (ok)
+			std::filesystem::rename(tempFileName, fileName, error);
+		if (!ok || error)
+		{
+			std::filesystem::remove(tempFileName, error);
+			return false;
+		}
+		return true;
+	}
+
+	// Returns false if there is no checkpoint, or it's from different options
+	inline bool LoadCheckpoint(const OutOfCoreOptions& options, std::vector<uint8_t>& chunksDone, OutOfCoreAccumulator& accumulator, uint64_t& CSVLength)
+	{
+		FILE* file = nullptr;
+		fopen_s(&file, FileName(options, ".bin").c_str(), "rb");
+		if (!file)
+			return false;
+
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		uint64_t hash = 0;
+		bool ok =
+			fread(&magic, sizeof(magic), 1, file) == 1 && magic == c_outOfCoreMagic &&
+			fread(&version, sizeof(version), 1, file) == 1 && version == c_outOfCoreVersion &&
+			fread(&hash, sizeof(hash), 1, file) == 1 && hash == OptionsHash(options) &&
+			ReadArray(file, chunksDone.data(), chunksDone.size()) &&
+			fread(&CSVLength, sizeof(CSVLength), 1, file) == 1 &&
+			fread(&accumulator.count, sizeof(accumulator.count), 1, file) == 1 &&
+			fread(&accumulator.belowZero, sizeof(accumulator.belowZero), 1, file) == 1 &&
+			fread(&accumulator.aboveOne, sizeof(accumulator.aboveOne), 1, file) == 1 &&
+			fread(&accumulator.min, sizeof(accumulator.min), 1, file) == 1 &&
+			fread(&accumulator.max, sizeof(accumulator.max), 1, file) == 1 &&
+			fread(&accumulator.exactZero, sizeof(accumulator.exactZero), 1, file) == 1 &&
+			fread(&accumulator.exactOne, sizeof(accumulator.exactOne), 1, file) == 1 &&
+			ReadArray(file, accumulator.lowTail, c_outOfCoreTailBins) &&
+			ReadArray(file, accumulator.highTail, c_outOfCoreTailBins) &&
+			ReadArray(file, accumulator.histogram.data(), accumulator.histogram.size()) &&
+			fread(&accumulator.remappedZero, sizeof(accumulator.remappedZero), 1, file) == 1 &&
+			fread(&accumulator.remappedOne, sizeof(accumulator.remappedOne), 1, file) == 1 &&
+			ReadArray(file, accumulator.remappedHistogram.data(), accumulator.remappedHistogram.size());
+
+		fclose(file);
+		return ok;
+	}
+}
+
+// Runs the characterization, resuming from the checkpoint if there is one, and returns the merged accumulator
+inline OutOfCoreAccumulator RunOutOfCore(const OutOfCoreOptions& options)
+{
+	using namespace OutOfCoreInternal;
+
+	std::error_code error;
+	std::filesystem::create_directories(c_outOfCoreDirectory, error);
+
+	const uint64_t chunkCount = (options.sampleCount + options.chunkSize - 1) / options.chunkSize;
+
+	const std::string CSVFileName = FileName(options, "_chunks.csv");
+
+	OutOfCoreAccumulator merged;
+	std::vector<uint8_t> chunksDone(chunkCount, 0);
+	uint64_t CSVLength = 0;
+	if (LoadCheckpoint(options, chunksDone, merged, CSVLength))
+	{
+		uint64_t doneCount = std::count(chunksDone.begin(), chunksDone.end(), 1);
+		printf("Resuming %s from %s: %llu of %llu chunks done\n", options.name.c_str(), FileName(options, ".bin").c_str(), (unsigned long long)doneCount, (unsigned long long)chunkCount);
+
+		// drop the rows of chunks that finished after the checkpoint was saved, since they run again. A CSV that is
+		// shorter than that was changed by something else, so is left alone rather than padded.
+		if (std::filesystem::file_size(CSVFileName, error) > CSVLength && !error)
+			std::filesystem::resize_file(CSVFileName, CSVLength, error);
+	}
+	else
+	{
+		merged = OutOfCoreAccumulator();
+		std::fill(chunksDone.begin(), chunksDone.end(), 0);
+
+		// start the per chunk CSV over
+		FILE* file = nullptr;
+		fopen_s(&file, CSVFileName.c_str(), "wb");
+		if (file)
+		{
+			fprintf(file, "\"Chunk\",\"Count\",\"Min\",\"Max\",\"Below Zero\",\"Above One\",\"Exact Zero\",\"Exact One\",\"Remapped Zero\",\"Remapped One\"\n");
+			CSVLength = (uint64_t)ftell(file);
+			fclose(file);
+		}
+	}
+
+	std::vector<float> paddedTable;
+	if (!options.remapTable.empty())
+		paddedTable = PadTable(options.remapTable);
+
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, options.seed, 0);
+
+	const float boundsScale = 1.0f / (options.boundsMax - options.boundsMin);
+
+	std::mutex mergeMutex;
+	std::atomic<uint64_t> nextChunk{ 0 };
+	auto Worker = [&]()
+	{
+		// One accumulator and one block of values per thread, reused for every chunk
+		OutOfCoreAccumulator accumulator;
+		std::vector<float> values(OutOfCoreFilter::c_blockSize);
+		std::vector<float> remapped(OutOfCoreFilter::c_blockSize);
+
+		while (true)
+		{
+			uint64_t chunk = nextChunk++;
+			if (chunk >= chunkCount)
+				break;
+			if (chunksDone[chunk])
+				continue;
+
+			accumulator = OutOfCoreAccumulator();
+
+			const uint64_t chunkBegin = chunk * options.chunkSize;
+			const uint64_t chunkEnd = std::min(chunkBegin + options.chunkSize, options.sampleCount);
+			OutOfCoreFilter filter(options, rng, chunkBegin);
+
+			for (uint64_t warmup = 0; warmup < options.warmup; warmup += OutOfCoreFilter::c_blockSize)
+				filter.Next(values.data(), std::min(uint64_t(OutOfCoreFilter::c_blockSize), options.warmup - warmup));
+
+			for (uint64_t blockBegin = chunkBegin; blockBegin < chunkEnd; blockBegin += OutOfCoreFilter::c_blockSize)
+			{
+				const size_t blockCount = (size_t)std::min(uint64_t(OutOfCoreFilter::c_blockSize), chunkEnd - blockBegin);
+				filter.Next(values.data(), blockCount);
+
+				for (size_t index = 0; index < blockCount; ++index)
+					values[index] = (values[index] - options.boundsMin) * boundsScale;
+				accumulator.Add(values.data(), blockCount);
+
+				// the remap clamps to [0,1] itself
+				if (!paddedTable.empty())
+				{
+					Kernels().RemapLUT(paddedTable.data(), paddedTable.size() - 1, values.data(), remapped.data(), blockCount);
+					accumulator.AddRemapped(remapped.data(), blockCount);
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(mergeMutex);
+			merged.Merge(accumulator);
+
+			// the chunk's row goes in the CSV before the checkpoint marks it done, so a crash in between reruns the
+			// chunk on resume, which cuts the CSV back to the checkpoint's length, so the row is never lost or repeated
+			FILE* file = nullptr;
+			fopen_s(&file, CSVFileName.c_str(), "ab");
+			if (file)
+			{
+				fprintf(file, "%llu,%llu,%f,%f,%llu,%llu,%llu,%llu,%llu,%llu\n",
+					(unsigned long long)chunk, (unsigned long long)accumulator.count, accumulator.min, accumulator.max,
+					(unsigned long long)accumulator.belowZero, (unsigned long long)accumulator.aboveOne,
+					(unsigned long long)accumulator.exactZero, (unsigned long long)accumulator.exactOne,
+					(unsigned long long)accumulator.remappedZero, (unsigned long long)accumulator.remappedOne);
+				long length = ftell(file);
+				if (fclose(file) == 0 && length >= 0)
+					CSVLength = (uint64_t)length;
+			}
+
+			chunksDone[chunk] = 1;
+			if (!SaveCheckpoint(options, chunksDone, merged, CSVLength))
+				printf("\nCouldn't save the checkpoint %s, a restart would redo the chunks since the last one\n", FileName(options, ".bin").c_str());
+
+			printf("\r%s: chunk %llu of %llu", options.name.c_str(), (unsigned long long)(chunk + 1), (unsigned long long)chunkCount);
+			fflush(stdout);
+		}
+	};
+
+	unsigned int threadCount = options.threadCount;
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::vector<std::thread> threads;
+	for (unsigned int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+		threads.emplace_back(Worker);
+	for (std::thread& thread : threads)
+		thread.join();
+	printf("\n");
+
+	return merged;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// Shims so the code builds outside of MSVC, which has fopen_s, sprintf_s, _fseeki64 and _countof built in.
+
+#include <stdio.h>
+#include <errno.h>
+#include <stddef.h>
+
+#if !defined(_MSC_VER)
+
+#include <sys/types.h>
+
+inline int fopen_s(FILE** file, const char* fileName, const char* mode)
+{
+	*file = fopen(fileName, mode);
+	return (*file) ? 0 : errno;
+}
+
+template <size_t N, typename... ARGS>
+inline int sprintf_s(char (&buffer)[N], const char* format, ARGS... args)
+{
+	return snprintf(buffer, N, format, args...);
+}
+
+// 64 bit file offsets, for files over 2GB
+inline int _fseeki64(FILE* file, long long offset, int origin)
+{
+	return fseeko(file, (off_t)offset, origin);
+}
+
+inline long long _ftelli64(FILE* file)
+{
+	return (long long)ftello(file);
+}
+
+#ifndef _countof
+#define _countof(x) (sizeof(x) / sizeof((x)[0]))
+#endif
+
+#endif
+
+// The command to run python scripts with
+#if defined(_WIN32)
+#define PYTHON_COMMAND "python"
+#else
+#define PYTHON_COMMAND "python3"
+#endif
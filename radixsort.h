@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Sorting floats for making the CDF tables, which needs the exact sorted values.
+// std::sort of 10 million floats is most of the time of a SequenceTest, so large arrays use a multithreaded LSD radix
+// sort on the bits of the floats instead, which is O(N) and does 3 passes of 11 bits each.
+// Small arrays, where the radix sort's fixed costs don't pay off, use std::sort.
+
+// Arrays smaller than this use std::sort
+static const size_t c_radixSortMinCount = 1 << 16;
+
+namespace RadixSortInternal
+{
+	static const int c_digitBits = 11;
+	static const int c_digitCount = 1 << c_digitBits;
+	static const uint32_t c_digitMask = c_digitCount - 1;
+	static const int c_passCount = (32 + c_digitBits - 1) / c_digitBits;
+
+	// Maps the float bits to a uint32 that sorts the same way the floats do.
+	// Positive floats already sort by their bits, once the sign bit is set to put them above the negatives.
+	// Negative floats sort backwards by their bits, so all the bits are flipped.
+	inline uint32_t FloatToKey(float f)
+	{
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(bits));
+		return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+	}
+
+	inline float KeyToFloat(uint32_t key)
+	{
+		uint32_t bits = (key & 0x80000000) ? (key & 0x7FFFFFFF) : ~key;
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	// Runs the function on threadCount threads, each given its thread index
+	template <typename LAMBDA>
+	void ParallelFor(unsigned int threadCount, const LAMBDA& lambda)
+	{
+		if (threadCount == 1)
+		{
+			lambda(0u);
+			return;
+		}
+
+		std::vector<std::thread> threads;
+		for (unsigned int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+			threads.emplace_back(lambda, threadIndex);
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+}
+
+// Sorts the floats from lowest to highest. A threadCount of 0 uses all the cores.
+// NaNs sort above +infinity, or below -infinity if their sign bit is set, instead of being unordered like std::sort.
+inline void RadixSortFloats(std::vector<float>& values, unsigned int threadCount = 0)
+{
+	using namespace RadixSortInternal;
+
+	const size_t count = values.size();
+	if (count < c_radixSortMinCount)
+	{
+		std::sort(values.begin(), values.end());
+		return;
+	}
+
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	// each thread works on its own contiguous chunk of the array
+	const size_t chunkSize = (count + threadCount - 1) / threadCount;
+	auto ChunkBegin = [&](unsigned int threadIndex) { return std::min(size_t(threadIndex) * chunkSize, count); };
+	auto ChunkEnd = [&](unsigned int threadIndex) { return std::min(size_t(threadIndex + 1) * chunkSize, count); };
+
+	// convert to keys, and count the digits of every pass at once
+	std::vector<uint32_t> keys(count);
+	std::vector<uint32_t> keysTemp(count);
+	std::vector<size_t> counts(size_t(threadCount) * c_passCount * c_digitCount, 0);
+	ParallelFor(threadCount,
+		[&](unsigned int threadIndex)
+		{
+			size_t* threadCounts = &counts[size_t(threadIndex) * c_passCount * c_digitCount];
+			for (size_t index = ChunkBegin(threadIndex); index < ChunkEnd(threadIndex); ++index)
+			{
+				uint32_t key = FloatToKey(values[index]);
+				keys[index] = key;
+				for (int pass = 0; pass < c_passCount; ++pass)
+					threadCounts[pass * c_digitCount + ((key >> (pass * c_digitBits)) & c_digitMask)]++;
+			}
+		}
+	);
+
+	std::vector<size_t> offsets(size_t(threadCount) * c_digitCount);
+	bool keysMoved = false;
+	for (int pass = 0; pass < c_passCount; ++pass)
+	{
+		const int shift = pass * c_digitBits;
+		auto ThreadCounts = [&](unsigned int threadIndex) { return &counts[(size_t(threadIndex) * c_passCount + pass) * c_digitCount]; };
+
+		// Skip the pass if every key has the same digit, which is common for the high bits, since values in [0,1]
+		// all have about the same exponent. The total of each digit doesn't change as the keys move around.
+		bool allSameDigit = false;
+		for (int digit = 0; digit < c_digitCount; ++digit)
+		{
+			size_t digitCount = 0;
+			for (unsigned int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+				digitCount += ThreadCounts(threadIndex)[digit];
+			if (digitCount == count)
+				allSameDigit = true;
+			if (digitCount != 0)
+				break;
+		}
+		if (allSameDigit)
+			continue;
+
+		// Once an earlier pass has moved the keys, each thread's chunk has different keys in it, so count them again
+		if (keysMoved)
+		{
+			ParallelFor(threadCount,
+				[&](unsigned int threadIndex)
+				{
+					size_t* threadCounts = ThreadCounts(threadIndex);
+					std::fill(threadCounts, threadCounts + c_digitCount, 0);
+					for (size_t index = ChunkBegin(threadIndex); index < ChunkEnd(threadIndex); ++index)
+						threadCounts[(keys[index] >> shift) & c_digitMask]++;
+				}
+			);
+		}
+
+		// Where each thread writes each digit. All of digit 0 comes first, with thread 0's before thread 1's,
+		// then all of digit 1, and so on, which keeps the sort stable.
+		size_t offset = 0;
+		for (int digit = 0; digit < c_digitCount; ++digit)
+		{
+			for (unsigned int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+			{
+				offsets[size_t(threadIndex) * c_digitCount + digit] = offset;
+				offset += ThreadCounts(threadIndex)[digit];
+			}
+		}
+
+		ParallelFor(threadCount,
+			[&](unsigned int threadIndex)
+			{
+				size_t* threadOffsets = &offsets[size_t(threadIndex) * c_digitCount];
+				for (size_t index = ChunkBegin(threadIndex); index < ChunkEnd(threadIndex); ++index)
+				{
+					uint32_t key = keys[index];
+					keysTemp[threadOffsets[(key >> shift) & c_digitMask]++] = key;
+				}
+			}
+		);
+		keys.swap(keysTemp);
+		keysMoved = true;
+	}
+
+	ParallelFor(threadCount,
+		[&](unsigned int threadIndex)
+		{
+			for (size_t index = ChunkBegin(threadIndex); index < ChunkEnd(threadIndex); ++index)
+				values[index] = KeyToFloat(keys[index]);
+		}
+	);
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include "pcg/pcg_basic.h"
+
+// SPMD ("single program, multiple data") noise streams, which run WIDTH independent streams at once, one per lane.
+// This is the way a compute shader runs: the program is written for a single lane, and is run for every lane.
+// Here that is a loop over plain arrays, one entry per lane, that has no branches or cross lane dependencies, so the
+// compiler vectorizes it to as many lanes as the instruction set has (SSE, AVX2, AVX-512).
+// The stream classes in BlueNoiseStream.h are width 1 instances of this, so the CPU tests run the same code that gets
+// ported to shaders, and a width 1 lane gives the same values as the wide version does in that lane.
+//
+// A PROGRAM is the part of a stream that differs between streams:
+//   static constexpr float c_xCoefficients[3];  the FIR filter applied to the white noise
+//   float Normalize(float y) const;              takes the filtered noise to [0,1]
+//   float Remap(float x) const;                  makes the noise uniform again, using an approximation of the CDF
+//
+// The programs are the LUT, polynomial, Hermite, fused, CDF table and red noise programs of BlueNoiseStream.h, and
+// BlueNoiseTunedProgram in autotune.h. The streams that aren't programs don't fit the 3 tap float filter:
+// * BlueNoiseStreamFixedPoint does its math in integers, so it gives the same bits everywhere
+// * BlueNoiseStreamFIR<N> has N taps, and a history to match
+// * BlueNoiseStreamAppleton keeps the values it has output, not just the white noise history
+
+namespace SPMDInternal
+{
+	// 2^-32, so that a uint32 times this is a float in [0,1]. Scaling by a power of 2 is exact, so this is the same
+	// as ldexpf((float)value, -32), but is a multiply that vectorizes, instead of a library call.
+	static const float c_uint32ToFloat01 = 1.0f / 4294967296.0f;
+
+	static const uint64_t c_pcg32Multiplier = 6364136223846793005ULL;
+
+	// Wide lanes are cache line aligned, so the vector loads and stores of a lane loop don't split cache lines.
+	// A single lane has nothing to split, and every scalar stream is a single lane, so it keeps the natural
+	// alignment of the type, which keeps the stream as small as its state.
+	template <int WIDTH, typename T>
+	constexpr size_t LaneAlignment()
+	{
+		return (WIDTH > 1) ? 64 : alignof(T);
+	}
+
+	// The PCG32 output function, from the state before the step
+	inline uint32_t PCG32Output(uint64_t oldstate)
+	{
+		uint32_t xorshifted = uint32_t(((oldstate >> 18u) ^ oldstate) >> 27u);
+		uint32_t rot = uint32_t(oldstate >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+	}
+
+	// Taking a step of PCG32 n times is also an LCG step, state * mult + inc * plusPerInc, where plusPerInc doesn't
+	// depend on inc, so one table works for every stream. (Brown, "Random Number Generation with Arbitrary Strides")
+	// The table has the jumps for every hex digit of a 64 bit step count, so a jump of any size is 16 table lookups.
+	struct PCG32Jumps
+	{
+		static const int c_digitBits = 4;
+		static const int c_digitCount = 1 << c_digitBits;
+		static const int c_digitPositions = 64 / c_digitBits;
+
+		PCG32Jumps()
+		{
+			// the jump for a 1 in the current digit position
+			uint64_t unitMult = c_pcg32Multiplier;
+			uint64_t unitPlus = 1;
+			for (int position = 0; position < c_digitPositions; ++position)
+			{
+				mult[position][0] = 1;
+				plusPerInc[position][0] = 0;
+				for (int digit = 1; digit < c_digitCount; ++digit)
+				{
+					mult[position][digit] = mult[position][digit - 1] * unitMult;
+					plusPerInc[position][digit] = plusPerInc[position][digit - 1] * unitMult + unitPlus;
+				}
+
+				// a 1 in the next position is c_digitCount of these
+				const int lastDigit = c_digitCount - 1;
+				unitPlus = plusPerInc[position][lastDigit] * unitMult + unitPlus;
+				unitMult = mult[position][lastDigit] * unitMult;
+			}
+		}
+
+		uint64_t mult[c_digitPositions][c_digitCount];
+		uint64_t plusPerInc[c_digitPositions][c_digitCount];
+	};
+
+	inline const PCG32Jumps& GetPCG32Jumps()
+	{
+		static const PCG32Jumps jumps;
+		return jumps;
+	}
+}
+
+// Returns the PCG32 state after delta steps from state, in 16 table lookups instead of delta steps.
+// Every digit of delta does a jump, with a 0 digit multiplying by 1 and adding 0, so there are no branches, and a
+// loop of these over many generators vectorizes.
+inline uint64_t PCG32AdvanceState(uint64_t state, uint64_t inc, uint64_t delta)
+{
+	typedef SPMDInternal::PCG32Jumps PCG32Jumps;
+	const PCG32Jumps& jumps = SPMDInternal::GetPCG32Jumps();
+	for (int position = 0; position < PCG32Jumps::c_digitPositions; ++position)
+	{
+		uint64_t digit = (delta >> (position * PCG32Jumps::c_digitBits)) & (PCG32Jumps::c_digitCount - 1);
+		state = state * jumps.mult[position][digit] + inc * jumps.plusPerInc[position][digit];
+	}
+	return state;
+}
+
+// WIDTH PCG32 generators, with the state and increment of each in their own arrays, so the lanes vectorize.
+// The math is the same as pcg32_random_r, so each lane gives the same sequence as the pcg32_random_t it came from.
+template <int WIDTH>
+struct PCG32Lanes
+{
+	PCG32Lanes(const pcg32_random_t* rngs)
+	{
+		for (int lane = 0; lane < WIDTH; ++lane)
+		{
+			state[lane] = rngs[lane].state;
+			inc[lane] = rngs[lane].inc;
+		}
+	}
+
+	uint32_t Next(int lane)
+	{
+		uint64_t oldstate = state[lane];
+		state[lane] = oldstate * SPMDInternal::c_pcg32Multiplier + inc[lane];
+		return SPMDInternal::PCG32Output(oldstate);
+	}
+
+	float NextFloat01(int lane)
+	{
+		return float(Next(lane)) * SPMDInternal::c_uint32ToFloat01;
+	}
+
+	alignas(SPMDInternal::LaneAlignment<WIDTH, uint64_t>()) uint64_t state[WIDTH];
+	alignas(SPMDInternal::LaneAlignment<WIDTH, uint64_t>()) uint64_t inc[WIDTH];
+};
+
+// Filters white noise with the program's 3 tap FIR filter, and makes it uniform again with the program's remap.
+// The program is a base class rather than a member, so a program with no state, whose tables are function local
+// statics, takes no space, and a scalar stream is just its generator and history.
+template <int WIDTH, typename PROGRAM>
+class NoiseStreamSPMD : private PROGRAM
+{
+public:
+	// rngs has WIDTH generators, one per lane
+	NoiseStreamSPMD(const pcg32_random_t* rngs, const PROGRAM& program = PROGRAM())
+		: PROGRAM(program)
+		, m_rng(rngs)
+	{
+		for (int lane = 0; lane < WIDTH; ++lane)
+			m_lastValues0[lane] = m_rng.NextFloat01(lane);
+		for (int lane = 0; lane < WIDTH; ++lane)
+			m_lastValues1[lane] = m_rng.NextFloat01(lane);
+	}
+
+	// Writes the next value of each lane to out
+	void Next(float* out)
+	{
+		for (int lane = 0; lane < WIDTH; ++lane)
+		{
+			float value = m_rng.NextFloat01(lane);
+			out[lane] = Evaluate(Program(), value, m_lastValues0[lane], m_lastValues1[lane]);
+			m_lastValues1[lane] = m_lastValues0[lane];
+			m_lastValues0[lane] = value;
+		}
+	}
+
+	// The output of a lane, given the newest white noise value and the two before it.
+	// NoiseStreamSeekable uses this too, so that it gives the same bits as running the stream.
+	static float Evaluate(const PROGRAM& program, float value, float lastValue0, float lastValue1)
+	{
+		const float* xCoefficients = PROGRAM::c_xCoefficients;
+		float y =
+			value * xCoefficients[0] +
+			lastValue0 * xCoefficients[1] +
+			lastValue1 * xCoefficients[2];
+		return program.Remap(program.Normalize(y));
+	}
+
+	const PROGRAM& Program() const
+	{
+		return *this;
+	}
+
+private:
+	PCG32Lanes<WIDTH> m_rng;
+	alignas(SPMDInternal::LaneAlignment<WIDTH, float>()) float m_lastValues0[WIDTH];
+	alignas(SPMDInternal::LaneAlignment<WIDTH, float>()) float m_lastValues1[WIDTH];
+};
+
+// Random access into the stream a NoiseStreamSPMD<1, PROGRAM> would make from the same generator, without running it.
+// Sample i is the value that the (i+1)th call to Next() gives. The filter only looks at the last 3 white noise values,
+// which are PCG outputs i, i+1 and i+2, so this jumps the generator ahead to i and takes a few steps, which is O(1).
+// This is for lookups like "sample i of pixel p", where each pixel is its own PCG stream id.
+template <typename PROGRAM>
+class NoiseStreamSeekable
+{
+public:
+	// How many samples the batched SampleAt() jumps at once
+	static const int c_batchWidth = 16;
+
+	NoiseStreamSeekable(pcg32_random_t rng, const PROGRAM& program = PROGRAM())
+		: m_state(rng.state)
+		, m_inc(rng.inc)
+		, m_program(program)
+	{
+	}
+
+	float SampleAt(uint64_t index) const
+	{
+		uint64_t state = PCG32AdvanceState(m_state, m_inc, JumpIndex(index));
+		float values[4];
+		for (float& value : values)
+		{
+			value = float(SPMDInternal::PCG32Output(state)) * SPMDInternal::c_uint32ToFloat01;
+			state = state * SPMDInternal::c_pcg32Multiplier + m_inc;
+		}
+		return Evaluate(index, values[0], values[1], values[2], values[3]);
+	}
+
+	// Gathers count samples at once, from any indices in any order.
+	// The jumps are done c_batchWidth at a time, a digit at a time for every lane, so the loops vectorize as gathers.
+	void SampleAt(const uint64_t* indices, float* out, size_t count) const
+	{
+		typedef SPMDInternal::PCG32Jumps PCG32Jumps;
+		const PCG32Jumps& jumps = SPMDInternal::GetPCG32Jumps();
+		for (size_t batchBegin = 0; batchBegin < count; batchBegin += c_batchWidth)
+		{
+			const size_t batchCount = std::min(count - batchBegin, size_t(c_batchWidth));
+
+			// the unused lanes of the last batch use index 0
+			alignas(64) uint64_t index[c_batchWidth];
+			alignas(64) uint64_t state[c_batchWidth];
+			for (int lane = 0; lane < c_batchWidth; ++lane)
+			{
+				index[lane] = (size_t(lane) < batchCount) ? indices[batchBegin + lane] : 0;
+				state[lane] = m_state;
+			}
+
+			for (int position = 0; position < PCG32Jumps::c_digitPositions; ++position)
+			{
+				const uint64_t* mult = jumps.mult[position];
+				const uint64_t* plusPerInc = jumps.plusPerInc[position];
+				for (int lane = 0; lane < c_batchWidth; ++lane)
+				{
+					uint64_t digit = (JumpIndex(index[lane]) >> (position * PCG32Jumps::c_digitBits)) & (PCG32Jumps::c_digitCount - 1);
+					state[lane] = state[lane] * mult[digit] + m_inc * plusPerInc[digit];
+				}
+			}
+
+			alignas(64) float values[4][c_batchWidth];
+			for (int valueIndex = 0; valueIndex < 4; ++valueIndex)
+			{
+				for (int lane = 0; lane < c_batchWidth; ++lane)
+				{
+					values[valueIndex][lane] = float(SPMDInternal::PCG32Output(state[lane])) * SPMDInternal::c_uint32ToFloat01;
+					state[lane] = state[lane] * SPMDInternal::c_pcg32Multiplier + m_inc;
+				}
+			}
+
+			alignas(64) float results[c_batchWidth];
+			for (int lane = 0; lane < c_batchWidth; ++lane)
+				results[lane] = Evaluate(index[lane], values[0][lane], values[1][lane], values[2][lane], values[3][lane]);
+
+			for (size_t lane = 0; lane < batchCount; ++lane)
+				out[batchBegin + lane] = results[lane];
+		}
+	}
+
+	const PROGRAM& Program() const
+	{
+		return m_program;
+	}
+
+private:
+	// The stream's constructor reads the first two values into the history in the opposite order that Next() shifts
+	// them, so samples 0 and 1 don't follow the pattern. They both start from the generator as it is, and use 4 values.
+	static uint64_t JumpIndex(uint64_t index)
+	{
+		return (index < 2) ? 0 : index;
+	}
+
+	// v0 to v3 are 4 PCG outputs in a row, starting at JumpIndex(index)
+	float Evaluate(uint64_t index, float v0, float v1, float v2, float v3) const
+	{
+		float value = (index == 1) ? v3 : v2;
+		float lastValue0 = (index == 0) ? v0 : ((index == 1) ? v2 : v1);
+		float lastValue1 = (index == 0) ? v1 : v0;
+		return NoiseStreamSPMD<1, PROGRAM>::Evaluate(m_program, value, lastValue0, lastValue1);
+	}
+
+	uint64_t m_state;
+	uint64_t m_inc;
+	PROGRAM m_program;
+};
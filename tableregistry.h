@@ -0,0 +1,338 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// Where the CDF tables and polynomial coefficients that the streams remap with live, one copy for every stream.
+// * Every table starts on its own cache line, so the 16 polynomial coefficients are exactly one line, and no table
+//   shares a line with anything that gets written.
+// * Tables are found by their contents, so registering the same table again gives the same memory. Streams made from
+//   the same CDF table share one copy, instead of each having its own, so thousands of streams touch a few lines.
+// * The memory comes in 2MB chunks, asking the OS for huge pages, so all the tables take a single TLB entry.
+//   On Linux that is a transparent huge page hint. Windows large pages need the "Lock pages in memory" privilege, so
+//   usually fall back to normal pages.
+// * The memory is read only, except while a table is being copied in, so nothing can write to a table that other
+//   threads are reading. Windows large pages can't be made read only, so stay writable.
+// * Every Register is a reference to the table, and Release gives one back. When the last is given back, the table's
+//   memory goes on a free list for later tables. The stream classes never release theirs, since there are only a few
+//   and copies of streams share the pointer, but the C API, which can make a table per stream, releases its table
+//   when the stream is destroyed, so the registry only holds the tables of live streams.
+
+static const size_t c_tableRegistryAlignment = 64;
+static const size_t c_tableRegistryChunkSize = 1 << 21;
+
+class TableRegistry
+{
+public:
+	// There is one registry, shared by everything
+	static TableRegistry& Get()
+	{
+		static TableRegistry registry;
+		return registry;
+	}
+
+	// Copies the table into the registry, or finds the copy that is already there, and adds a reference to it.
+	// Safe to call from any thread.
+	template <typename T>
+	const T* Register(const T* table, size_t count)
+	{
+		return (const T*)RegisterBytes(table, count * sizeof(T));
+	}
+
+	template <typename T>
+	const T* Register(const std::vector<T>& table)
+	{
+		return Register(table.data(), table.size());
+	}
+
+	const void* RegisterBytes(const void* data, size_t size)
+	{
+		uint64_t hash = Hash(data, size);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto range = m_tables.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second.size == size && memcmp(it->second.data, data, size) == 0)
+			{
+				it->second.refCount++;
+				return it->second.data;
+			}
+		}
+
+		size_t alignedSize = AlignedSize(size);
+		uint8_t* table = Allocate(alignedSize);
+		Chunk& chunk = ChunkOf(table);
+		SetReadOnly(chunk, false);
+		memcpy(table, data, size);
+		SetReadOnly(chunk, true);
+		m_bytesUsed += alignedSize;
+
+		m_tables.emplace(hash, Table{ table, size, 1 });
+		m_tableHashes.emplace(table, hash);
+		return table;
+	}
+
+	// Gives back a reference from Register. Does nothing for a pointer that didn't come from Register.
+	void Release(const void* table)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto hashIt = m_tableHashes.find(table);
+		if (hashIt == m_tableHashes.end())
+			return;
+
+		auto range = m_tables.equal_range(hashIt->second);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second.data != table)
+				continue;
+			if (--it->second.refCount > 0)
+				return;
+
+			size_t alignedSize = AlignedSize(it->second.size);
+			m_freeBlocks.emplace(alignedSize, (uint8_t*)table);
+			m_bytesUsed -= alignedSize;
+			m_tables.erase(it);
+			m_tableHashes.erase(hashIt);
+			return;
+		}
+	}
+
+	size_t TableCount()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_tables.size();
+	}
+
+	size_t BytesUsed()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_bytesUsed;
+	}
+
+	// True if the OS took the huge page request for every chunk
+	bool HugePages()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const Chunk& chunk : m_chunks)
+		{
+			if (!chunk.hugePages)
+				return false;
+		}
+		return !m_chunks.empty();
+	}
+
+private:
+	TableRegistry() = default;
+	TableRegistry(const TableRegistry&) = delete;
+	TableRegistry& operator=(const TableRegistry&) = delete;
+
+	struct Chunk
+	{
+		uint8_t* memory = nullptr;
+		size_t size = 0;
+		size_t used = 0;
+		bool hugePages = false;
+		bool heap = false;
+	};
+
+	struct Table
+	{
+		const uint8_t* data;
+		size_t size;
+		size_t refCount;
+	};
+
+	static size_t AlignedSize(size_t size)
+	{
+		return (size + c_tableRegistryAlignment - 1) & ~(c_tableRegistryAlignment - 1);
+	}
+
+	// The smallest free block that fits, with what's left over going back on the free list, or else the end of the
+	// last chunk. When that is too small, it goes on the free list too, and a new chunk is made.
+	uint8_t* Allocate(size_t alignedSize)
+	{
+		auto freeBlock = m_freeBlocks.lower_bound(alignedSize);
+		if (freeBlock != m_freeBlocks.end())
+		{
+			uint8_t* block = freeBlock->second;
+			size_t blockSize = freeBlock->first;
+			m_freeBlocks.erase(freeBlock);
+			if (blockSize > alignedSize)
+				m_freeBlocks.emplace(blockSize - alignedSize, block + alignedSize);
+			return block;
+		}
+
+		if (m_chunks.empty() || m_chunks.back().size - m_chunks.back().used < alignedSize)
+		{
+			if (!m_chunks.empty() && m_chunks.back().used < m_chunks.back().size)
+			{
+				Chunk& last = m_chunks.back();
+				m_freeBlocks.emplace(last.size - last.used, last.memory + last.used);
+				last.used = last.size;
+			}
+			m_chunks.push_back(AllocateChunk(alignedSize));
+		}
+
+		Chunk& chunk = m_chunks.back();
+		uint8_t* block = chunk.memory + chunk.used;
+		chunk.used += alignedSize;
+		return block;
+	}
+
+	Chunk& ChunkOf(const uint8_t* table)
+	{
+		for (Chunk& chunk : m_chunks)
+		{
+			if (table >= chunk.memory && table < chunk.memory + chunk.size)
+				return chunk;
+		}
+		return m_chunks.back();
+	}
+
+	// FNV-1a
+	static uint64_t Hash(const void* data, size_t size)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t index = 0; index < size; ++index)
+		{
+			hash ^= bytes[index];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	static Chunk AllocateChunk(size_t minSize)
+	{
+		Chunk chunk;
+		chunk.size = (minSize + c_tableRegistryChunkSize - 1) & ~(c_tableRegistryChunkSize - 1);
+
+#if defined(_WIN32)
+		SIZE_T largePageSize = GetLargePageMinimum();
+		if (largePageSize > 0)
+		{
+			SIZE_T largeSize = (chunk.size + largePageSize - 1) & ~(largePageSize - 1);
+			chunk.memory = (uint8_t*)VirtualAlloc(nullptr, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (chunk.memory)
+			{
+				chunk.size = largeSize;
+				chunk.hugePages = true;
+			}
+		}
+		if (!chunk.memory)
+			chunk.memory = (uint8_t*)VirtualAlloc(nullptr, chunk.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+		// Transparent huge pages need the memory aligned to the huge page size, so map extra and trim the ends
+		size_t mappedSize = chunk.size + c_tableRegistryChunkSize;
+		uint8_t* mapped = (uint8_t*)mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped != MAP_FAILED)
+		{
+			uint8_t* aligned = (uint8_t*)(((uintptr_t)mapped + c_tableRegistryChunkSize - 1) & ~uintptr_t(c_tableRegistryChunkSize - 1));
+			if (aligned > mapped)
+				munmap(mapped, aligned - mapped);
+			size_t tail = (mapped + mappedSize) - (aligned + chunk.size);
+			if (tail > 0)
+				munmap(aligned + chunk.size, tail);
+			chunk.memory = aligned;
+#if defined(MADV_HUGEPAGE)
+			chunk.hugePages = madvise(chunk.memory, chunk.size, MADV_HUGEPAGE) == 0;
+#endif
+		}
+#endif
+
+		// If the OS won't map the memory, fall back to the heap, aligned by hand, which can't be made read only
+		if (!chunk.memory)
+		{
+			uint8_t* memory = new uint8_t[chunk.size + c_tableRegistryAlignment];
+			chunk.memory = (uint8_t*)(((uintptr_t)memory + c_tableRegistryAlignment - 1) & ~uintptr_t(c_tableRegistryAlignment - 1));
+			chunk.hugePages = false;
+			chunk.heap = true;
+		}
+		return chunk;
+	}
+
+	static void SetReadOnly(Chunk& chunk, bool readOnly)
+	{
+		if (chunk.heap)
+			return;
+#if defined(_WIN32)
+		if (chunk.hugePages)
+			return;
+		DWORD oldProtect;
+		VirtualProtect(chunk.memory, chunk.size, readOnly ? PAGE_READONLY : PAGE_READWRITE, &oldProtect);
+#else
+		mprotect(chunk.memory, chunk.size, readOnly ? PROT_READ : (PROT_READ | PROT_WRITE));
+#endif
+	}
+
+	std::mutex m_mutex;
+	std::vector<Chunk> m_chunks;
+	std::unordered_multimap<uint64_t, Table> m_tables;
+	std::unordered_map<const void*, uint64_t> m_tableHashes;
+	std::multimap<size_t, uint8_t*> m_freeBlocks;
+	size_t m_bytesUsed = 0;
+};
+
+#if defined(_MSC_VER)
+#define TABLE_REGISTRY_COLD __declspec(noinline)
+#else
+#define TABLE_REGISTRY_COLD __attribute__((noinline, cold))
+#endif
+
+namespace TableRegistryInternal
+{
+	template <typename T>
+	TABLE_REGISTRY_COLD const T* RegisterBuiltInTable(std::atomic<const T*>& registered, const T* table, size_t count)
+	{
+		const T* ret = TableRegistry::Get().Register(table, count);
+		registered.store(ret, std::memory_order_release);
+		return ret;
+	}
+}
+
+// The registry's copy of a table built into the code, like the LUTs and polynomial coefficients of the stream
+// programs, which look their table up every sample. registered is a function local static, which is constant
+// initialized, so unlike a static initialized by calling Register, there is no guard, and no call in the sample loop
+// to spill registers around. Registering is out of line, the first time. Threads that race to it get the same copy.
+template <typename T>
+inline const T* BuiltInTable(std::atomic<const T*>& registered, const T* table, size_t count)
+{
+	const T* ret = registered.load(std::memory_order_acquire);
+	return ret ? ret : TableRegistryInternal::RegisterBuiltInTable(registered, table, count);
+}
+
+// Asks for the cache lines of a table to be loaded into L1, ahead of using it, such as before switching to a
+// different stream's table in a loop over many streams. It's only a hint, and does nothing where it isn't supported.
+inline void PrefetchTable(const void* table, size_t size)
+{
+	const char* bytes = (const char*)table;
+	for (size_t offset = 0; offset < size; offset += c_tableRegistryAlignment)
+	{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_prefetch(bytes + offset, _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+		__builtin_prefetch(bytes + offset, 0, 3);
+#else
+		(void)bytes;
+#endif
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "mathutils.h"
+
+// Inverse CDFs of distributions we want colored noise to have, instead of uniform.
+// Composing one of these with the CDF of the filtered noise makes a single "fused" table, so that one lookup takes
+// the filtered noise straight to the target distribution, instead of going to uniform first and then doing a second transform.
+
+// The ICDFs of unbounded distributions go to infinity at 0 and 1, so u is clamped to [c_minProbability, 1 - c_minProbability].
+// For a standard normal that is about +/- 4.26 standard deviations.
+static const double c_minProbability = 1e-5;
+
+// Peter Acklam's rational approximation of the standard normal ICDF, which has a relative error less than 1.15e-9.
+// https://web.archive.org/web/20151030215612/http://home.online.no/~pjacklam/notes/invnorm/
+inline float GaussianICDF(float u)
+{
+	static const double a[6] = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02, 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00 };
+	static const double b[5] = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02, 6.680131188771972e+01, -1.328068155288572e+01 };
+	static const double c[6] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00, -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00 };
+	static const double d[4] = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00, 3.754408661907416e+00 };
+	static const double pLow = 0.02425;
+
+	double p = std::min(std::max(double(u), c_minProbability), 1.0 - c_minProbability);
+
+	if (p < pLow)
+	{
+		double q = std::sqrt(-2.0 * std::log(p));
+		return float((((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0));
+	}
+	else if (p <= 1.0 - pLow)
+	{
+		double q = p - 0.5;
+		double r = q * q;
+		return float((((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.0));
+	}
+	else
+	{
+		double q = std::sqrt(-2.0 * std::log(1.0 - p));
+		return -float((((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0));
+	}
+}
+
+// Exponential distribution with a rate of lambda
+inline float ExponentialICDF(float u, float lambda = 1.0f)
+{
+	double p = std::min(std::max(double(u), 0.0), 1.0 - c_minProbability);
+	return float(-std::log(1.0 - p) / double(lambda));
+}
+
+// An ICDF given as a table of values at evenly spaced probabilities in [0,1], such as a sorted list of samples
+// of the target distribution, resampled. Linearly interpolated between entries.
+class TabulatedICDF
+{
+public:
+	TabulatedICDF(const std::vector<float>& table)
+		: m_table(table)
+	{
+	}
+
+	float operator()(float u) const
+	{
+		return SampleTable(m_table, u);
+	}
+
+private:
+	std::vector<float> m_table;
+};
+
+// Makes a table which maps the filtered noise, normalized to [0,1], straight to the target distribution.
+// CDF is a table of the filtered noise CDF, like SequenceTest makes, and ICDF is a function of the target distribution.
+// The result is used the same way as the CDF tables, with SampleTable, or the LUT in BlueNoiseStreamFused.
+template <typename LAMBDA>
+std::vector<float> MakeFusedLUT(const std::vector<float>& CDF, const LAMBDA& ICDF, size_t size)
+{
+	std::vector<float> ret(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		float x = float(i) / float(size - 1);
+		ret[i] = ICDF(SampleTable(CDF, x));
+	}
+	return ret;
+}
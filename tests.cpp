@@ -0,0 +1,1054 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "platform.h"
+#include "BlueNoiseStream.h"
+#include "noisestreampool.h"
+#include "cdfcache.h"
+#include "targetdistribution.h"
+#include "autotune.h"
+#include "dispatch.h"
+#include "noisestreamchannels.h"
+#include "columnstore.h"
+#include "filterdesign.h"
+#include "leastsquaresfit.h"
+#include "minimaxfit.h"
+#include "ToUniformC.h"
+
+// Tests of the noise streams and the code around them. ctest runs each test on its own, by name:
+//   ToUniformTests             runs every test
+//   ToUniformTests name ...    runs the named tests
+// A test prints what went wrong and returns false if it fails. The exit code is 0 only if every test that ran passed.
+
+// The shims in platform.h have to behave like the MSVC functions they stand in for
+bool PlatformShimsTest()
+{
+	bool ret = true;
+
+	char buffer[32];
+	sprintf_s(buffer, "%s %d %.2f", "pi", 3, 3.14159);
+	if (strcmp(buffer, "pi 3 3.14") != 0)
+	{
+		printf("sprintf_s gave \"%s\"\n", buffer);
+		ret = false;
+	}
+
+	FILE* file = nullptr;
+	if (fopen_s(&file, "this/directory/does/not/exist.txt", "rb") == 0 || file != nullptr)
+	{
+		printf("fopen_s didn't fail on a missing file\n");
+		ret = false;
+	}
+
+	// seeking and telling past 2GB doesn't need a 2GB file, only a seek
+	const char* fileName = "platformshimstest.bin";
+	if (fopen_s(&file, fileName, "wb") != 0 || file == nullptr)
+	{
+		printf("fopen_s couldn't make %s\n", fileName);
+		return false;
+	}
+	const long long c_farOffset = (3ll << 30) + 5;
+	if (_fseeki64(file, c_farOffset, SEEK_SET) != 0 || _ftelli64(file) != c_farOffset)
+	{
+		printf("_fseeki64 / _ftelli64 don't handle offsets over 2GB\n");
+		ret = false;
+	}
+	fclose(file);
+	remove(fileName);
+
+	int array[7];
+	if (_countof(array) != 7)
+	{
+		printf("_countof is wrong\n");
+		ret = false;
+	}
+
+	return ret;
+}
+
+// A cache file with a corrupt count has to fail to load, without trying to allocate what the count says
+bool CDFCacheCorruptCountTest()
+{
+	CDFCacheKey key;
+	key.xCoefficients = { 0.5f, -1.0f, 0.5f };
+	key.sampleCount = 1000;
+	key.tableSizeFull = 4;
+	key.tableSizeSmall = 2;
+	key.pyramidMinSize = 2;
+	key.pyramidMaxSize = 4;
+
+	CDFCacheEntry entry;
+	entry.pyramid.levels.resize(2);
+	entry.pyramid.levels[0].table = { 0.0f, 1.0f };
+	entry.pyramid.levels[1].table = { 0.0f, 0.25f, 0.75f, 1.0f };
+	entry.polynomial.order = 1;
+	entry.polynomial.pieces = 1;
+	entry.polynomial.coefficients = { 1.0, 0.0 };
+	SaveCDFCache(key, entry);
+
+	bool ret = true;
+	CDFCacheEntry loaded;
+	if (!LoadCDFCache(key, loaded) || loaded.CDFFull != entry.pyramid.levels[1].table)
+	{
+		printf("The cache entry didn't load back\n");
+		ret = false;
+	}
+
+	// the offsets of the x coefficient count, and the count of the first pyramid level's table, after the magic,
+	// version, and the rest of the key
+	const long c_xCountOffset = 8;
+	const long c_tableCountOffset = 8 + 4 + 3 * 4 + 4 + 8 + 4 * 4 + 4;
+	for (long offset : { c_xCountOffset, c_tableCountOffset })
+	{
+		SaveCDFCache(key, entry);
+		FILE* file = nullptr;
+		fopen_s(&file, CDFCacheFileName(key).c_str(), "r+b");
+		if (!file)
+			return false;
+		uint32_t hugeCount = 0xFFFFFFF0;
+		fseek(file, offset, SEEK_SET);
+		fwrite(&hugeCount, sizeof(hugeCount), 1, file);
+		fclose(file);
+
+		if (LoadCDFCache(key, loaded))
+		{
+			printf("A cache file with a count of 0x%08x at offset %ld loaded\n", hugeCount, offset);
+			ret = false;
+		}
+	}
+
+	remove(CDFCacheFileName(key).c_str());
+	return ret;
+}
+
+// TabulatedICDF has to give the table's values at its entries, and interpolate the ICDF it came from in between
+bool TabulatedICDFTest()
+{
+	static const size_t c_tableSize = 4096;
+	std::vector<float> table(c_tableSize);
+	for (size_t index = 0; index < c_tableSize; ++index)
+		table[index] = ExponentialICDF(float(index) / float(c_tableSize - 1));
+	TabulatedICDF tabulated(table);
+
+	bool ret = true;
+	for (size_t index = 0; index < c_tableSize; ++index)
+	{
+		float u = float(index) / float(c_tableSize - 1);
+		if (tabulated(u) != table[index])
+		{
+			printf("TabulatedICDF at entry %zu gave %f, not %f\n", index, tabulated(u), table[index]);
+			ret = false;
+			break;
+		}
+	}
+
+	// the exponential ICDF curves up sharply near 1, so linear interpolation is only close below that
+	static const float c_maxDifference = 0.001f;
+	for (int index = 0; index <= 9900; ++index)
+	{
+		float u = float(index) / 10000.0f;
+		float difference = std::abs(tabulated(u) - ExponentialICDF(u));
+		if (difference > c_maxDifference)
+		{
+			printf("TabulatedICDF(%f) is %f off from ExponentialICDF\n", u, difference);
+			ret = false;
+			break;
+		}
+	}
+
+	return ret;
+}
+
+// BlueNoiseStreamFixedPoint has to give the same bits on every compiler and CPU, so check it against output saved
+// from a known seed. If this fails, something changed the fixed point math, which breaks anything replaying old streams.
+bool FixedPointGoldenTest()
+{
+	static const uint32_t c_goldenFirst[] = { 0xfdf2f7e3, 0x0343628a, 0xf0242029, 0xa9b7fd8c, 0x06b84adf, 0xed736a40, 0x3f6fa07d, 0xd154792b };
+	static const uint64_t c_goldenHash = 0x4f2ec4f04c8e925aull;
+	static const size_t c_goldenHashCount = 1000000;
+
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 0xa000b800, 0);
+	BlueNoiseStreamFixedPoint stream(rng);
+
+	bool ret = true;
+	for (size_t index = 0; index < _countof(c_goldenFirst); ++index)
+	{
+		uint32_t value = stream.Next();
+		if (value != c_goldenFirst[index])
+		{
+			printf("Fixed point golden test failed: value %zu was 0x%08x, expected 0x%08x\n", index, value, c_goldenFirst[index]);
+			ret = false;
+		}
+	}
+
+	// FNV-1a hash of the bytes of the values after those
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t index = 0; index < c_goldenHashCount; ++index)
+	{
+		uint32_t value = stream.Next();
+		for (int byteIndex = 0; byteIndex < 4; ++byteIndex)
+		{
+			hash ^= (value >> (byteIndex * 8)) & 0xFF;
+			hash *= 0x100000001b3ull;
+		}
+	}
+	if (hash != c_goldenHash)
+	{
+		printf("Fixed point golden test failed: hash was 0x%016llx, expected 0x%016llx\n", (unsigned long long)hash, (unsigned long long)c_goldenHash);
+		ret = false;
+	}
+
+	return ret;
+}
+
+// NoiseStreamSeekable has to give the same bits as running the stream, for any index, one at a time or batched
+template <typename PROGRAM>
+bool SeekableProgramTest(const char* label)
+{
+	static const size_t c_sequentialCount = 100000;
+
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 0xa000b800, 0);
+	NoiseStreamSPMD<1, PROGRAM> stream(&rng);
+	NoiseStreamSeekable<PROGRAM> seekable(rng);
+
+	// the indices backwards, so the batches aren't in order
+	std::vector<float> sequential(c_sequentialCount);
+	std::vector<uint64_t> indices(c_sequentialCount);
+	for (size_t index = 0; index < c_sequentialCount; ++index)
+	{
+		stream.Next(&sequential[index]);
+		indices[index] = c_sequentialCount - 1 - index;
+	}
+
+	std::vector<float> batched(c_sequentialCount);
+	seekable.SampleAt(indices.data(), batched.data(), batched.size());
+
+	size_t scalarMismatches = 0;
+	size_t batchedMismatches = 0;
+	for (size_t index = 0; index < c_sequentialCount; ++index)
+	{
+		if (seekable.SampleAt(index) != sequential[index])
+			scalarMismatches++;
+		if (batched[c_sequentialCount - 1 - index] != sequential[index])
+			batchedMismatches++;
+	}
+
+	// far out indices can't be checked against the stream, but the two ways should agree
+	static const uint64_t c_farIndices[] = { 1ull << 32, (1ull << 40) + 12345, 0xFFFFFFFFFFFFFFFFull };
+	float farBatched[_countof(c_farIndices)];
+	seekable.SampleAt(c_farIndices, farBatched, _countof(c_farIndices));
+	for (size_t index = 0; index < _countof(c_farIndices); ++index)
+	{
+		if (seekable.SampleAt(c_farIndices[index]) != farBatched[index])
+			batchedMismatches++;
+	}
+
+	if (scalarMismatches > 0 || batchedMismatches > 0)
+	{
+		printf("Seekable test failed for %s: %zu scalar and %zu batched mismatches\n", label, scalarMismatches, batchedMismatches);
+		return false;
+	}
+	return true;
+}
+
+bool SeekableTest()
+{
+	bool ret = true;
+	ret &= SeekableProgramTest<BlueNoiseLUTProgram>("LUT");
+	ret &= SeekableProgramTest<BlueNoisePolynomialProgram>("Polynomial");
+	ret &= SeekableProgramTest<BlueNoiseHermiteProgram>("Hermite");
+	ret &= SeekableProgramTest<RedNoisePolynomialProgram>("Red Polynomial");
+	return ret;
+}
+
+// A kernel with fewer taps than BlueNoiseStreamFIR<N> is the same as one padded out to N taps with zeros
+bool FIRShortKernelTest()
+{
+	const std::vector<float> CDF = { 0.0f, 0.25f, 0.75f, 1.0f };
+	const std::vector<float> shortKernel = { 0.5f, -1.0f, 0.5f };
+	const std::vector<float> paddedKernel = { 0.5f, -1.0f, 0.5f, 0.0f, 0.0f };
+
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 0xa000b800, 0);
+	BlueNoiseStreamFIR<5> shortStream(rng, shortKernel, CDF);
+	BlueNoiseStreamFIR<5> paddedStream(rng, paddedKernel, CDF);
+
+	for (int index = 0; index < 10000; ++index)
+	{
+		float shortValue = shortStream.Next();
+		float paddedValue = paddedStream.Next();
+		if (shortValue != paddedValue)
+		{
+			printf("Value %d of the short kernel was %f, and %f padded\n", index, shortValue, paddedValue);
+			return false;
+		}
+	}
+	return true;
+}
+
+// A designed FIR filter has to meet the spec it was designed to.
+// * The power spectrum of { -0.25, 0.5, -0.25 } is sin(pi f)^4, and its amplitude is a cosine series with 3 terms, so
+//   least squares with 3 taps has to find those taps, and the error against the target has to be 0.
+// * Blue noise (power f) can't be matched exactly, since its amplitude has an infinite slope at DC, but the power
+//   spectrum of the designs, scaled to the same average power, has to be near the target at every frequency, rising
+//   from well below average at DC to above average at Nyquist. More taps have to get closer.
+bool FilterDesignTest()
+{
+	bool ret = true;
+
+	auto exactTarget = [](double f) { return std::pow(std::sin(3.14159265358979323846 * f), 4.0); };
+	const float exactTaps[3] = { -0.25f, 0.5f, -0.25f };
+	DesignedFilter exact = DesignFIRLeastSquares(exactTarget, 3);
+	for (size_t index = 0; index < 3; ++index)
+	{
+		if (exact.xCoefficients.size() != 3 || std::abs(exact.xCoefficients[index] - exactTaps[index]) > 1e-6f)
+		{
+			printf("Least squares design of sin(pi f)^4 gave %s, not { -0.25, 0.5, -0.25 }\n", exact.Code().c_str());
+			ret = false;
+			break;
+		}
+	}
+	if (exact.maxError > 1e-5)
+	{
+		printf("%s, should be 0\n", exact.Description().c_str());
+		ret = false;
+	}
+
+	auto blueTarget = [](double f) { return f; };
+	double lastRMSError = 1e30;
+	for (int taps : { 5, 9, 17 })
+	{
+		for (const DesignedFilter& design : { DesignFIRWindow(blueTarget, taps), DesignFIRLeastSquares(blueTarget, taps) })
+		{
+			std::vector<double> power = FilterPowerSpectrum(design.xCoefficients, {});
+			double meanPower = 0.0;
+			double meanTarget = 0.0;
+			for (size_t index = 0; index < power.size(); ++index)
+			{
+				meanPower += power[index] / double(power.size());
+				meanTarget += blueTarget(double(index) / double(c_filterDesignFFTSize)) / double(power.size());
+			}
+
+			double maxError = 0.0;
+			for (size_t index = 0; index < power.size(); ++index)
+			{
+				double target = blueTarget(double(index) / double(c_filterDesignFFTSize));
+				maxError = std::max(maxError, std::abs(power[index] * meanTarget / meanPower - target) / meanTarget);
+			}
+
+			if (maxError > 0.4 || power[0] > 0.4 * meanPower || power.back() < meanPower)
+			{
+				printf("%s, with a max error of %f, and power %f at DC, %f at Nyquist, and %f on average\n", design.Description().c_str(), maxError, power[0], power.back(), meanPower);
+				ret = false;
+			}
+		}
+
+		DesignedFilter leastSquares = DesignFIRLeastSquares(blueTarget, taps);
+		if (leastSquares.RMSError >= lastRMSError)
+		{
+			printf("%s, which isn't better than the RMS error %f of fewer taps\n", leastSquares.Description().c_str(), lastRMSError);
+			ret = false;
+		}
+		lastRMSError = leastSquares.RMSError;
+	}
+	return ret;
+}
+
+// Fits with known answers.
+// * The minimax line through x^2 on [0,1] is x - 1/8, with error +1/8, -1/8, +1/8 at 0, 1/2 and 1.
+// * x / (1 + x) is a rational function, so a 1/1 rational fit has to match it to float precision.
+// * A denominator can go negative between the points of the table, which the check over the interval has to catch.
+bool MinimaxFitTest()
+{
+	using namespace MinimaxFitInternal;
+	bool ret = true;
+
+	static const size_t c_pointCount = 1001;
+	std::vector<float> square(c_pointCount);
+	std::vector<float> rational(c_pointCount);
+	for (size_t index = 0; index < c_pointCount; ++index)
+	{
+		float x = float(index) / float(c_pointCount - 1);
+		square[index] = x * x;
+		rational[index] = x / (1.0f + x);
+	}
+
+	RationalFit line;
+	if (!MinimaxFit(square, 1, 0, 1, line) || std::abs(line.maxError - 0.125f) > 1e-5f ||
+		std::abs(line.numerator[0] - 1.0f) > 1e-5f || std::abs(line.numerator[1] + 0.125f) > 1e-5f)
+	{
+		printf("The minimax line through x^2 was %s, not x - 0.125 with a max error of 0.125\n", line.CoefficientArrays().c_str());
+		ret = false;
+	}
+	else
+	{
+		const float errors[3] = { -line.Evaluate(0.0f), 0.25f - line.Evaluate(0.5f), 1.0f - line.Evaluate(1.0f) };
+		for (int index = 0; index < 3; ++index)
+		{
+			if (std::abs(errors[index] - ((index % 2 == 0) ? 0.125f : -0.125f)) > 1e-5f)
+			{
+				printf("The minimax line through x^2 doesn't equioscillate: errors %f %f %f\n", errors[0], errors[1], errors[2]);
+				ret = false;
+				break;
+			}
+		}
+	}
+
+	RationalFit exact;
+	if (!MinimaxFit(rational, 1, 1, 1, exact) || exact.maxError > 1e-6f)
+	{
+		printf("The 1/1 rational fit of x / (1 + x) has a max error of %g\n", exact.maxError);
+		ret = false;
+	}
+
+	// (x - 0.5005)^2 - 1e-8 is positive at every point of a 1001 point table, but negative around 0.5005
+	const std::vector<double> denominator = { 0.5005 * 0.5005 - 1e-8, -2.0 * 0.5005, 1.0 };
+	double pointsMinimum = HUGE_VAL;
+	for (size_t index = 0; index < c_pointCount; ++index)
+		pointsMinimum = std::min(pointsMinimum, EvaluatePolynomial(denominator, double(index) / double(c_pointCount - 1)));
+	double intervalMinimum = PolynomialMinimum(denominator, 0.0, 1.0);
+	if (pointsMinimum <= 0.0 || std::abs(intervalMinimum + 1e-8) > 1e-12)
+	{
+		printf("The denominator's minimum was %g at the points and %g over the interval, not positive and -1e-8\n", pointsMinimum, intervalMinimum);
+		ret = false;
+	}
+
+	return ret;
+}
+
+// Least squares fits with known answers. A cubic with f(0) = 0 and f(1) = 1, like smoothstep, has to be fit exactly by
+// cubic pieces, and a fit that can't be exact, like sqrt by lines, still has to meet the end and continuity constraints.
+bool LeastSquaresFitTest()
+{
+	bool ret = true;
+
+	static const size_t c_pointCount = 1001;
+	std::vector<float> smoothstep(c_pointCount);
+	std::vector<float> squareRoot(c_pointCount);
+	for (size_t index = 0; index < c_pointCount; ++index)
+	{
+		float x = float(index) / float(c_pointCount - 1);
+		smoothstep[index] = x * x * (3.0f - 2.0f * x);
+		squareRoot[index] = std::sqrt(x);
+	}
+	const std::vector<float> weights(c_pointCount, 1.0f);
+
+	LeastSquaresPolynomialFit<3, 4> cubic;
+	FitCDF(cubic, smoothstep, weights);
+	float maxError = 0.0f;
+	for (size_t index = 0; index < c_pointCount; ++index)
+		maxError = std::max(maxError, std::abs(cubic.Evaluate(float(index) / float(c_pointCount - 1)) - smoothstep[index]));
+	if (maxError > 1e-5f)
+	{
+		printf("The cubic least squares fit of smoothstep has a max error of %g\n", maxError);
+		ret = false;
+	}
+
+	LeastSquaresPolynomialFit<1, 4> lines;
+	FitCDF(lines, squareRoot, weights);
+	if (std::abs(lines.Evaluate(0.0f)) > 1e-5f || std::abs(lines.Evaluate(1.0f) - 1.0f) > 1e-5f)
+	{
+		printf("The line fit of sqrt goes from %f to %f, not 0 to 1\n", lines.Evaluate(0.0f), lines.Evaluate(1.0f));
+		ret = false;
+	}
+	for (size_t knot = 1; knot < 4; ++knot)
+	{
+		float x = lines.GetKnots()[knot];
+		float left = lines.Evaluate(std::nextafter(x, 0.0f));
+		float right = lines.Evaluate(x);
+		if (std::abs(left - right) > 1e-5f)
+		{
+			printf("The line fit of sqrt jumps from %f to %f at %f\n", left, right, x);
+			ret = false;
+		}
+	}
+
+	return ret;
+}
+
+// The column store codec has to give back what went in: the bit packing, byte shuffling and LZ stages each on their
+// own, then whole columns, with float columns within their max error, and non-finite floats stored as they are.
+// A file with a corrupt directory has to fail to open.
+bool ColumnStoreTest()
+{
+	using namespace ColumnStoreInternal;
+	bool ret = true;
+
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, 0xa000b800, 0);
+	auto Random64 = [&]()
+	{
+		uint64_t high = pcg32_random_r(&rng);
+		return (high << 32) | pcg32_random_r(&rng);
+	};
+
+	// every width, with an odd count so the values don't end on a byte
+	for (uint8_t width = 0; width <= 64; ++width)
+	{
+		std::vector<uint64_t> values(1001), unpacked(1001);
+		for (uint64_t& value : values)
+			value = (width == 0) ? 0 : Random64() >> (64 - width);
+		std::vector<uint8_t> packed;
+		BitPack(values.data(), values.size(), width, packed);
+		BitUnpack(packed.data(), values.size(), width, unpacked.data());
+		if (packed.size() != (values.size() * width + 7) / 8 || unpacked != values)
+		{
+			printf("BitPack / BitUnpack don't round trip at width %i\n", (int)width);
+			ret = false;
+		}
+	}
+
+	for (uint8_t width = 1; width <= 4; ++width)
+	{
+		std::vector<uint32_t> values(1001), unshuffled(1001);
+		for (uint32_t& value : values)
+			value = (width == 4) ? pcg32_random_r(&rng) : pcg32_random_r(&rng) & ((1u << (width * 8)) - 1);
+		std::vector<uint8_t> shuffled;
+		ShuffleBytes(values.data(), values.size(), width, shuffled);
+		UnshuffleBytes(shuffled.data(), values.size(), width, unshuffled.data());
+		if (unshuffled != values)
+		{
+			printf("ShuffleBytes / UnshuffleBytes don't round trip at width %i\n", (int)width);
+			ret = false;
+		}
+	}
+
+	// repeats, overlapping matches, and bytes that don't compress
+	{
+		std::vector<uint8_t> bytes;
+		for (int index = 0; index < 5000; ++index)
+			bytes.push_back(uint8_t(index % 7));
+		bytes.insert(bytes.end(), 3000, 0xAB);
+		for (int index = 0; index < 5000; ++index)
+			bytes.push_back(uint8_t(pcg32_random_r(&rng)));
+		std::vector<uint8_t> compressed, decompressed;
+		LZCompress(bytes, compressed);
+		if (compressed.size() >= bytes.size() || !LZDecompress(compressed.data(), compressed.size(), decompressed, bytes.size()) || decompressed != bytes)
+		{
+			printf("LZCompress / LZDecompress don't round trip\n");
+			ret = false;
+		}
+		if (LZDecompress(compressed.data(), compressed.size() / 2, decompressed, bytes.size()))
+		{
+			printf("LZDecompress took a truncated input\n");
+			ret = false;
+		}
+	}
+
+	// whole columns, over several blocks with a short last block
+	static const size_t c_blockSize = 1000;
+	static const size_t c_count = 4321;
+	static const float c_maxError = 0.0005f;
+	std::vector<size_t> indices(c_count);
+	std::vector<float> noise(c_count), nonFinite(c_count);
+	for (size_t index = 0; index < c_count; ++index)
+	{
+		indices[index] = pcg32_random_r(&rng) % 100000;
+		noise[index] = ldexpf((float)pcg32_random_r(&rng), -32) * 2.0f - 1.0f;
+		nonFinite[index] = noise[index];
+	}
+	nonFinite[10] = std::numeric_limits<float>::quiet_NaN();
+	nonFinite[1500] = std::numeric_limits<float>::infinity();
+	nonFinite[2500] = -std::numeric_limits<float>::infinity();
+
+	const char* fileName = "columnstoretest.col";
+	{
+		ColumnStoreWriter writer(fileName, c_blockSize);
+		writer.AddIndexColumn("indices", indices);
+		writer.AddFloatColumn("noise", noise, c_maxError);
+		writer.AddFloatColumn("lossless", noise, 0.0f);
+		writer.AddFloatColumn("nonfinite", nonFinite, c_maxError);
+		if (!writer.Close())
+		{
+			printf("Couldn't write %s\n", fileName);
+			return false;
+		}
+	}
+
+	{
+		ColumnStoreReader reader;
+		std::vector<size_t> readIndices;
+		std::vector<std::vector<float>> readFloats;
+		if (!reader.Open(fileName) || reader.Columns().size() != 4 ||
+			!reader.ReadColumn(reader.FindColumn("indices"), readIndices) ||
+			!reader.ReadColumns({ 1, 2, 3 }, readFloats))
+		{
+			printf("Couldn't read %s back\n", fileName);
+			remove(fileName);
+			return false;
+		}
+
+		if (readIndices != indices)
+		{
+			printf("The index column didn't round trip\n");
+			ret = false;
+		}
+		for (size_t index = 0; index < c_count; ++index)
+		{
+			if (!(std::abs(readFloats[0][index] - noise[index]) <= c_maxError))
+			{
+				printf("Float value %zu was %f, more than %f from %f\n", index, readFloats[0][index], c_maxError, noise[index]);
+				ret = false;
+				break;
+			}
+		}
+		if (memcmp(readFloats[1].data(), noise.data(), c_count * sizeof(float)) != 0)
+		{
+			printf("The lossless float column didn't round trip\n");
+			ret = false;
+		}
+		// the blocks with a NaN or infinity are stored raw, so are exact, and the others are within the max error
+		for (size_t index = 0; index < c_count; ++index)
+		{
+			float value = readFloats[2][index];
+			bool rawBlock = (index / c_blockSize == 0) || (index / c_blockSize == 1) || (index / c_blockSize == 2);
+			bool same = rawBlock ? memcmp(&value, &nonFinite[index], sizeof(float)) == 0 : std::abs(value - nonFinite[index]) <= c_maxError;
+			if (!same)
+			{
+				printf("Non finite column value %zu was %f, not %f\n", index, value, nonFinite[index]);
+				ret = false;
+				break;
+			}
+		}
+	}
+
+	// corrupt the directory: the directory offset is 12 bytes from the end, and the first column's entry starts after
+	// the column count with its label length, then the label, kind, max error, value count, block count and blocks
+	std::vector<uint8_t> file;
+	{
+		FILE* in = nullptr;
+		fopen_s(&in, fileName, "rb");
+		if (!in)
+			return false;
+		_fseeki64(in, 0, SEEK_END);
+		file.resize((size_t)_ftelli64(in));
+		_fseeki64(in, 0, SEEK_SET);
+		fread(file.data(), 1, file.size(), in);
+		fclose(in);
+	}
+	uint64_t directoryOffset;
+	memcpy(&directoryOffset, &file[file.size() - 12], sizeof(directoryOffset));
+	const size_t labelLengthOffset = size_t(directoryOffset) + 4;
+	const size_t valueCountOffset = labelLengthOffset + 4 + strlen("indices") + 4 + 4;
+	const size_t firstBlockCountOffset = valueCountOffset + 8 + 4 + 8 + 4;
+
+	struct Corruption
+	{
+		const char* what;
+		size_t offset;
+		uint32_t value;
+	};
+	const Corruption corruptions[] =
+	{
+		{ "a huge label length", labelLengthOffset, 0xFFFFFFF0 },
+		{ "a value count one more than its blocks hold", valueCountOffset, uint32_t(c_count + 1) },
+		{ "a block count over the block size", firstBlockCountOffset, uint32_t(c_blockSize + 1) },
+		{ "a huge block count", firstBlockCountOffset, 0xFFFFFFF0 },
+		{ "a block past the directory", firstBlockCountOffset - 4, 0xFFFFFF },
+	};
+	for (const Corruption& corruption : corruptions)
+	{
+		std::vector<uint8_t> corrupt = file;
+		memcpy(&corrupt[corruption.offset], &corruption.value, sizeof(corruption.value));
+		FILE* out = nullptr;
+		fopen_s(&out, fileName, "wb");
+		if (!out)
+			return false;
+		fwrite(corrupt.data(), 1, corrupt.size(), out);
+		fclose(out);
+
+		ColumnStoreReader reader;
+		if (reader.Open(fileName))
+		{
+			printf("A column store with %s opened\n", corruption.what);
+			ret = false;
+		}
+	}
+
+	// and truncated
+	{
+		FILE* out = nullptr;
+		fopen_s(&out, fileName, "wb");
+		if (!out)
+			return false;
+		fwrite(file.data(), 1, file.size() / 2, out);
+		fclose(out);
+
+		ColumnStoreReader reader;
+		if (reader.Open(fileName))
+		{
+			printf("A truncated column store opened\n");
+			ret = false;
+		}
+	}
+
+	remove(fileName);
+	return ret;
+}
+
+// Each lane of a wide NoiseStreamSPMD has to give the same bits as a width 1 stream made from the same generator
+template <typename PROGRAM>
+bool SPMDLanesMatch(const char* name, const PROGRAM& program)
+{
+	static const int c_width = 8;
+	pcg32_random_t rngs[c_width];
+	for (int lane = 0; lane < c_width; ++lane)
+		pcg32_srandom_r(&rngs[lane], 0xa000b800, lane);
+
+	NoiseStreamSPMD<c_width, PROGRAM> wide(rngs, program);
+	std::vector<NoiseStreamSPMD<1, PROGRAM>> narrow;
+	for (int lane = 0; lane < c_width; ++lane)
+		narrow.emplace_back(&rngs[lane], program);
+
+	for (int index = 0; index < 10000; ++index)
+	{
+		float wideValues[c_width];
+		wide.Next(wideValues);
+		for (int lane = 0; lane < c_width; ++lane)
+		{
+			float value;
+			narrow[lane].Next(&value);
+			if (value != wideValues[lane])
+			{
+				printf("%s: value %d of lane %d was %f, and %f at width 1\n", name, index, lane, wideValues[lane], value);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool SPMDLanesTest()
+{
+	std::vector<float> table(256);
+	for (size_t index = 0; index < table.size(); ++index)
+		table[index] = float(index) / float(table.size() - 1);
+	const float* paddedTable = TableRegistry::Get().Register(PadTable(table));
+
+	TunedCDF tuned;
+	tuned.type = TunedCDFType::LUT;
+	tuned.pieces = int(table.size());
+	tuned.values = table;
+
+	bool ret = true;
+	ret &= SPMDLanesMatch("LUT", BlueNoiseLUTProgram());
+	ret &= SPMDLanesMatch("Polynomial", BlueNoisePolynomialProgram());
+	ret &= SPMDLanesMatch("Hermite", BlueNoiseHermiteProgram());
+	ret &= SPMDLanesMatch("Fused", BlueNoiseFusedProgram{ paddedTable, table.size() });
+	ret &= SPMDLanesMatch("CDF table", BlueNoiseCDFTableProgram{ paddedTable, table.size() });
+	ret &= SPMDLanesMatch("Red noise", RedNoisePolynomialProgram());
+	ret &= WithTunedProgram(tuned, [](const auto& program) { return SPMDLanesMatch("Tuned", program); });
+	return ret;
+}
+
+// Every dispatch path has to give the same bits as the scalar path. ctest runs this once for each TOUNIFORM_ISA, so
+// the path that Kernels() picks runs on each one.
+bool DispatchTest()
+{
+	bool ret = DispatchSelfTest();
+
+	// the forced path, or the best one the CPU can run if it can't run that
+	DispatchISA expected = DispatchInternal::ISAOverride();
+	if (expected == DispatchISA::Count || (int)expected > (int)DetectedISA())
+		expected = DetectedISA();
+	printf("  Noise kernels: %s (CPU supports %s)\n", DispatchISAName(Kernels().ISA), DispatchISAName(DetectedISA()));
+	if (Kernels().ISA != expected)
+	{
+		printf("Kernels() picked %s, not %s\n", DispatchISAName(Kernels().ISA), DispatchISAName(expected));
+		ret = false;
+	}
+	return ret;
+}
+
+// Each channel of NoiseStreamChannels has to give the same values as a BlueNoiseStreamPolynomial seeded the same way.
+// It picks its step function from Kernels().ISA, so ctest runs this once for each TOUNIFORM_ISA, like DispatchTest.
+bool NoiseStreamChannelsTest()
+{
+	printf("  Noise kernels: %s\n", DispatchISAName(Kernels().ISA));
+
+	// an odd count, so the vector loops have a remainder
+	static const size_t c_channelCount = 1001;
+	static const size_t c_steps = 100;
+	NoiseStreamChannels<BlueNoisePolynomialProgram> channels(0xa000b800, c_channelCount);
+	std::vector<float> values(c_channelCount * c_steps);
+	channels.Next(values.data(), c_steps);
+	for (size_t channel = 0; channel < c_channelCount; ++channel)
+	{
+		pcg32_random_t rng;
+		pcg32_srandom_r(&rng, 0xa000b800, channel);
+		BlueNoiseStreamPolynomial stream(rng);
+		for (size_t step = 0; step < c_steps; ++step)
+		{
+			float value = stream.Next();
+			if (values[step * c_channelCount + channel] != value)
+			{
+				printf("NoiseStreamChannels channel %zu step %zu was %f, not %f\n", channel, step, values[step * c_channelCount + channel], value);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// A C API stream has to give the same values as the C++ stream, with every implementation the CPU has, filling in
+// uneven amounts so the SIMD fills end partway through their blocks
+template <typename STREAM>
+bool CAPIMatches(const char* name, ToUniform_Stream* cStream, STREAM stream)
+{
+	static const size_t c_fillSizes[] = { 1, 2, 7, 300, 1000, 4096, 3 };
+
+	bool matches = true;
+	std::vector<float> values;
+	for (size_t fillSize : c_fillSizes)
+	{
+		values.resize(fillSize);
+		ToUniform_Fill(cStream, values.data(), fillSize);
+		for (float value : values)
+			matches &= (value == stream.Next());
+	}
+	ToUniform_DestroyStream(cStream);
+
+	if (!matches)
+		printf("The C API %s stream doesn't match C++ with the %s implementation\n", name, ToUniform_ImplementationName(ToUniform_GetImplementation()));
+	return matches;
+}
+
+bool CAPITest()
+{
+	static const uint64_t c_seed = 0xa000b800;
+	static const uint64_t c_sequence = 1;
+
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, c_seed, c_sequence);
+
+	std::vector<float> CDF(64);
+	for (size_t index = 0; index < CDF.size(); ++index)
+		CDF[index] = float(index * index) / float((CDF.size() - 1) * (CDF.size() - 1));
+
+	bool ret = true;
+	for (int implementation = ToUniform_Scalar; implementation < ToUniform_ImplementationCount; ++implementation)
+	{
+		if (!ToUniform_SetImplementation((ToUniform_Implementation)implementation))
+			continue;
+
+		ret &= CAPIMatches("LUT", ToUniform_CreateStream(ToUniform_BlueNoiseLUT, c_seed, c_sequence), BlueNoiseStreamLUT(rng));
+		ret &= CAPIMatches("Polynomial", ToUniform_CreateStream(ToUniform_BlueNoisePolynomial, c_seed, c_sequence), BlueNoiseStreamPolynomial(rng));
+		ret &= CAPIMatches("Hermite", ToUniform_CreateStream(ToUniform_BlueNoiseHermite, c_seed, c_sequence), BlueNoiseStreamHermite(rng));
+		ret &= CAPIMatches("Red Polynomial", ToUniform_CreateStream(ToUniform_RedNoisePolynomial, c_seed, c_sequence), RedNoiseStreamPolynomial(rng));
+		ret &= CAPIMatches("CDF table", ToUniform_CreateStreamFromTable(CDF.data(), CDF.size(), c_seed, c_sequence), BlueNoiseStreamCDFTable(rng, CDFTableLevel{ CDF }));
+	}
+	ToUniform_SetImplementation(ToUniform_Auto);
+
+	// Streams made from tables that nothing else uses give their tables back to the registry when destroyed, so making
+	// and destroying them doesn't grow it
+	TableRegistry& registry = TableRegistry::Get();
+	size_t tableCount = registry.TableCount();
+	size_t bytesUsed = registry.BytesUsed();
+	for (int index = 0; index < 1000; ++index)
+	{
+		CDF[1] = float(index) / 1000000.0f;
+		ToUniform_Stream* first = ToUniform_CreateStreamFromTable(CDF.data(), CDF.size(), c_seed, c_sequence);
+		ToUniform_Stream* second = ToUniform_CreateStreamFromTable(CDF.data(), CDF.size(), c_seed, c_sequence);
+		ToUniform_DestroyStream(first);
+		float value;
+		ToUniform_Fill(second, &value, 1);
+		ToUniform_DestroyStream(second);
+	}
+	if (registry.TableCount() != tableCount || registry.BytesUsed() != bytesUsed)
+	{
+		printf("C API CDF table streams grew the table registry from %zu tables, %zu bytes to %zu tables, %zu bytes\n", tableCount, bytesUsed, registry.TableCount(), registry.BytesUsed());
+		ret = false;
+	}
+	return ret;
+}
+
+// Many threads checking slots out and returning them as fast as they can, more threads than slots, so the free list
+// runs empty and gets pushed and popped under contention. A slot must never be checked out by two threads at once,
+// and every slot has to be back in the free list at the end.
+bool NoiseStreamPoolStressTest()
+{
+	static const uint32_t c_slotCount = 8;
+	static const int c_threadCount = 16;
+	static const int c_iterations = 20000;
+
+	typedef NoiseStreamPool<BlueNoiseStreamLUT, 16> Pool;
+	Pool pool(0xa000b800, c_slotCount);
+
+	std::atomic<int> owners[c_slotCount];
+	for (std::atomic<int>& owner : owners)
+		owner = 0;
+	std::atomic<int> doubleCheckouts{ 0 };
+	std::atomic<int> emptyCheckouts{ 0 };
+
+	std::vector<std::thread> threads;
+	for (int threadIndex = 0; threadIndex < c_threadCount; ++threadIndex)
+	{
+		threads.emplace_back([&]()
+			{
+				float sum = 0.0f;
+				for (int iteration = 0; iteration < c_iterations; ++iteration)
+				{
+					Pool::Slot* slot = pool.Checkout();
+					if (!slot)
+					{
+						emptyCheckouts++;
+						std::this_thread::yield();
+						continue;
+					}
+					if (owners[slot->index].exchange(1) != 0)
+						doubleCheckouts++;
+					for (int sample = 0; sample < 3; ++sample)
+						sum += slot->Next();
+					owners[slot->index] = 0;
+					pool.Return(slot);
+				}
+				volatile float sink = sum;
+				(void)sink;
+			}
+		);
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	bool ret = true;
+	if (doubleCheckouts > 0)
+	{
+		printf("%d times, a slot was checked out by two threads at once\n", doubleCheckouts.load());
+		ret = false;
+	}
+
+	// every slot comes back out exactly once, then the pool is empty
+	bool seen[c_slotCount] = {};
+	for (uint32_t index = 0; index < c_slotCount; ++index)
+	{
+		Pool::Slot* slot = pool.Checkout();
+		if (!slot || seen[slot->index])
+		{
+			printf("The free list lost or duplicated a slot\n");
+			return false;
+		}
+		seen[slot->index] = true;
+	}
+	if (pool.Checkout() != nullptr)
+	{
+		printf("The free list has more slots than the pool\n");
+		ret = false;
+	}
+
+	printf("  %d checkouts found the pool empty\n", emptyCheckouts.load());
+	return ret;
+}
+
+// A thread that outlives a pool mustn't get that pool's slot back from ThreadLocalSlot() of a new pool made at the
+// same address, or return the slot to it when the thread exits. The new pool's free list shows which: the thread's
+// slot in it has to come out of its free list, and go back in when the thread exits.
+bool NoiseStreamPoolReuseTest()
+{
+	typedef NoiseStreamPool<BlueNoiseStreamLUT, 16> Pool;
+	static const uint32_t c_slotCount = 2;
+	alignas(Pool) unsigned char storage[sizeof(Pool)];
+	Pool* second = nullptr;
+
+	bool ret = true;
+	std::thread thread([&]()
+		{
+			Pool* first = new (storage) Pool(1, c_slotCount);
+			first->ThreadLocalSlot();
+			first->~Pool();
+
+			second = new (storage) Pool(2, c_slotCount);
+			Pool::Slot* slot = second->ThreadLocalSlot();
+			if (slot == nullptr || second->FreeSlotCount() != c_slotCount - 1)
+			{
+				printf("ThreadLocalSlot didn't check a slot out of a new pool at the address of a destroyed one\n");
+				ret = false;
+			}
+			if (second->ThreadLocalSlot() != slot || second->FreeSlotCount() != c_slotCount - 1)
+			{
+				printf("ThreadLocalSlot didn't give the same slot the second time\n");
+				ret = false;
+			}
+		}
+	);
+	thread.join();
+
+	if (second->FreeSlotCount() != c_slotCount)
+	{
+		printf("The thread's slot didn't go back to the pool when it exited, or a slot went back twice\n");
+		ret = false;
+	}
+	second->~Pool();
+	return ret;
+}
+
+struct Test
+{
+	const char* name;
+	bool (*function)();
+};
+
+static const Test c_tests[] =
+{
+	{ "PlatformShims", PlatformShimsTest },
+	{ "CDFCacheCorruptCount", CDFCacheCorruptCountTest },
+	{ "TabulatedICDF", TabulatedICDFTest },
+	{ "ColumnStore", ColumnStoreTest },
+	{ "FixedPointGolden", FixedPointGoldenTest },
+	{ "Seekable", SeekableTest },
+	{ "FIRShortKernel", FIRShortKernelTest },
+	{ "FilterDesign", FilterDesignTest },
+	{ "MinimaxFit", MinimaxFitTest },
+	{ "LeastSquaresFit", LeastSquaresFitTest },
+	{ "SPMDLanes", SPMDLanesTest },
+	{ "Dispatch", DispatchTest },
+	{ "NoiseStreamChannels", NoiseStreamChannelsTest },
+	{ "CAPI", CAPITest },
+	{ "NoiseStreamPoolStress", NoiseStreamPoolStressTest },
+	{ "NoiseStreamPoolReuse", NoiseStreamPoolReuseTest },
+};
+
+int main(int argc, char** argv)
+{
+	std::vector<const Test*> tests;
+	if (argc < 2)
+	{
+		for (const Test& test : c_tests)
+			tests.push_back(&test);
+	}
+	for (int argIndex = 1; argIndex < argc; ++argIndex)
+	{
+		const Test* found = nullptr;
+		for (const Test& test : c_tests)
+		{
+			if (strcmp(test.name, argv[argIndex]) == 0)
+				found = &test;
+		}
+		if (!found)
+		{
+			printf("There is no test named %s\n", argv[argIndex]);
+			return 1;
+		}
+		tests.push_back(found);
+	}
+
+	int failed = 0;
+	for (const Test* test : tests)
+	{
+		bool passed = test->function();
+		printf("%s: %s\n", test->name, passed ? "passed" : "FAILED");
+		failed += passed ? 0 : 1;
+	}
+
+	if (failed > 0)
+		printf("%d of %zu tests failed\n", failed, tests.size());
+	return (failed > 0) ? 1 : 0;
+}
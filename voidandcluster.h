@@ -0,0 +1,377 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <cmath>
+#include <thread>
+#include <algorithm>
+#include "pcg/pcg_basic.h"
+#include "platform.h"
+
+// Makes 1D blue noise with the void and cluster algorithm, like the sequences in the bluenoise folder.
+// https://blog.demofox.org/2019/06/25/generating-blue-noise-textures-with-void-and-cluster/
+// The result is the rank of each position, so is a permutation of [0, length). It wraps around (is toroidal).
+//
+// The energy at each position is a gaussian weighted count of the 1s around it, truncated to footprintRadius.
+// When a position is flipped, the gaussian of that one position is added to or subtracted from the energies within
+// the footprint, and the tightest cluster (highest energy 1) and largest void (lowest energy 0) come from heaps,
+// instead of scanning every position each step.
+//
+// The gaussian weights are fixed point integers, so adding and subtracting them is exact. With doubles, the errors
+// left behind would be bigger than the weights at the edge of the footprint, and would decide which of several
+// equally large voids is filled first, instead of the random tie break.
+struct VoidAndClusterSettings
+{
+	float sigma = 1.0f;
+	int footprintRadius = 0; // 0 means 3 sigma, where the gaussian has fallen to about 1%
+	float initialDensity = 0.1f;
+};
+
+namespace VoidAndClusterInternal
+{
+	// A heap of positions, which knows where each position is in the heap, so their energy can be updated.
+	// Ties in energy are broken by a random number per position, so big empty areas don't fill in order.
+	// The energy and tie break are kept in the heap entries, so sifting doesn't jump around memory to compare.
+	template <bool MAXHEAP>
+	class EnergyHeap
+	{
+	public:
+		EnergyHeap(size_t length)
+			: m_heapIndex(length, -1)
+		{
+		}
+
+		bool Empty() const { return m_heap.empty(); }
+		int Top() const { return m_heap[0].position; }
+
+		void Clear()
+		{
+			for (const Entry& entry : m_heap)
+				m_heapIndex[entry.position] = -1;
+			m_heap.clear();
+		}
+
+		void Insert(int position, int64_t energy, uint32_t tieBreak)
+		{
+			m_heapIndex[position] = (int)m_heap.size();
+			m_heap.push_back({ energy, tieBreak, position });
+			SiftUp(m_heapIndex[position]);
+		}
+
+		void Remove(int position)
+		{
+			int index = m_heapIndex[position];
+			Entry last = m_heap.back();
+			m_heap.pop_back();
+			m_heapIndex[position] = -1;
+			if (last.position == position)
+				return;
+
+			m_heap[index] = last;
+			m_heapIndex[last.position] = index;
+			SiftUp(index);
+			SiftDown(m_heapIndex[last.position]);
+		}
+
+		// Call when the energy of a position changes
+		void Update(int position, int64_t energy)
+		{
+			int index = m_heapIndex[position];
+			if (index < 0)
+				return;
+
+			int64_t oldEnergy = m_heap[index].energy;
+			m_heap[index].energy = energy;
+			if ((energy > oldEnergy) == MAXHEAP)
+				SiftUp(index);
+			else
+				SiftDown(index);
+		}
+
+	private:
+		// 4 children per node makes the heap half as deep as a binary heap, and the children share a cache line.
+		static const int c_arity = 4;
+
+		struct Entry
+		{
+			int64_t energy;
+			uint32_t tieBreak;
+			int position;
+		};
+
+		static bool Before(const Entry& a, const Entry& b)
+		{
+			if (a.energy != b.energy)
+				return MAXHEAP ? (a.energy > b.energy) : (a.energy < b.energy);
+			return a.tieBreak < b.tieBreak;
+		}
+
+		void SiftUp(int index)
+		{
+			Entry entry = m_heap[index];
+			while (index > 0)
+			{
+				int parent = (index - 1) / c_arity;
+				if (!Before(entry, m_heap[parent]))
+					break;
+				m_heap[index] = m_heap[parent];
+				m_heapIndex[m_heap[index].position] = index;
+				index = parent;
+			}
+			m_heap[index] = entry;
+			m_heapIndex[entry.position] = index;
+		}
+
+		void SiftDown(int index)
+		{
+			Entry entry = m_heap[index];
+			int count = (int)m_heap.size();
+			while (true)
+			{
+				int firstChild = index * c_arity + 1;
+				if (firstChild >= count)
+					break;
+				int child = firstChild;
+				int lastChild = std::min(firstChild + c_arity, count);
+				for (int otherChild = firstChild + 1; otherChild < lastChild; ++otherChild)
+				{
+					if (Before(m_heap[otherChild], m_heap[child]))
+						child = otherChild;
+				}
+				if (!Before(m_heap[child], entry))
+					break;
+				m_heap[index] = m_heap[child];
+				m_heapIndex[m_heap[index].position] = index;
+				index = child;
+			}
+			m_heap[index] = entry;
+			m_heapIndex[entry.position] = index;
+		}
+
+		std::vector<Entry> m_heap;
+		std::vector<int> m_heapIndex;
+	};
+
+	class Generator
+	{
+	public:
+		Generator(size_t length, pcg32_random_t& rng, const VoidAndClusterSettings& settings)
+			: m_length((int)length)
+			, m_radius(std::max(std::min(FootprintRadius(settings), ((int)length - 1) / 2), 1))
+			, m_isOne(length, 0)
+			, m_energy(length, 0)
+			, m_tieBreak(length)
+			, m_clusters(length)
+			, m_voids(length)
+		{
+			m_gaussian.resize(m_radius + 1);
+			for (int distance = 0; distance <= m_radius; ++distance)
+				m_gaussian[distance] = std::llround(std::ldexp(std::exp(-double(distance * distance) / (2.0 * double(settings.sigma) * double(settings.sigma))), c_energyFractionBits));
+
+			for (uint32_t& f : m_tieBreak)
+				f = pcg32_random_r(&rng);
+		}
+
+		std::vector<size_t> Generate(pcg32_random_t& rng, float initialDensity)
+		{
+			std::vector<size_t> ranks(m_length);
+
+			// Make the initial binary pattern by putting 1s in random places
+			int onesCount = std::max(1, int(float(m_length) * initialDensity));
+			std::vector<int> positions(m_length);
+			for (int i = 0; i < m_length; ++i)
+				positions[i] = i;
+			for (int i = 0; i < onesCount; ++i)
+				std::swap(positions[i], positions[i + pcg32_boundedrand_r(&rng, uint32_t(m_length - i))]);
+			for (int i = 0; i < onesCount; ++i)
+				m_isOne[positions[i]] = 1;
+			Reset(true, true);
+
+			// Move the 1 from the tightest cluster to the largest void, until that is the same place
+			for (int iteration = 0; iteration < m_length; ++iteration)
+			{
+				int cluster = m_clusters.Top();
+				Set(cluster, false);
+				int largestVoid = m_voids.Top();
+				Set(largestVoid, true);
+				if (largestVoid == cluster)
+					break;
+			}
+			std::vector<uint8_t> initialPattern = m_isOne;
+
+			// Phase 1: Remove the tightest clusters, ranking them from onesCount-1 down to 0
+			Reset(true, false);
+			for (int rank = onesCount - 1; rank >= 0; --rank)
+			{
+				int cluster = m_clusters.Top();
+				ranks[cluster] = rank;
+				Set(cluster, false);
+			}
+
+			// Phase 2 and 3: From the initial pattern, fill in the largest voids, ranking them from onesCount up to length-1.
+			// Phase 3 is normally done on the inverted pattern, but the tightest cluster of 0s is the largest void of 1s.
+			m_isOne = initialPattern;
+			Reset(false, true);
+			for (int rank = onesCount; rank < m_length; ++rank)
+			{
+				int largestVoid = m_voids.Top();
+				ranks[largestVoid] = rank;
+				Set(largestVoid, true);
+			}
+
+			return ranks;
+		}
+
+	private:
+		// 32 fractional bits keeps the weights out to 3 sigma to about 8 significant digits, and the energy of a whole
+		// footprint of 1s stays far from overflowing.
+		static const int c_energyFractionBits = 32;
+
+		static int FootprintRadius(const VoidAndClusterSettings& settings)
+		{
+			if (settings.footprintRadius > 0)
+				return settings.footprintRadius;
+			return std::max(int(std::ceil(3.0f * settings.sigma)), 1);
+		}
+
+		// positions are never more than the footprint radius out of range, which is less than the length
+		int Wrap(int position) const
+		{
+			if (position < 0)
+				return position + m_length;
+			if (position >= m_length)
+				return position - m_length;
+			return position;
+		}
+
+		int64_t CalculateEnergy(int position) const
+		{
+			// A 1 doesn't count itself, it's the same for every 1, and would hide small differences.
+			int64_t energy = 0;
+			if (position >= m_radius && position + m_radius < m_length)
+			{
+				const uint8_t* isOne = &m_isOne[position];
+				for (int distance = 1; distance <= m_radius; ++distance)
+					energy += m_gaussian[distance] * int64_t(isOne[-distance] + isOne[distance]);
+			}
+			else
+			{
+				for (int distance = 1; distance <= m_radius; ++distance)
+					energy += m_gaussian[distance] * int64_t(m_isOne[Wrap(position - distance)] + m_isOne[Wrap(position + distance)]);
+			}
+			return energy;
+		}
+
+		// Recalculates the energies and makes the heaps. Phase 1 only needs the clusters, and phase 2 and 3 only need the voids,
+		// so the other heap isn't kept up to date, which halves the work per step.
+		void Reset(bool trackClusters, bool trackVoids)
+		{
+			m_trackClusters = trackClusters;
+			m_trackVoids = trackVoids;
+			m_clusters.Clear();
+			m_voids.Clear();
+			for (int i = 0; i < m_length; ++i)
+			{
+				m_energy[i] = CalculateEnergy(i);
+				if (m_isOne[i] && m_trackClusters)
+					m_clusters.Insert(i, m_energy[i], m_tieBreak[i]);
+				else if (!m_isOne[i] && m_trackVoids)
+					m_voids.Insert(i, m_energy[i], m_tieBreak[i]);
+			}
+		}
+
+		void Set(int position, bool one)
+		{
+			m_isOne[position] = one ? 1 : 0;
+			if (m_trackVoids)
+			{
+				if (one)
+					m_voids.Remove(position);
+				else
+					m_voids.Insert(position, m_energy[position], m_tieBreak[position]);
+			}
+			if (m_trackClusters)
+			{
+				if (one)
+					m_clusters.Insert(position, m_energy[position], m_tieBreak[position]);
+				else
+					m_clusters.Remove(position);
+			}
+
+			// The flipped position is the only change within each neighbor's footprint
+			for (int distance = -m_radius; distance <= m_radius; ++distance)
+			{
+				if (distance == 0)
+					continue;
+
+				int neighbor = Wrap(position + distance);
+				int64_t weight = m_gaussian[std::abs(distance)];
+				m_energy[neighbor] += one ? weight : -weight;
+				if (m_isOne[neighbor] && m_trackClusters)
+					m_clusters.Update(neighbor, m_energy[neighbor]);
+				else if (!m_isOne[neighbor] && m_trackVoids)
+					m_voids.Update(neighbor, m_energy[neighbor]);
+			}
+		}
+
+		int m_length;
+		int m_radius;
+		std::vector<int64_t> m_gaussian;
+		std::vector<uint8_t> m_isOne;
+		std::vector<int64_t> m_energy;
+		std::vector<uint32_t> m_tieBreak;
+		EnergyHeap<true> m_clusters;
+		EnergyHeap<false> m_voids;
+		bool m_trackClusters = true;
+		bool m_trackVoids = true;
+	};
+}
+
+// Makes a single void and cluster sequence.
+inline std::vector<size_t> MakeVoidAndCluster1D(size_t length, uint64_t seed, uint64_t sequenceIndex = 0, const VoidAndClusterSettings& settings = VoidAndClusterSettings())
+{
+	pcg32_random_t rng;
+	pcg32_srandom_r(&rng, seed, sequenceIndex);
+	VoidAndClusterInternal::Generator generator(length, rng, settings);
+	return generator.Generate(rng, settings.initialDensity);
+}
+
+// Makes several independent void and cluster sequences in parallel. A threadCount of 0 uses all the cores.
+inline std::vector<std::vector<size_t>> MakeVoidAndCluster1DSequences(size_t count, size_t length, uint64_t seed, const VoidAndClusterSettings& settings = VoidAndClusterSettings(), unsigned int threadCount = 0)
+{
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	threadCount = (unsigned int)std::min<size_t>(threadCount, count);
+
+	std::vector<std::vector<size_t>> ret(count);
+	std::vector<std::thread> threads;
+	for (unsigned int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		threads.emplace_back([&, threadIndex]()
+			{
+				for (size_t index = threadIndex; index < count; index += threadCount)
+					ret[index] = MakeVoidAndCluster1D(length, seed, index, settings);
+			}
+		);
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	return ret;
+}
+
+// Writes a sequence in the same format as the files in the bluenoise folder: the length, then the ranks, all as size_t.
+inline bool WriteVoidAndClusterFile(const char* fileName, const std::vector<size_t>& ranks)
+{
+	FILE* file = nullptr;
+	fopen_s(&file, fileName, "wb");
+	if (!file)
+		return false;
+
+	size_t length = ranks.size();
+	fwrite(&length, sizeof(size_t), 1, file);
+	fwrite(ranks.data(), sizeof(size_t), length, file);
+	fclose(file);
+	return true;
+}